@@ -29,7 +29,11 @@
 #include <stdio.h>
 
 #include <memory>
+#include <new>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 class CollationComparator;
 
@@ -99,6 +103,21 @@ private:
   X *itsPtr;             ///< The actual data pointer
 };
 
+/// A view of characters owned by somebody else, not zero terminated
+struct StringRef
+{
+  const char *data;
+  size_t size;
+
+  StringRef() : data(""), size(0) {}
+  StringRef(const char *data, size_t size) : data(data), size(size) {}
+
+  std::string str() const
+  {
+    return std::string(data, size);
+  }
+};
+
 /// An iterator to traverse a dictionary
 class DictionaryIterator
 {
@@ -110,9 +129,39 @@ public:
   virtual const char *getKeyword() = 0;
   virtual const char *getDescription() = 0;
 
+  /**
+   * Zero-copy access to the keyword and the description, for full
+   * dictionary scans. The views point into buffers owned by the iterator
+   * or the dictionary and are valid only until this or any other iterator
+   * of the same dictionary is moved or created, or the dictionary is
+   * edited. Copy the data with StringRef::str() to keep it longer.
+   */
+  virtual StringRef getKeywordRef()
+  {
+    const char *s = getKeyword();
+    return s != nullptr ? StringRef(s, strlen(s)) : StringRef();
+  }
+
+  virtual StringRef getDescriptionRef()
+  {
+    const char *s = getDescription();
+    return s != nullptr ? StringRef(s, strlen(s)) : StringRef();
+  }
+
   virtual bool nextEntry() = 0;
   virtual bool previousEntry() = 0;
 
+  /**
+   * True if the iterator points past the last entry (the position returned
+   * by end()). Cheaper than comparing with end(), which allocates an
+   * iterator and compares keywords. The default implementation compares the
+   * keyword with the terminal keyword (U+00B6).
+   */
+  virtual bool atEnd()
+  {
+    return strcmp(getKeyword(), "\xc2\xb6") == 0;
+  }
+
   bool operator==(DictionaryIterator &x)
   {
     return strcmp(getKeyword(), x.getKeyword()) == 0;
@@ -128,6 +177,220 @@ public:
 typedef OwnedPtr<DictionaryIterator> DictionaryIteratorPtr;
 // typedef std::unique_ptr<DictionaryIterator> DictionaryIteratorPtr;
 
+/**
+ * Move-only owner of an iterator. Iterators that fit in the inline buffer
+ * are constructed in place, so that a lookup does not have to allocate
+ * them on the heap; larger iterators are allocated as usual.
+ */
+class DictionaryIteratorHandle
+{
+public:
+  /// Size of the inline buffer for the concrete iterator
+  static const size_t INLINE_SIZE = 128;
+
+  DictionaryIteratorHandle() : itsPtr(nullptr), itsMove(nullptr) {}
+
+  /// Takes over an iterator allocated with new
+  explicit DictionaryIteratorHandle(DictionaryIterator *p) : itsPtr(p), itsMove(nullptr) {}
+
+  DictionaryIteratorHandle(DictionaryIteratorHandle &&r) : itsPtr(nullptr), itsMove(nullptr)
+  {
+    take(r);
+  }
+
+  DictionaryIteratorHandle &operator=(DictionaryIteratorHandle &&r)
+  {
+    if(&r != this) {
+      reset();
+      take(r);
+    }
+    return *this;
+  }
+
+  DictionaryIteratorHandle(const DictionaryIteratorHandle &) = delete;
+  DictionaryIteratorHandle &operator=(const DictionaryIteratorHandle &) = delete;
+
+  ~DictionaryIteratorHandle()
+  {
+    reset();
+  }
+
+  /// Constructs the concrete iterator T in the handle
+  template <class T, class... Args> T *emplace(Args&&... args)
+  {
+    reset();
+    T *p = construct<T>(FitsInline<T>(), std::forward<Args>(args)...);
+    itsPtr = p;
+    return p;
+  }
+
+  /// Destroys the iterator
+  void reset()
+  {
+    if(itsMove != nullptr)
+      itsPtr->~DictionaryIterator();
+    else
+      delete itsPtr;
+
+    itsPtr = nullptr;
+    itsMove = nullptr;
+  }
+
+  /// Hands the iterator over to the old style pointer
+  DictionaryIteratorPtr release()
+  {
+    DictionaryIterator *p = itsMove != nullptr ? itsMove(itsPtr, nullptr) : itsPtr;
+    itsPtr = nullptr;
+    itsMove = nullptr;
+    return DictionaryIteratorPtr(p);
+  }
+
+  /// Check the data pointed at is the same
+  bool operator==(const DictionaryIteratorHandle &x) const
+  {
+    return *itsPtr == *x.itsPtr;
+  }
+
+  /// Check the data pointed at is different
+  bool operator!=(const DictionaryIteratorHandle &x) const
+  {
+    return *itsPtr != *x.itsPtr;
+  }
+
+  /// The handle holds an iterator
+  bool isValid() const
+  {
+    return itsPtr != nullptr;
+  }
+
+  DictionaryIterator &operator*()  const  { return *itsPtr; }
+  DictionaryIterator *operator->() const  { return itsPtr; }
+  DictionaryIterator *get()        const  { return itsPtr; }
+
+private:
+  typedef union { void *p; long long l; double d; unsigned char c[INLINE_SIZE]; } Storage;
+
+  template <class T> struct FitsInline :
+    std::integral_constant<bool, sizeof(T) <= INLINE_SIZE && alignof(T) <= alignof(Storage)> {};
+
+  template <class T, class... Args> T *construct(std::true_type, Args&&... args)
+  {
+    itsMove = &moveIterator<T>;
+    return new (&itsStorage) T(std::forward<Args>(args)...);
+  }
+
+  template <class T, class... Args> T *construct(std::false_type, Args&&... args)
+  {
+    return new T(std::forward<Args>(args)...);
+  }
+
+  /// Moves an inline iterator to dst, or to the heap if dst is null
+  template <class T> static DictionaryIterator *moveIterator(DictionaryIterator *src, void *dst)
+  {
+    T *t = static_cast<T *>(src);
+    DictionaryIterator *moved = dst != nullptr ? new (dst) T(std::move(*t)) : new T(std::move(*t));
+    t->~T();
+    return moved;
+  }
+
+  /// Moves the iterator of r into this (empty) handle
+  void take(DictionaryIteratorHandle &r)
+  {
+    if(r.itsMove != nullptr) {
+      itsPtr = r.itsMove(r.itsPtr, &itsStorage);
+      itsMove = r.itsMove;
+    }
+    else {
+      itsPtr = r.itsPtr;
+    }
+
+    r.itsPtr = nullptr;
+    r.itsMove = nullptr;
+  }
+
+  DictionaryIterator *itsPtr;                                        ///< The iterator
+  DictionaryIterator *(*itsMove)(DictionaryIterator *, void *);      ///< Set if the iterator is inline
+  Storage itsStorage;                                                ///< Inline iterator
+};
+
+/// Counters of the lookup cache, see StaticDictionary::setCacheSize
+struct LookupCacheStats
+{
+  unsigned long hits;
+  unsigned long misses;
+  size_t entries;       ///< Lookups in the cache
+  size_t capacity;      ///< Lookups the cache can hold
+
+  LookupCacheStats() : hits(0), misses(0), entries(0), capacity(0)
+  {
+  }
+
+  double getHitRate() const
+  {
+    return hits + misses == 0 ? 0 : (double) hits / (hits + misses);
+  }
+};
+
+/**
+ * Counters of the work done by a dictionary, see StaticDictionary::getStats.
+ * Each counter is summed over all the lookups and iterations since the
+ * dictionary was loaded or the counters were reset.
+ */
+struct DictionaryStats
+{
+  unsigned long long lookups;           ///< findEntry calls
+  unsigned long long indexProbes;       ///< index entries compared with the word
+  unsigned long long bisectionSteps;    ///< steps of the binary search over the file
+  unsigned long long scanBytes;         ///< bytes scanned by findPrev and findNext
+  unsigned long long readCalls;         ///< read system calls
+  unsigned long long readBytes;         ///< bytes returned by them
+  unsigned long long chunksInflated;    ///< dictzip chunks decompressed
+  unsigned long long chunkHits;         ///< reads served by a chunk already inflated, here or by another process
+  unsigned long long cacheHits;         ///< lookups found in the lookup cache
+  unsigned long long cacheMisses;       ///< lookups not found in it
+  unsigned long long canonicalizations; ///< words canonized
+  unsigned long long decodes;           ///< strings decoded by SHCM
+  unsigned long long decodedBytes;      ///< bytes of the decoded strings
+  unsigned long long sqliteSteps;       ///< sqlite3_step calls
+
+  DictionaryStats() : lookups(0), indexProbes(0), bisectionSteps(0), scanBytes(0), readCalls(0),
+                      readBytes(0), chunksInflated(0), chunkHits(0), cacheHits(0), cacheMisses(0),
+                      canonicalizations(0), decodes(0), decodedBytes(0), sqliteSteps(0)
+  {
+  }
+
+  DictionaryStats &operator+=(const DictionaryStats &other)
+  {
+    lookups += other.lookups;
+    indexProbes += other.indexProbes;
+    bisectionSteps += other.bisectionSteps;
+    scanBytes += other.scanBytes;
+    readCalls += other.readCalls;
+    readBytes += other.readBytes;
+    chunksInflated += other.chunksInflated;
+    chunkHits += other.chunkHits;
+    cacheHits += other.cacheHits;
+    cacheMisses += other.cacheMisses;
+    canonicalizations += other.canonicalizations;
+    decodes += other.decodes;
+    decodedBytes += other.decodedBytes;
+    sqliteSteps += other.sqliteSteps;
+    return *this;
+  }
+};
+
+/// Result of one word of StaticDictionary::findEntries
+struct LookupResult
+{
+  std::string keyword;          ///< the entry findEntry would point to, empty if none
+  std::string description;
+  bool matches;                 ///< the matches flag of findEntry
+
+  LookupResult() : matches(false)
+  {
+  }
+};
+
 class StaticDictionary
 {
 public:
@@ -140,6 +403,100 @@ public:
 
   virtual DictionaryIteratorPtr findEntry(const char *keyword, bool &matches) = 0;
 
+  /**
+   * Same as begin, end and findEntry, but the iterator is returned in a
+   * move-only handle and is usually not allocated on the heap
+   */
+  virtual DictionaryIteratorHandle beginHandle()
+  {
+    return DictionaryIteratorHandle(begin().release());
+  }
+
+  virtual DictionaryIteratorHandle endHandle()
+  {
+    return DictionaryIteratorHandle(end().release());
+  }
+
+  virtual DictionaryIteratorHandle findEntryHandle(const char *keyword, bool &matches)
+  {
+    return DictionaryIteratorHandle(findEntry(keyword, matches).release());
+  }
+
+  /**
+   * Looks up several keywords at once; results[i] is what findEntry
+   * returns for keywords[i]. The results are copies, as the iterators of
+   * a dictionary share its position. Bedic dictionaries issue the reads
+   * of all the keywords together at every step of the search, so a batch
+   * of cold lookups costs about as many device round trips as a single
+   * one; the default implementation calls findEntryHandle for each.
+   *
+   * @return  false if a lookup failed, see getErrorMessage
+   */
+  virtual bool findEntries(const std::vector<std::string> &keywords, std::vector<LookupResult> &results)
+  {
+    results.assign(keywords.size(), LookupResult());
+    for(size_t i = 0; i < keywords.size(); i++) {
+      DictionaryIteratorHandle it = findEntryHandle(keywords[i].c_str(), results[i].matches);
+      if(!it.isValid())
+        return false;
+
+      if(!it->atEnd()) {
+        results[i].keyword = it->getKeyword();
+        results[i].description = it->getDescription();
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   * Ordinal access, for scrollbars and pagination. Entries are counted
+   * from 0 in the dictionary order.
+   *
+   * getEntryCount returns the number of entries, seekOrdinal an iterator
+   * at the n-th entry (an invalid iterator if n is out of range) and
+   * rankOf the number of entries that sort before the keyword. The number
+   * of entries between two keywords is rankOf(b) - rankOf(a).
+   * getEntryCount and rankOf return -1 on error.
+   *
+   * The default implementations walk the dictionary.
+   */
+  virtual long getEntryCount()
+  {
+    long n = 0;
+    for(DictionaryIteratorHandle it = beginHandle(); it.isValid() && !it->atEnd(); it->nextEntry())
+      n++;
+
+    return n;
+  }
+
+  virtual DictionaryIteratorPtr seekOrdinal(long n)
+  {
+    DictionaryIteratorHandle it = beginHandle();
+    for( ; n > 0 && it.isValid() && !it->atEnd(); n--)
+      it->nextEntry();
+
+    if(n != 0 || !it.isValid() || it->atEnd())
+      return DictionaryIteratorPtr(nullptr);
+
+    return it.release();
+  }
+
+  virtual long rankOf(const char *keyword)
+  {
+    bool matches;
+    DictionaryIteratorHandle found = findEntryHandle(keyword, matches);
+    if(!found.isValid())
+      return -1;
+
+    long n = 0;
+    for(DictionaryIteratorHandle it = beginHandle(); it.isValid() && !it->atEnd() && *it != *found;
+        it->nextEntry())
+      n++;
+
+    return n;
+  }
+
   virtual const char *getName() = 0;
   virtual const char *getFileName() = 0;
 
@@ -147,11 +504,83 @@ public:
 
   virtual const char *getErrorMessage() = 0;
 
+  /**
+   * Optional cache of findEntry results keyed by the canonized keyword,
+   * so repeated lookups of frequent words skip the search and the
+   * decompression. The cache holds up to entries lookups, 0 (the
+   * default) disables it. Editing a dictionary empties its cache.
+   *
+   * getCacheStats returns false if the dictionary has no cache.
+   */
+  virtual void setCacheSize(size_t /* entries */)
+  {
+  }
+
+  virtual bool getCacheStats(LookupCacheStats & /* stats */)
+  {
+    return false;
+  }
+
+  /**
+   * Hint that the dictionary is about to be read from begin() to end(),
+   * as by exports and reindexing. Bedic dictionaries then read the file
+   * in large blocks, ask the kernel to read ahead and inflate the next
+   * dictzip chunks on a background thread. Lookups still work, but are
+   * slower; turn the mode off when the scan is over.
+   */
+  virtual void setSequentialAccess(bool /* sequential */)
+  {
+  }
+
+  /**
+   * Keeps the inflated chunks of a dictzip dictionary in a sparse file
+   * next to it (foo.dic.dz.chunks), so that every chunk is inflated once
+   * and then read like a plain file. Costs up to the uncompressed size
+   * of the dictionary in disk space. Off by default; does nothing for
+   * plain files or if the directory is not writable. The file is shared
+   * by processes and kept between runs, until the dictionary changes.
+   */
+  virtual void setChunkCacheFile(bool /* enable */)
+  {
+  }
+
+  /**
+   * Snapshot of the counters of the work done by the lookups, to tell
+   * why one lookup is slower than another. The counters are relaxed
+   * atomics, so they can be read while another thread does lookups.
+   *
+   * The counters exist only if the library was built with BEDIC_STATS
+   * (make STATS=1); otherwise getStats returns false.
+   */
+  virtual bool getStats(DictionaryStats & /* stats */)
+  {
+    return false;
+  }
+
+  /// Sets all the counters of getStats to 0
+  virtual void resetStats()
+  {
+  }
+
   virtual bool checkIntegrity()
   {
     return true;
   }
 
+  /**
+   * Reads the whole dictionary and checks it against the block checksums
+   * written by xerox, mkbedic and DictionaryWriter, with threads threads
+   * (0 for one per processor). Dictionaries without checksums are only
+   * checked with checkIntegrity.
+   *
+   * checkIntegrity (and loading with doCheckIntegrity) checks a block
+   * only when it is first read, which costs nothing at load time.
+   */
+  virtual bool verifyChecksums(int /* threads */ = 0)
+  {
+    return checkIntegrity();
+  }
+
   virtual CollationComparator *getCollationComparator()
   {
     return nullptr;
@@ -180,6 +609,17 @@ public:
   static StaticDictionary *loadDictionary(const char *filename, bool doCheckIntegrity,
                                           std::string &errorMessage);
 
+  /**
+   * Turns on the cache shared by the processes that load the same bedic
+   * dictionaries: a file per dictionary in dir holds its parsed header,
+   * index and collation and the dictzip chunks inflated last, so that
+   * the next process loads the dictionary without parsing the header and
+   * its lookups start with warm chunks. A dictionary that changed is
+   * loaded from its file again. An empty dir (the default) turns the
+   * cache off; dictionaries loaded before are not affected.
+   */
+  static void setSharedCacheDirectory(const char *dir);
+
 };
 
 class DynamicDictionary : public StaticDictionary
@@ -207,6 +647,14 @@ DynamicDictionary *createSQLiteDictionary(const char *fileName, const char *name
 DynamicDictionary *createHybridDictionary(const char *fileName, StaticDictionary *static_dic,
                                           std::string &errorMessage);
 
+/**
+ * Merges the dynamic part of a hybrid dictionary (foo.hdic) into its
+ * static part (foo.dic.dz), which is rewritten, and empties the dynamic
+ * part. Static entries removed from the hybrid dictionary are dropped.
+ * The dictionary must not be open.
+ */
+bool compactHybridDictionary(const char *fileName, std::string &errorMessage);
+
 std::string formatDicEntry(std::string entry);
 
 #endif  /* BEDIC_H */
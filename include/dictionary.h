@@ -28,7 +28,14 @@
 #ifndef DICTIONARY_H
 #define DICTIONARY_H
 
+#include <stddef.h>
+
 #include <string>
+#include <vector>
+
+struct LookupCacheStats;
+struct DictionaryStats;
+struct LookupResult;
 
 /**
  * This is an abstract class that represents a Dictionary
@@ -80,6 +87,15 @@ public:
    */
   virtual bool findEntry(const std::string &word, bool &subword) = 0;
 
+  /**
+   * Looks for several words at once, reading the file for all of them
+   * together. The result of each word is the one of findEntry; the
+   * internal word pointer is left at an undefined entry.
+   *
+   * @return  true if no error occurred
+   */
+  virtual bool findEntries(const std::vector<std::string> &words, std::vector<LookupResult> &results) = 0;
+
   /**
    * Moves the internal word pointer to the next word.
    *
@@ -89,6 +105,15 @@ public:
    */
   virtual bool nextEntry() = 0;
 
+  /**
+   * Moves the internal word pointer to the previous word.
+   *
+   * If the pointer is set to the first word, it is not changed.
+   *
+   * @return  true if the pointer is moved
+   */
+  virtual bool previousEntry() = 0;
+
   /**
    * Moves the internal word pointer to the first word.
    * 
@@ -110,6 +135,68 @@ public:
    */
   virtual bool randomEntry() = 0;
 
+  /**
+   * Returns the number of entries in the dictionary
+   *
+   * @return  number of entries, or -1 if error
+   */
+  virtual long getEntryCount() = 0;
+
+  /**
+   * Tells if the dictionary has no entries, without counting them
+   */
+  virtual bool isEmpty() const = 0;
+
+  /**
+   * Moves the internal word pointer to the n-th entry (counted from 0).
+   *
+   * @return  true if the word is read successfully
+   */
+  virtual bool seekOrdinal(long n) = 0;
+
+  /**
+   * Returns the number of entries that sort before the word, i.e. the
+   * ordinal the word has or would have in the dictionary. Moves the
+   * internal word pointer.
+   *
+   * @return  rank of the word, or -1 if error
+   */
+  virtual long rankOf(const std::string &word) = 0;
+
+  /**
+   * Sets the number of findEntry results that are cached, 0 disables
+   * the cache
+   */
+  virtual void setCacheSize(size_t entries) = 0;
+
+  /**
+   * Turns on the mode for reading the whole dictionary with nextEntry:
+   * the file is read in large blocks with read-ahead and dictzip chunks
+   * are inflated ahead on another thread
+   */
+  virtual void setSequentialAccess(bool sequential) = 0;
+
+  /**
+   * Keeps the inflated chunks of a dictzip file in a cache file next to
+   * it, so that every chunk is inflated once
+   */
+  virtual void setChunkCacheFile(bool enable) = 0;
+
+  /**
+   * Returns the counters of the findEntry cache
+   */
+  virtual void getCacheStats(LookupCacheStats &stats) const = 0;
+
+  /**
+   * Returns the counters of the work done by the lookups
+   *
+   * @return  false if the library was built without BEDIC_STATS
+   */
+  virtual bool getStats(DictionaryStats &stats) const = 0;
+
+  /// Sets the counters of getStats to 0
+  virtual void resetStats() = 0;
+
   /**
    * Returns the word pointed by the internal word pointer
    *
@@ -124,6 +211,34 @@ public:
    */
   virtual const std::string &getSense() const = 0;
 
+  /**
+   * Returns the word pointed by the internal word pointer without copying
+   * it. The data is not zero terminated and is valid only until the word
+   * pointer is moved.
+   *
+   * @param length  set to the length of the word in bytes
+   * @return  pointer to the first byte of the word
+   */
+  virtual const char *getWordData(size_t &length) const
+  {
+    length = getWord().size();
+    return getWord().data();
+  }
+
+  /**
+   * Returns the sense of the current word without copying it (unless the
+   * dictionary is compressed). The data is not zero terminated and is valid
+   * only until the word pointer is moved.
+   *
+   * @param length  set to the length of the sense in bytes
+   * @return  pointer to the first byte of the sense
+   */
+  virtual const char *getSenseData(size_t &length) const
+  {
+    length = getSense().size();
+    return getSense().data();
+  }
+
   /**
    * Returns error description or zero if no error
    *
@@ -145,6 +260,15 @@ public:
    * @return  true if integrity check is succesfull - dictionary file is not corrupted.
    */
   virtual bool checkIntegrity() = 0;
+
+  /**
+   * Checks the whole file against the block checksums written by the
+   * builders, in parallel
+   *
+   * @param threads  number of threads, 0 for one per processor
+   * @return  true if the file is not corrupted
+   */
+  virtual bool verifyChecksums(int threads) = 0;
 };
 
 #endif  /* DICTIONARY_H */
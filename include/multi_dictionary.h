@@ -0,0 +1,123 @@
+/**
+ * @file   multi_dictionary.h
+ * @brief  Search many static dictionaries as one
+ * @author Lyndon Hill and others
+ */
+
+#pragma once
+#ifndef MULTI_DICTIONARY_H
+#define MULTI_DICTIONARY_H
+
+#include <string>
+#include <vector>
+
+#include "bedic.h"
+
+class ThreadPool;
+
+/// An entry found by MultiDictionary::lookup
+struct MultiDictionaryHit
+{
+  int dictionary;             ///< Index of the dictionary the entry comes from
+  bool matches;               ///< The keyword is the one that was looked up
+  std::string keyword;
+  std::string description;
+};
+
+/**
+ * Federated search over several static dictionaries (usually of the same
+ * language pair). Iterators merge the entries of all dictionaries in the
+ * collation order of the first one; entries with the same keyword come in
+ * the order of the dictionaries. Lookups search the dictionaries in
+ * parallel, one thread per dictionary at most.
+ *
+ * The dictionaries are owned by MultiDictionary. They must not be used
+ * from other threads while MultiDictionary searches them.
+ */
+class MultiDictionary : public StaticDictionary
+{
+  friend MultiDictionary *createMultiDictionary(const std::vector<StaticDictionary *> &dictionaries,
+                                                int threads, std::string &errorMessage);
+  friend class MultiDictionaryIterator;
+
+protected:
+  std::vector<StaticDictionary *> dictionaries;
+  CollationComparator *cmp;
+  ThreadPool *pool;
+
+  std::string name;
+  std::string errorString;
+
+  MultiDictionary(const std::vector<StaticDictionary *> &dictionaries, int threads);
+
+  /// Finds the keyword in every dictionary, in parallel
+  bool findEntries(const char *keyword, std::vector<DictionaryIteratorHandle> &found, bool &matches);
+
+public:
+  ~MultiDictionary();
+
+  virtual DictionaryIteratorPtr begin();
+  virtual DictionaryIteratorPtr end();
+
+  virtual DictionaryIteratorPtr findEntry(const char *keyword, bool &matches);
+
+  virtual DictionaryIteratorHandle beginHandle();
+  virtual DictionaryIteratorHandle endHandle();
+
+  virtual DictionaryIteratorHandle findEntryHandle(const char *keyword, bool &matches);
+
+  /**
+   * Collects up to count entries from the keyword on, merged in collation
+   * order. Each dictionary reads its entries in its own thread.
+   * @return false on error
+   */
+  bool lookup(const char *keyword, int count, std::vector<MultiDictionaryHit> &hits);
+
+  int getDictionaryCount() const
+  {
+    return dictionaries.size();
+  }
+
+  StaticDictionary *getDictionary(int i)
+  {
+    return dictionaries[i];
+  }
+
+  virtual const char *getName();
+  virtual const char *getFileName();
+
+  virtual bool getProperty(const char *propertyName, std::string &propertyValue);
+
+  virtual const char *getErrorMessage();
+
+  /// Every dictionary gets a cache of the size, the counters are summed
+  virtual void setCacheSize(size_t entries);
+  virtual bool getCacheStats(LookupCacheStats &stats);
+
+  /// Every dictionary is switched
+  virtual void setSequentialAccess(bool sequential);
+  virtual void setChunkCacheFile(bool enable);
+
+  /// The counters of all the dictionaries are summed
+  virtual bool getStats(DictionaryStats &stats);
+  virtual void resetStats();
+
+  /// Checks the dictionaries one after another
+  virtual bool verifyChecksums(int threads);
+
+  virtual CollationComparator *getCollationComparator()
+  {
+    return cmp;
+  }
+};
+
+/**
+ * Create a federated dictionary, which takes over the dictionaries
+ * @param dictionaries  At least one dictionary
+ * @param threads       Threads used by lookups, 0 for one per processor
+ * @param errorMessage  Set if the dictionary can not be created
+ */
+MultiDictionary *createMultiDictionary(const std::vector<StaticDictionary *> &dictionaries,
+                                       int threads, std::string &errorMessage);
+
+#endif  /* MULTI_DICTIONARY_H */
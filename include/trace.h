@@ -0,0 +1,132 @@
+/**
+ * @file   trace.h
+ * @brief  Timed spans of the phases of lookups, for debugging latency
+ * @author Lyndon Hill and others
+ *
+ * Tracing is off until a callback or a buffer is installed. While it is
+ * off, a traced phase costs one relaxed atomic load. The spans of all
+ * the dictionaries of the process go to the same callback or buffer.
+ */
+
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+/// Traced phases, see Trace::getPhaseName
+enum TracePhase
+{
+  TRACE_LOOKUP,          ///< a whole DictImpl::findEntry
+  TRACE_INDEX_SEARCH,    ///< binary search of the index property
+  TRACE_BISECTION,       ///< binary search over the bytes of the file
+  TRACE_READ_ENTRY,      ///< reading and splitting one entry
+  TRACE_INFLATE,         ///< inflating one dictzip chunk
+  TRACE_DECODE,          ///< one SHCM decode
+  TRACE_FORMAT,          ///< formatDicEntry
+  TRACE_PHASE_COUNT
+};
+
+/// A timed phase; the times are CLOCK_MONOTONIC nanoseconds
+struct TraceSpan
+{
+  TracePhase phase;
+  unsigned int thread;   ///< small number identifying the thread
+  unsigned long long start;
+  unsigned long long end;
+  long long arg;         ///< file position, chunk or size, depending on the phase
+};
+
+typedef void (*TraceCallback)(const TraceSpan &span, void *data);
+
+/**
+ * @class Trace
+ *
+ * Spans are passed to a callback, called on the thread that ran the
+ * phase, stored in a ring buffer, or both. The buffer is lock-free: each
+ * thread claims a slot with an atomic increment, and the oldest spans
+ * are overwritten when the buffer is full. collectSpans drains it; it
+ * must not be called by two threads at once.
+ *
+ * setCallback and setBufferSize must not be called while lookups run.
+ */
+class Trace
+{
+public:
+  /// Sends the spans to callback, null turns tracing off
+  static void setCallback(TraceCallback callback, void *data);
+
+  /// Stores the last capacity spans (rounded up to a power of 2), 0 turns tracing off
+  static void setBufferSize(size_t capacity);
+
+  /**
+   * Appends the spans stored since the last call, oldest first
+   *
+   * @return  number of spans lost because the buffer was full
+   */
+  static size_t collectSpans(std::vector<TraceSpan> &spans);
+
+  static const char *getPhaseName(TracePhase phase);
+
+  /// Time of the monotonic clock in nanoseconds
+  static unsigned long long now();
+
+  static bool isEnabled()
+  {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  /// Passes the span to the callback or the buffer
+  static void record(const TraceSpan &span);
+
+private:
+  static std::atomic<bool> enabled;
+};
+
+/**
+ * @class TraceScope
+ *
+ * Traces the phase from the construction to the destruction of the
+ * object, if tracing was on when it was constructed.
+ */
+class TraceScope
+{
+  TraceSpan span;
+
+public:
+  explicit TraceScope(TracePhase phase, long long arg = 0)
+  {
+    span.start = Trace::isEnabled() ? Trace::now() : 0;
+    span.phase = phase;
+    span.arg = arg;
+  }
+
+  ~TraceScope()
+  {
+    finish();
+  }
+
+  /// Ends the phase before the object is destroyed
+  void finish()
+  {
+    if(span.start != 0) {
+      span.end = Trace::now();
+      Trace::record(span);
+      span.start = 0;
+    }
+  }
+
+  /// Sets the argument when it is known only at the end of the phase
+  void setArg(long long arg)
+  {
+    span.arg = arg;
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+};
+
+#endif  /* TRACE_H */
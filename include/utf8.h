@@ -32,9 +32,17 @@ public:
   static int tolower(const std::string &, std::string &);
   static int toupper(const std::string &, std::string &);
 
+  /// Decode one rune (up to 4 bytes), returns 128 if the sequence is invalid
   static unsigned int chartorune(const char **s);
   static int runetochar(char *s, int rune);
   static unsigned int runetoupper(unsigned int c);
+  static unsigned int runetolower(unsigned int c);
+
+  /// runetoupper by binary search of the range tables, the reference for the lookup tables
+  static unsigned int runetoupperSearch(unsigned int c);
+
+  /// Number of leading ASCII bytes in s, stops at a zero byte or after len bytes
+  static int asciiSpan(const char *s, int len);
 };
 
 #endif  /* UTF8_H */
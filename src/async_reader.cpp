@@ -0,0 +1,52 @@
+/**
+ * @file   async_reader.cpp
+ * @brief  Reads several blocks of a file at once
+ * @author Lyndon Hill and others
+ */
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "async_reader.h"
+#include "thread_pool.h"
+
+/// Reads the rest of a request from done bytes on, pread may return less
+static void readRequest(int fd, ReadRequest &request, int done)
+{
+  while(done < request.len) {
+    ssize_t n = pread(fd, request.buf + done, request.len - done, request.pos + done);
+    if(n < 0 && errno == EINTR) continue;
+    if(n < 0) {
+      request.result = -1;
+      return;
+    }
+    if(n == 0) break;
+    done += n;
+  }
+
+  request.result = done;
+}
+
+/// Threads of the pool; they wait for the device, so more than processors
+static const int READ_THREADS = 16;
+
+static ThreadPool &readPool()
+{
+  static ThreadPool pool(READ_THREADS);
+  return pool;
+}
+
+void readRequests(int fd, ReadRequest *requests, int count)
+{
+  for(int i = 0; i < count; i++)
+    requests[i].result = -1;
+
+  if(count == 1) {
+    readRequest(fd, requests[0], 0);
+    return;
+  }
+
+  readPool().run(count, [fd, requests](int i) {
+    readRequest(fd, requests[i], 0);
+  });
+}
@@ -0,0 +1,31 @@
+/**
+ * @file   async_reader.h
+ * @brief  Reads several blocks of a file at once
+ * @author Lyndon Hill and others
+ */
+
+#pragma once
+#ifndef ASYNC_READER_H
+#define ASYNC_READER_H
+
+#include <sys/types.h>
+
+/// One read of a batch, see readRequests and File::readBatch
+struct ReadRequest
+{
+  off_t pos;
+  char *buf;
+  int len;
+  int result;      ///< bytes read, -1 if error
+};
+
+/**
+ * Reads the requests from fd and returns when all are done. The reads of
+ * a batch are issued together, so that it costs one device round trip
+ * when the data is not in the page cache. They are run by a pool of
+ * threads shared by all the files, each thread doing a blocking pread;
+ * batches of several threads are read at the same time.
+ */
+void readRequests(int fd, ReadRequest *requests, int count);
+
+#endif  /* ASYNC_READER_H */
@@ -2,8 +2,8 @@
  * @file   bedic_wrapper.cpp
  * @brief  This file contains a wrapper for the original bedic Dictionary class
  *         (file dictionary.cpp), so that it can be interfaced as a
- *         StaticDictionary. This dictionary does not implement
- *         DictionaryIterator::previous().
+ *         StaticDictionary. DictionaryIterator::previous() steps back
+ *         with Dictionary::previousEntry.
  * @author Lyndon Hill and others
  *
  * Copyright (C) 2005 Rafal Mantiuk <rafm@users.sourceforge.net>
@@ -24,11 +24,12 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "bedic.h"
 #include "dictionary.h"
 
-extern char terminal_keyword[];
+extern unsigned char terminal_keyword[];
 
 class BedicDictionaryIterator;
 
@@ -57,6 +58,16 @@ public:
 
   virtual DictionaryIteratorPtr findEntry(const char *keyword, bool &matches);
 
+  virtual DictionaryIteratorHandle beginHandle();
+  virtual DictionaryIteratorHandle endHandle();
+
+  virtual DictionaryIteratorHandle findEntryHandle(const char *keyword, bool &matches);
+  virtual bool findEntries(const std::vector<std::string> &keywords, std::vector<LookupResult> &results);
+
+  virtual long getEntryCount();
+  virtual DictionaryIteratorPtr seekOrdinal(long n);
+  virtual long rankOf(const char *keyword);
+
   virtual const char *getName();
   virtual const char *getFileName();
 
@@ -64,7 +75,15 @@ public:
 
   virtual const char *getErrorMessage();
 
+  virtual void setCacheSize(size_t entries);
+  virtual void setSequentialAccess(bool sequential);
+  virtual void setChunkCacheFile(bool enable);
+  virtual bool getCacheStats(LookupCacheStats &stats);
+  virtual bool getStats(DictionaryStats &stats);
+  virtual void resetStats();
+
   virtual bool checkIntegrity();
+  virtual bool verifyChecksums(int threads);
 };
 
 //============== Iterator ==============
@@ -80,13 +99,9 @@ public:
   {
   }
 
-  ~BedicDictionaryIterator()
-  {
-  }
-
   const char *getKeyword() 
   {
-    if(lastEntry) return terminal_keyword;
+    if(lastEntry) return reinterpret_cast<const char *>(terminal_keyword);
     return dic->getWord().c_str();
   }
 
@@ -96,6 +111,32 @@ public:
     return dic->getSense().c_str();
   }
 
+  virtual StringRef getKeywordRef()
+  {
+    if(lastEntry) {
+      const char *keyword = reinterpret_cast<const char *>(terminal_keyword);
+      return StringRef(keyword, strlen(keyword));
+    }
+
+    size_t length;
+    const char *data = dic->getWordData(length);
+    return StringRef(data, length);
+  }
+
+  virtual StringRef getDescriptionRef()
+  {
+    if(lastEntry) return StringRef();
+
+    size_t length;
+    const char *data = dic->getSenseData(length);
+    return StringRef(data, length);
+  }
+
+  bool atEnd()
+  {
+    return lastEntry;
+  }
+
   bool nextEntry()
   {
     if(lastEntry)
@@ -113,7 +154,15 @@ public:
 
   bool previousEntry()
   {
-    return false;
+    if(lastEntry) {
+      if(!dic->lastEntry())
+        return false;
+
+      lastEntry = false;
+      return true;
+    }
+
+    return dic->previousEntry();
   }
 };
 
@@ -126,29 +175,71 @@ BedicDictionary::~BedicDictionary()
 
 DictionaryIteratorPtr BedicDictionary::begin()
 {
-  bool success = dic->firstEntry();
-  if(!success)
-    return DictionaryIteratorPtr(nullptr);
-
-  return DictionaryIteratorPtr(new BedicDictionaryIterator(dic, false));
+  return beginHandle().release();
 }
 
 DictionaryIteratorPtr BedicDictionary::end()
 {
-  return DictionaryIteratorPtr(new BedicDictionaryIterator(dic, true));
+  return endHandle().release();
 }
 
 DictionaryIteratorPtr BedicDictionary::findEntry(const char *keyword, bool &matches)
 {
+  return findEntryHandle(keyword, matches).release();
+}
+
+DictionaryIteratorHandle BedicDictionary::beginHandle()
+{
+  // the first entry of an empty dictionary is its end
+  DictionaryIteratorHandle it;
+  if(dic->firstEntry() || (dic->isEmpty() && dic->getError() == ""))
+    it.emplace<BedicDictionaryIterator>(dic, dic->isEmpty());
+
+  return it;
+}
+
+DictionaryIteratorHandle BedicDictionary::endHandle()
+{
+  DictionaryIteratorHandle it;
+  it.emplace<BedicDictionaryIterator>(dic, true);
+  return it;
+}
+
+DictionaryIteratorHandle BedicDictionary::findEntryHandle(const char *keyword, bool &matches)
+{
+  DictionaryIteratorHandle it;
   bool subword;
   matches = dic->findEntry(keyword, subword);
 
-  if(dic->getError() != "")
+  if(dic->getError() == "")
+    it.emplace<BedicDictionaryIterator>(dic, dic->isEmpty());
+
+  return it;
+}
+
+bool BedicDictionary::findEntries(const std::vector<std::string> &keywords, std::vector<LookupResult> &results)
+{
+  return dic->findEntries(keywords, results) && dic->getError() == "";
+}
+
+long BedicDictionary::getEntryCount()
+{
+  return dic->getEntryCount();
+}
+
+DictionaryIteratorPtr BedicDictionary::seekOrdinal(long n)
+{
+  if(!dic->seekOrdinal(n))
     return DictionaryIteratorPtr(nullptr);
 
   return DictionaryIteratorPtr(new BedicDictionaryIterator(dic, false));
 }
 
+long BedicDictionary::rankOf(const char *keyword)
+{
+  return dic->rankOf(keyword);
+}
+
 const char *BedicDictionary::getName()
 {
   return dic->getName().c_str();
@@ -170,11 +261,47 @@ const char *BedicDictionary::getErrorMessage()
   return dic->getError().c_str();
 }
 
+void BedicDictionary::setCacheSize(size_t entries)
+{
+  dic->setCacheSize(entries);
+}
+
+void BedicDictionary::setSequentialAccess(bool sequential)
+{
+  dic->setSequentialAccess(sequential);
+}
+
+void BedicDictionary::setChunkCacheFile(bool enable)
+{
+  dic->setChunkCacheFile(enable);
+}
+
+bool BedicDictionary::getCacheStats(LookupCacheStats &stats)
+{
+  dic->getCacheStats(stats);
+  return true;
+}
+
+bool BedicDictionary::getStats(DictionaryStats &stats)
+{
+  return dic->getStats(stats);
+}
+
+void BedicDictionary::resetStats()
+{
+  dic->resetStats();
+}
+
 bool BedicDictionary::checkIntegrity()
 {
   return dic->checkIntegrity();
 }
 
+bool BedicDictionary::verifyChecksums(int threads)
+{
+  return dic->verifyChecksums(threads);
+}
+
 StaticDictionary *loadBedicDictionary(const char *filename, bool doCheckIntegrity,
                                       std::string &errorMessage)
 {
@@ -0,0 +1,332 @@
+/**
+ * @file   bench.cpp
+ * @brief  Microbenchmarks of lookups, iteration, collation, SHCM, the
+ *         SQLite and hybrid dictionaries and mkbedic. Each benchmark
+ *         reports latency percentiles and throughput.
+ * @author Lyndon Hill and others
+ *
+ * The dictionaries are generated in a temporary directory from a fixed
+ * seed, so the numbers of two builds can be compared.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bedic.h"
+#include "dictionary_impl.h"
+#include "dictionary_writer.h"
+#include "shcm.h"
+
+/// Deterministic pseudo random generator, the same data on every platform
+static unsigned int nextRandom(unsigned int &state)
+{
+  state = state * 1103515245u + 12345u;
+  return (state >> 16) & 0x7fff;
+}
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static std::vector<std::string> keywords, senses;
+static unsigned int sink = 0;
+
+/// Sorted, unique lower case keywords; they sort the same canonized
+static void makeCorpus(int count)
+{
+  static const char *words[] = {
+    "noun", "verb", "adjective", "the", "of", "a", "meaning", "used", "in", "sense",
+    "figurative", "colloquial", "especially", "see", "also", "plural", "obsolete"
+  };
+  const int nwords = sizeof(words) / sizeof(words[0]);
+
+  unsigned int state = 42;
+  for(int i = 0; i < count; i++) {
+    std::string w;
+    int len = 3 + nextRandom(state) % 10;
+    for(int j = 0; j < len; j++)
+      w += (char) ('a' + nextRandom(state) % 26);
+    keywords.push_back(w);
+  }
+
+  std::sort(keywords.begin(), keywords.end());
+  keywords.erase(std::unique(keywords.begin(), keywords.end()), keywords.end());
+
+  for(unsigned int i = 0; i < keywords.size(); i++) {
+    std::string s = "{s}{ss}";
+    int len = 5 + nextRandom(state) % 40;
+    for(int j = 0; j < len; j++) {
+      if(j != 0) s += ' ';
+      s += words[nextRandom(state) % nwords];
+    }
+    s += "{/ss}{/s}";
+    senses.push_back(s);
+  }
+}
+
+/**
+ * Runs op(0) ... op(count - 1), timing each call, and prints the
+ * percentiles of the latencies and the number of calls per second
+ */
+template <class Op>
+static void measure(const char *name, int count, Op op)
+{
+  std::vector<double> latency(count);
+  double start = now();
+  for(int i = 0; i < count; i++) {
+    double t = now();
+    op(i);
+    latency[i] = now() - t;
+  }
+  double total = now() - start;
+
+  std::sort(latency.begin(), latency.end());
+  printf("%-30s %8d %10.2f %10.2f %10.2f %10.2f %12.0f\n", name, count,
+         latency[count / 2] * 1e6, latency[count * 9 / 10] * 1e6, latency[count * 99 / 100] * 1e6,
+         latency[count - 1] * 1e6, count / total);
+}
+
+static bool writeDictionary(const char *fileName, bool dictzip)
+{
+  DictionaryWriter writer;
+  writer.setProperty("id", "Benchmark");
+  for(unsigned int i = 0; i < keywords.size(); i++)
+    writer.addEntry(keywords[i].data(), keywords[i].size(), senses[i].data(), senses[i].size());
+
+  if(!writer.write(fileName, dictzip)) {
+    fprintf(stderr, "Cannot write %s: %s\n", fileName, writer.getError().c_str());
+    return false;
+  }
+
+  return true;
+}
+
+/// Lookups of existing keywords, of missing ones and of prefixes
+static void benchLookups(const char *fileName, const char *label, int count)
+{
+  DictImpl dic(fileName, false);
+  if(!dic.getError().empty()) {
+    fprintf(stderr, "Cannot open %s: %s\n", fileName, dic.getError().c_str());
+    return;
+  }
+
+  std::mt19937 generator(7);
+  std::uniform_int_distribution<size_t> anyKeyword(0, keywords.size() - 1);
+  std::vector<std::string> hits, misses, prefixes;
+  for(int i = 0; i < count; i++) {
+    const std::string &k = keywords[anyKeyword(generator)];
+    hits.push_back(k);
+    misses.push_back(k + "0");
+    prefixes.push_back(k.substr(0, 3));
+  }
+
+  std::string name;
+  bool subword;
+
+  name = std::string("findEntry hit ") + label;
+  measure(name.c_str(), count, [&](int i) {
+    sink += dic.findEntry(hits[i], subword);
+    size_t length;
+    sink += dic.getSenseData(length)[0];
+  });
+
+  name = std::string("findEntry miss ") + label;
+  measure(name.c_str(), count, [&](int i) { sink += dic.findEntry(misses[i], subword); });
+
+  name = std::string("findEntry prefix ") + label;
+  measure(name.c_str(), count, [&](int i) { sink += dic.findEntry(prefixes[i], subword); });
+
+  // Zipfian traffic: the word of rank k is looked up in proportion to
+  // 1 / k, drawn by inverting the cumulative harmonic weights
+  dic.setCacheSize(1024);
+  size_t ranks = std::min<size_t>(4096, hits.size());
+  std::vector<double> weights(ranks);
+  for(size_t k = 0; k < ranks; k++)
+    weights[k] = (k > 0 ? weights[k - 1] : 0) + 1.0 / (k + 1);
+
+  std::uniform_real_distribution<double> anyWeight(0, weights.back());
+  std::vector<std::string> zipf;
+  for(int i = 0; i < count; i++) {
+    size_t rank = std::upper_bound(weights.begin(), weights.end(), anyWeight(generator)) - weights.begin();
+    zipf.push_back(hits[std::min(rank, ranks - 1)]);
+  }
+
+  name = std::string("findEntry cached ") + label;
+  measure(name.c_str(), count, [&](int i) { sink += dic.findEntry(zipf[i], subword); });
+
+  name = std::string("iteration ") + label;
+  dic.firstEntry();
+  measure(name.c_str(), keywords.size() - 1, [&](int) {
+    sink += dic.nextEntry();
+    size_t length;
+    sink += dic.getWordData(length)[0];
+  });
+}
+
+static void benchCollation()
+{
+  CollationComparator cmp;
+  cmp.setCollation("", "-.");
+
+  std::vector<CanonizedWord> words(keywords.size());
+  measure("canonizeWord", keywords.size(), [&](int i) {
+    cmp.canonizeWord(keywords[i].data(), keywords[i].size(), words[i]);
+  });
+
+  measure("compare", keywords.size() - 1, [&](int i) { sink += cmp.compare(words[i], words[i + 1]) + 1; });
+}
+
+static void benchSHCM()
+{
+  SHCM *shcm = SHCM::create();
+  shcm->startPreEncode();
+  for(unsigned int i = 0; i < senses.size(); i++)
+    shcm->preencode(senses[i]);
+  std::string tree = shcm->endPreEncode();
+
+  std::vector<std::string> encoded;
+  for(unsigned int i = 0; i < senses.size(); i++)
+    encoded.push_back(shcm->encode(senses[i]));
+
+  shcm->startDecode(tree);
+  measure("SHCM decode", encoded.size(), [&](int i) { sink += shcm->decode(encoded[i]).size(); });
+  shcm->endDecode();
+}
+
+static void benchSQLite(const char *fileName, int count)
+{
+  std::string errorMessage;
+  DynamicDictionary *dic = createSQLiteDictionary(fileName, "Benchmark", errorMessage);
+  if(dic == nullptr) {
+    fprintf(stderr, "Cannot create %s: %s\n", fileName, errorMessage.c_str());
+    return;
+  }
+
+  int step = keywords.size() / count;
+  measure("SQLite insert", count, [&](int i) {
+    DictionaryIteratorPtr it = dic->insertEntry(keywords[i * step].c_str());
+    if(it.isValid())
+      sink += dic->updateEntry(it, senses[i * step].c_str());
+  });
+
+  measure("SQLite findEntry", count, [&](int i) {
+    bool matches;
+    DictionaryIteratorHandle it = dic->findEntryHandle(keywords[(i * 7 % count) * step].c_str(), matches);
+    sink += it->getDescriptionRef().size;
+  });
+
+  delete dic;
+}
+
+static void benchHybrid(const char *staticFileName, const char *fileName, int count)
+{
+  std::string errorMessage;
+  StaticDictionary *static_dic = StaticDictionary::loadDictionary(staticFileName, false, errorMessage);
+  DynamicDictionary *dic = static_dic != nullptr ?
+    createHybridDictionary(fileName, static_dic, errorMessage) : nullptr;
+  if(dic == nullptr) {
+    fprintf(stderr, "Cannot create %s: %s\n", fileName, errorMessage.c_str());
+    delete static_dic;
+    return;
+  }
+
+  // Overrides and new entries spread over the dictionary
+  int step = keywords.size() / count;
+  for(int i = 0; i < count; i++) {
+    std::string keyword = keywords[i * step];
+    if(i % 2 != 0) keyword += "0";
+
+    DictionaryIteratorPtr it = dic->insertEntry(keyword.c_str());
+    if(it.isValid())
+      dic->updateEntry(it, "edited");
+  }
+
+  DictionaryIteratorHandle it = dic->beginHandle();
+  measure("hybrid iteration", keywords.size(), [&](int) {
+    sink += it->getKeywordRef().size;
+    it->nextEntry();
+  });
+
+  measure("hybrid findEntry", count, [&](int i) {
+    bool matches;
+    DictionaryIteratorHandle found = dic->findEntryHandle(keywords[(i * 7 % count) * step + 1].c_str(), matches);
+    sink += found->getDescriptionRef().size;
+  });
+
+  delete dic;
+}
+
+static void benchMkbedic(const char *mkbedic, const char *dir)
+{
+  std::string source = std::string(dir) + "/source.txt";
+  FILE *fh = fopen(source.c_str(), "w");
+  if(fh == nullptr) return;
+
+  fprintf(fh, "id=Benchmark\n\n");
+  for(unsigned int i = 0; i < keywords.size(); i++)
+    fprintf(fh, "%s\n%s\n\n", keywords[i].c_str(), senses[i].c_str());
+  fclose(fh);
+
+  std::string command = std::string(mkbedic) + " " + source + " " + dir + "/mkbedic.dic 2>/dev/null";
+  measure("mkbedic", 3, [&](int) {
+    if(system(command.c_str()) != 0)
+      fprintf(stderr, "mkbedic failed\n");
+  });
+}
+
+int main(int argc, char **argv)
+{
+  int count = argc > 1 ? atoi(argv[1]) : 50000;
+
+  char dir[] = "/tmp/bedic-bench-XXXXXX";
+  if(mkdtemp(dir) == nullptr) {
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+  std::string plain = std::string(dir) + "/bench.dic";
+  std::string dictzip = plain + ".dz";
+  std::string sqlite = std::string(dir) + "/bench.edic";
+  std::string hybrid = std::string(dir) + "/bench.hdic";
+
+  makeCorpus(count);
+  if(!writeDictionary(plain.c_str(), false) || !writeDictionary(dictzip.c_str(), true))
+    return EXIT_FAILURE;
+
+  printf("%u entries\n", (unsigned int) keywords.size());
+  printf("%-30s %8s %10s %10s %10s %10s %12s\n", "benchmark", "ops", "p50 us", "p90 us", "p99 us",
+         "max us", "ops/s");
+
+  int lookups = std::min<int>(10000, keywords.size());
+  benchLookups(plain.c_str(), "(plain)", lookups);
+  benchLookups(dictzip.c_str(), "(dictzip)", lookups);
+  benchCollation();
+  benchSHCM();
+
+  int edits = std::min<int>(1000, keywords.size() / 4);
+  benchSQLite(sqlite.c_str(), edits);
+  benchHybrid(dictzip.c_str(), hybrid.c_str(), edits);
+
+  // mkbedic is built next to this program
+  std::string mkbedic = argv[0];
+  size_t slash = mkbedic.rfind('/');
+  mkbedic = (slash == std::string::npos ? std::string(".") : mkbedic.substr(0, slash)) + "/mkbedic";
+  if(access(mkbedic.c_str(), X_OK) == 0)
+    benchMkbedic(mkbedic.c_str(), dir);
+
+  std::string command = std::string("rm -rf ") + dir;
+  if(system(command.c_str()) != 0)
+    fprintf(stderr, "Cannot remove %s\n", dir);
+
+  return sink == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
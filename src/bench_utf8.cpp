@@ -0,0 +1,159 @@
+/**
+ * @file   bench_utf8.cpp
+ * @brief  Microbenchmark for case mapping and canonization of mixed
+ *         Latin/Cyrillic/Greek text
+ * @author Lyndon Hill and others
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "dictionary_impl.h"
+#include "utf8.h"
+
+/// Deterministic pseudo random generator, the same text on every platform
+static unsigned int nextRandom(unsigned int &state)
+{
+  state = state * 1103515245u + 12345u;
+  return (state >> 16) & 0x7fff;
+}
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// Build words from Latin (with diacritics), Cyrillic and Greek letters
+static std::vector<std::string> makeWords(int count)
+{
+  static const unsigned int ranges[][2] = {
+    { 'a', 'z' }, { 'A', 'Z' }, { 0xe0, 0xfe }, { 0x100, 0x17e },
+    { 0x410, 0x44f }, { 0x391, 0x3a9 }, { 0x3b1, 0x3c9 }
+  };
+  const int nranges = sizeof(ranges) / sizeof(ranges[0]);
+
+  unsigned int state = 42;
+  std::vector<std::string> words;
+  words.reserve(count);
+
+  for(int i = 0; i < count; i++) {
+    std::string w;
+    int len = 3 + nextRandom(state) % 10;
+    for(int j = 0; j < len; j++) {
+      const unsigned int *r = ranges[nextRandom(state) % nranges];
+      char buf[8];
+      int n = Utf8::runetochar(buf, r[0] + nextRandom(state) % (r[1] - r[0] + 1));
+      w.append(buf, n);
+    }
+    words.push_back(w);
+  }
+
+  return words;
+}
+
+int main(int argc, char **argv)
+{
+  int count  = argc > 1 ? atoi(argv[1]) : 200000;
+  int rounds = 5;
+
+  std::vector<std::string> words = makeWords(count);
+
+  std::vector<unsigned int> runes;
+  size_t bytes = 0;
+  for(unsigned int i = 0; i < words.size(); i++) {
+    const char *s = words[i].c_str();
+    while(*s != 0)
+      runes.push_back(Utf8::chartorune(&s));
+    bytes += words[i].size();
+  }
+
+  printf("%d words, %u runes, %u bytes\n", count, (unsigned int) runes.size(), (unsigned int) bytes);
+
+  // runetoupper on decoded runes, against the binary search it replaced
+  double best = 1e9;
+  unsigned int sink = 0;
+  for(int r = 0; r < rounds; r++) {
+    double t = now();
+    for(unsigned int i = 0; i < runes.size(); i++)
+      sink += Utf8::runetoupper(runes[i]);
+    t = now() - t;
+    if(t < best) best = t;
+  }
+
+  double bestSearch = 1e9;
+  for(int r = 0; r < rounds; r++) {
+    double t = now();
+    for(unsigned int i = 0; i < runes.size(); i++)
+      sink += Utf8::runetoupperSearch(runes[i]);
+    t = now() - t;
+    if(t < bestSearch) bestSearch = t;
+  }
+  printf("runetoupper:          %7.2f ns/rune\n", best * 1e9 / runes.size());
+  printf("runetoupperSearch:    %7.2f ns/rune  (%.1fx slower)\n",
+         bestSearch * 1e9 / runes.size(), bestSearch / best);
+
+  // Utf8::toupper on whole words
+  best = 1e9;
+  std::string upper;
+  for(int r = 0; r < rounds; r++) {
+    double t = now();
+    for(unsigned int i = 0; i < words.size(); i++) {
+      Utf8::toupper(words[i], upper);
+      sink += upper.size();
+    }
+    t = now() - t;
+    if(t < best) best = t;
+  }
+  printf("Utf8::toupper:        %7.2f ns/word  %7.1f MB/s\n",
+         best * 1e9 / words.size(), bytes / best / 1e6);
+
+  // canonizeWord without char-precedence
+  CollationComparator cmp;
+  cmp.setCollation("", "-.");
+  best = 1e9;
+  for(int r = 0; r < rounds; r++) {
+    double t = now();
+    for(unsigned int i = 0; i < words.size(); i++)
+      sink += cmp.canonizeWord(words[i]).size();
+    t = now() - t;
+    if(t < best) best = t;
+  }
+  printf("canonizeWord:         %7.2f ns/word  %7.1f MB/s\n",
+         best * 1e9 / words.size(), bytes / best / 1e6);
+
+  // compare, the way the builders sort, with and without char-precedence
+  static const char *collations[2] = {
+    "", "{a\xc3\xa0\xc3\xa1}{b}{c\xc3\xa7}{d}{e\xc3\xa8\xc3\xa9}fghijklmnopqrstuvwxyz"
+  };
+  for(int c = 0; c < 2; c++) {
+    CollationComparator sortCmp;
+    sortCmp.setCollation(collations[c], "-.");
+
+    std::vector<CanonizedWord> keys;
+    for(unsigned int i = 0; i < words.size(); i++)
+      keys.push_back(sortCmp.canonizeWord(words[i]));
+
+    // neighbours in sorted order share long prefixes, as in a real dictionary
+    std::sort(keys.begin(), keys.end());
+
+    best = 1e9;
+    for(int r = 0; r < rounds; r++) {
+      double t = now();
+      for(unsigned int i = 1; i < keys.size(); i++)
+        sink += sortCmp.compare(keys[i - 1], keys[i]) + 1;
+      t = now() - t;
+      if(t < best) best = t;
+    }
+    printf("compare (%s): %7.2f ns/pair\n", c == 0 ? "plain    " : "precedence",
+           best * 1e9 / (keys.size() - 1));
+  }
+
+  return sink == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file   block_checksums.cpp
+ * @brief  CRC-32 of fixed-size blocks of the entries, the block-checksums property
+ * @author Lyndon Hill and others
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+extern "C" {
+#include <zlib.h>
+}
+
+#include "block_checksums.h"
+
+BlockChecksums::BlockChecksums(long blockSize) : blockSize(blockSize), blockFill(0)
+{
+  blockChecksum = crc32(0, nullptr, 0);
+}
+
+void BlockChecksums::add(const char *data, size_t length)
+{
+  while(length > 0) {
+    size_t n = blockSize - blockFill;
+    if(n > length) n = length;
+
+    blockChecksum = crc32(blockChecksum, (const Bytef *) data, n);
+    blockFill += n;
+    data += n;
+    length -= n;
+
+    if(blockFill == blockSize) {
+      checksums.push_back(blockChecksum);
+      blockChecksum = crc32(0, nullptr, 0);
+      blockFill = 0;
+    }
+  }
+}
+
+std::string BlockChecksums::toString() const
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%ld", blockSize);
+  std::string value = buf;
+
+  for(size_t i = 0; i < checksums.size(); i++) {
+    snprintf(buf, sizeof(buf), " %08lx", checksums[i]);
+    value += buf;
+  }
+
+  if(blockFill > 0) {
+    snprintf(buf, sizeof(buf), " %08lx", blockChecksum);
+    value += buf;
+  }
+
+  return value;
+}
+
+std::string BlockChecksums::placeholder(off_t dataSize, long blockSize)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%ld", blockSize);
+  std::string value = buf;
+
+  off_t count = (dataSize + blockSize - 1) / blockSize;
+  for(off_t i = 0; i < count; i++)
+    value += " 00000000";
+
+  return value;
+}
+
+bool BlockChecksums::parse(const std::string &value)
+{
+  checksums.clear();
+  blockFill = 0;
+
+  const char *s = value.c_str();
+  char *eptr;
+  blockSize = strtol(s, &eptr, 10);
+  while(blockSize > 0 && *eptr == ' ') {
+    s = eptr + 1;
+    unsigned long crc = strtoul(s, &eptr, 16);
+    if(eptr != s + 8) {
+      blockSize = 0;
+      break;
+    }
+    checksums.push_back(crc);
+  }
+
+  if(blockSize <= 0 || *eptr != '\0') {
+    checksums.clear();
+    blockSize = 0;
+    return false;
+  }
+
+  return true;
+}
+
+unsigned long BlockChecksums::checksum(const char *data, size_t length)
+{
+  return crc32(crc32(0, nullptr, 0), (const Bytef *) data, length);
+}
@@ -0,0 +1,86 @@
+/**
+ * @file   block_checksums.h
+ * @brief  CRC-32 of fixed-size blocks of the entries, the block-checksums property
+ * @author Lyndon Hill and others
+ */
+
+#pragma once
+#ifndef BLOCK_CHECKSUMS_H
+#define BLOCK_CHECKSUMS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * @class BlockChecksums
+ *
+ * The data part of a dictionary (the bytes after the header) is split
+ * into blocks of getBlockSize() bytes, the last one shorter. The
+ * block-checksums property holds the block size followed by the CRC-32
+ * of every block as 8 hex digits, separated by spaces:
+ *
+ *    block-checksums=65536 0a1b2c3d 4e5f6071 ...
+ *
+ * The builders add the entries as they write them; the dictionary
+ * checks a block when it is first read (see DictImpl::checkIntegrity)
+ * or all of them with DictImpl::verifyChecksums.
+ */
+class BlockChecksums
+{
+public:
+  /// 16384 checksums (147kB of header) for a 1GB dictionary
+  static const long DEFAULT_BLOCK_SIZE = 65536;
+
+  explicit BlockChecksums(long blockSize = DEFAULT_BLOCK_SIZE);
+
+  /// Appends length bytes of the data part
+  void add(const char *data, size_t length);
+
+  /// The value of the block-checksums property
+  std::string toString() const;
+
+  /**
+   * A value of the same length as toString() would give for dataSize
+   * bytes of data, to be overwritten once the data is written
+   */
+  static std::string placeholder(off_t dataSize, long blockSize = DEFAULT_BLOCK_SIZE);
+
+  /// Reads the value of the block-checksums property
+  bool parse(const std::string &value);
+
+  long getBlockSize() const
+  {
+    return blockSize;
+  }
+
+  size_t getBlockCount() const
+  {
+    return checksums.size() + (blockFill > 0 ? 1 : 0);
+  }
+
+  /// Number of blocks of dataSize bytes of data
+  size_t getBlockCount(off_t dataSize) const
+  {
+    return (dataSize + blockSize - 1) / blockSize;
+  }
+
+  /// CRC-32 of block i of a parsed property
+  unsigned long getChecksum(size_t i) const
+  {
+    return checksums[i];
+  }
+
+  /// CRC-32 of length bytes
+  static unsigned long checksum(const char *data, size_t length);
+
+private:
+  long blockSize;
+  std::vector<unsigned long> checksums;
+  unsigned long blockChecksum;   ///< CRC of the block being added
+  long blockFill;                ///< Bytes in the block being added
+};
+
+#endif  /* BLOCK_CHECKSUMS_H */
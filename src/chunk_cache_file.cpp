@@ -0,0 +1,228 @@
+/**
+ * @file   chunk_cache_file.cpp
+ * @brief  Inflated chunks of a dictzip file kept on disk
+ * @author Lyndon Hill and others
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "chunk_cache_file.h"
+
+/// Layout of the file: the header, the bitmap, the CRC-32 of each chunk and the chunks
+struct ChunkCacheFile::Header
+{
+  char magic[8];
+  unsigned int version;
+  int chunkCount;
+  long long dzSize;          ///< size of the dictzip file
+  long long mtimeSec;
+  long long mtimeNsec;
+  long long dataSize;
+  long long dataOffset;      ///< offset of chunk 0
+  int chunkLength;
+};
+
+static const char CHUNK_CACHE_MAGIC[8] = { 'B', 'E', 'D', 'I', 'C', 'C', 'F', 0 };
+static const unsigned int CHUNK_CACHE_VERSION = 2;
+
+/// The chunks start at a page boundary
+static const off_t DATA_ALIGNMENT = 4096;
+
+/// The flusher syncs once this many chunks are pending, or after FLUSH_DELAY
+static const size_t FLUSH_CHUNKS = 32;
+static const std::chrono::seconds FLUSH_DELAY(1);
+
+std::string ChunkCacheFile::getFilename(const char *dzFilename)
+{
+  return std::string(dzFilename) + ".chunks";
+}
+
+ChunkCacheFile::ChunkCacheFile(int fd, char *map, size_t mapSize, off_t dataOffset, off_t dataSize,
+                               int chunkCount, int chunkLength) :
+  fd(fd), map(map), mapSize(mapSize), dataOffset(dataOffset), dataSize(dataSize), chunkLength(chunkLength)
+{
+  int words = (chunkCount + 63) / 64;
+  bitmap = (std::atomic<unsigned long long> *) (map + sizeof(Header));
+  crcs = (std::atomic<unsigned int> *) (bitmap + words);
+  data = map + dataOffset;
+  trusted = new std::atomic<unsigned long long> [words];
+  for(int i = 0; i < words; i++)
+    trusted[i].store(0, std::memory_order_relaxed);
+  stopping = false;
+}
+
+ChunkCacheFile::~ChunkCacheFile()
+{
+  {
+    std::lock_guard<std::mutex> lock(flushMutex);
+    stopping = true;
+  }
+  flushWanted.notify_one();
+  if(flusher.joinable())
+    flusher.join();
+
+  // what the flusher did not sync yet is synced when the cache is closed
+  syncChunks(pending);
+  delete [] trusted;
+  munmap(map, mapSize);
+  ::close(fd);
+}
+
+/// Maps size bytes of fd, null if error
+static char *mapFile(int fd, size_t size)
+{
+  char *map = (char *) mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return map == MAP_FAILED ? nullptr : map;
+}
+
+ChunkCacheFile *ChunkCacheFile::open(const char *dzFilename, off_t dataSize, int chunkCount, int chunkLength)
+{
+  struct stat st;
+  if(chunkCount <= 0 || chunkLength <= 0 || stat(dzFilename, &st) != 0)
+    return nullptr;
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CHUNK_CACHE_MAGIC, sizeof(CHUNK_CACHE_MAGIC));
+  header.version = CHUNK_CACHE_VERSION;
+  header.chunkCount = chunkCount;
+  header.dzSize = st.st_size;
+  header.mtimeSec = st.st_mtim.tv_sec;
+  header.mtimeNsec = st.st_mtim.tv_nsec;
+  header.dataSize = dataSize;
+  header.chunkLength = chunkLength;
+  off_t bitmapSize = (chunkCount + 63) / 64 * sizeof(unsigned long long);
+  off_t crcSize = (off_t) chunkCount * sizeof(unsigned int);
+  header.dataOffset = (sizeof(Header) + bitmapSize + crcSize + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+  off_t size = header.dataOffset + dataSize;
+  if((off_t) (size_t) size != size)
+    return nullptr;
+
+  std::string filename = getFilename(dzFilename);
+  int fd = ::open(filename.c_str(), O_RDWR);
+  if(fd >= 0) {
+    Header current;
+    char *map = nullptr;
+    if(pread(fd, &current, sizeof(current), 0) == (ssize_t) sizeof(current) &&
+       memcmp(&current, &header, sizeof(header)) == 0 && fstat(fd, &st) == 0 && st.st_size == size)
+      map = mapFile(fd, size);
+
+    if(map != nullptr)
+      return new ChunkCacheFile(fd, map, size, header.dataOffset, dataSize, chunkCount, chunkLength);
+    ::close(fd);
+  }
+
+  // a new file replaces a stale one under the processes that still use
+  // it. The header, the bitmap and the checksums are allocated, so that
+  // stores through the mapping can not fail, the chunks are holes until
+  // they are written.
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", (int) getpid());
+  std::string tmpName = filename + suffix;
+  fd = ::open(tmpName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+    return nullptr;
+
+  char *map = nullptr;
+  if(ftruncate(fd, size) == 0 && posix_fallocate(fd, 0, header.dataOffset) == 0 &&
+     pwrite(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header))
+    map = mapFile(fd, size);
+
+  if(map == nullptr || rename(tmpName.c_str(), filename.c_str()) != 0) {
+    if(map != nullptr)
+      munmap(map, size);
+    ::close(fd);
+    unlink(tmpName.c_str());
+    return nullptr;
+  }
+
+  return new ChunkCacheFile(fd, map, size, header.dataOffset, dataSize, chunkCount, chunkLength);
+}
+
+const char *ChunkCacheFile::getChunk(int cp) const
+{
+  unsigned long long mask = 1ULL << (cp % 64);
+  const char *chunk = data + (off_t) cp * chunkLength;
+  if((trusted[cp / 64].load(std::memory_order_acquire) & mask) != 0)
+    return chunk;
+
+  if((bitmap[cp / 64].load(std::memory_order_acquire) & mask) == 0)
+    return nullptr;
+
+  // the bit may have reached the disk before the data, a chunk that does
+  // not match its checksum is missing
+  int length = std::min<off_t>(chunkLength, dataSize - (off_t) cp * chunkLength);
+  if(crc32(0, (const Bytef *) chunk, length) != crcs[cp].load(std::memory_order_relaxed))
+    return nullptr;
+
+  trusted[cp / 64].fetch_or(mask, std::memory_order_release);
+  return chunk;
+}
+
+void ChunkCacheFile::storeChunk(int cp, const char *chunk, int length)
+{
+  off_t offset = (off_t) cp * chunkLength;
+  if(offset >= dataSize || length != std::min<off_t>(chunkLength, dataSize - offset) ||
+     getChunk(cp) != nullptr)
+    return;
+
+  // written with pwrite, which fails on a full disk where a store to the
+  // mapping would raise SIGBUS
+  for(int done = 0; done < length; ) {
+    ssize_t n = pwrite(fd, chunk + done, length - done, dataOffset + offset + done);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) return;
+    done += n;
+  }
+
+  // this process reads the chunk from the page cache at once, the
+  // others once the flusher has set its bit
+  crcs[cp].store(crc32(0, (const Bytef *) chunk, length), std::memory_order_relaxed);
+  trusted[cp / 64].fetch_or(1ULL << (cp % 64), std::memory_order_release);
+
+  std::lock_guard<std::mutex> lock(flushMutex);
+  pending.push_back(cp);
+  if(!flusher.joinable())
+    flusher = std::thread(&ChunkCacheFile::flushChunks, this);
+  if(pending.size() >= FLUSH_CHUNKS)
+    flushWanted.notify_one();
+}
+
+// fdatasync takes milliseconds on flash, so it is kept off the lookups
+void ChunkCacheFile::flushChunks()
+{
+  std::unique_lock<std::mutex> lock(flushMutex);
+  while(!stopping) {
+    flushWanted.wait_for(lock, FLUSH_DELAY, [this] { return stopping || pending.size() >= FLUSH_CHUNKS; });
+    if(stopping || pending.empty())
+      continue;
+
+    std::vector<int> chunks;
+    chunks.swap(pending);
+    lock.unlock();
+    syncChunks(chunks);
+    lock.lock();
+  }
+}
+
+void ChunkCacheFile::syncChunks(const std::vector<int> &chunks)
+{
+  if(chunks.empty())
+    return;
+
+  // the bits are set once the chunks and their checksums are on disk
+  if(fdatasync(fd) == 0) {
+    for(size_t i = 0; i < chunks.size(); i++)
+      bitmap[chunks[i] / 64].fetch_or(1ULL << (chunks[i] % 64), std::memory_order_release);
+  }
+}
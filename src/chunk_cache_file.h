@@ -0,0 +1,108 @@
+/**
+ * @file   chunk_cache_file.h
+ * @brief  Inflated chunks of a dictzip file kept on disk
+ * @author Lyndon Hill and others
+ */
+
+#pragma once
+#ifndef CHUNK_CACHE_FILE_H
+#define CHUNK_CACHE_FILE_H
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ChunkCacheFile
+ *
+ * A file next to a dictzip file (foo.dic.dz.chunks) that holds its
+ * chunks inflated, at their uncompressed offsets, after a header, a
+ * bitmap of the chunks that are there and the CRC-32 of each chunk. The
+ * file is sparse: a chunk takes disk space once it is stored. It is
+ * mapped, so a chunk is inflated once and then read from the page cache
+ * like a plain file.
+ *
+ * The header keeps the size and the modification time of the dictzip
+ * file; a changed dictionary starts with an empty cache. Processes and
+ * dictionaries can share the file, and two writers of the same chunk
+ * write the same bytes. A chunk is written with pwrite, and its bit is
+ * set once the chunk is on disk. A thread started by the first store
+ * syncs the file every few chunks or every second, so that lookups do
+ * not wait for the disk; the rest is synced when the cache is closed.
+ * A chunk whose checksum does not match, after a crash for example, is
+ * missing.
+ */
+class ChunkCacheFile
+{
+public:
+  ~ChunkCacheFile();
+
+  /**
+   * Opens the cache of the dictzip file, or creates it if it is missing
+   * or stale
+   *
+   * @param dataSize     uncompressed size of the dictzip file
+   * @param chunkLength  length of an inflated chunk, only the last chunk
+   *                     may be shorter
+   * @return  the cache, or null if the file could not be opened, for
+   *          example in a read-only directory
+   */
+  static ChunkCacheFile *open(const char *dzFilename, off_t dataSize, int chunkCount, int chunkLength);
+
+  /**
+   * Chunk cp, or null if it was not stored yet. The checksum of a chunk
+   * stored by another process is checked the first time.
+   */
+  const char *getChunk(int cp) const;
+
+  /**
+   * Stores chunk cp, which must have its full length. Only one thread
+   * stores chunks, others may get them meanwhile.
+   */
+  void storeChunk(int cp, const char *chunk, int length);
+
+  /// Name of the cache of a dictzip file
+  static std::string getFilename(const char *dzFilename);
+
+private:
+  struct Header;
+
+  ChunkCacheFile(int fd, char *map, size_t mapSize, off_t dataOffset, off_t dataSize, int chunkCount,
+                 int chunkLength);
+
+  int fd;
+  char *map;
+  size_t mapSize;
+  std::atomic<unsigned long long> *bitmap;
+  std::atomic<unsigned int> *crcs;
+  char *data;
+  off_t dataOffset;
+  off_t dataSize;
+  int chunkLength;
+
+  /// Chunks this process stored or checked, a bitmap like the one of the file
+  std::atomic<unsigned long long> *trusted;
+
+  /// Chunks stored whose bits are not set yet, taken by the flusher
+  std::vector<int> pending;
+  std::mutex flushMutex;
+  std::condition_variable flushWanted;
+  std::thread flusher;
+  bool stopping;
+
+  /// Body of the flusher thread
+  void flushChunks();
+
+  /// Syncs the file and sets the bits of the chunks
+  void syncChunks(const std::vector<int> &chunks);
+
+  ChunkCacheFile(const ChunkCacheFile &) = delete;
+  ChunkCacheFile &operator=(const ChunkCacheFile &) = delete;
+};
+
+#endif  /* CHUNK_CACHE_FILE_H */
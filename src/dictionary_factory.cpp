@@ -25,6 +25,7 @@
 #include <stdio.h>
 
 #include "bedic.h"
+#include "shared_cache.h"
 
 StaticDictionary *loadBedicDictionary(const char *filename, bool doCheckIntegrity,
                                       std::string &errorMessage);
@@ -57,3 +58,8 @@ StaticDictionary *StaticDictionary::loadDictionary(const char *filename,
     return loadBedicDictionary(filename, doCheckIntegrity, errorMessage);
   }
 }
+
+void StaticDictionary::setSharedCacheDirectory(const char *dir)
+{
+  SharedCache::setDirectory(dir == nullptr ? "" : dir);
+}
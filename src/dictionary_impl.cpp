@@ -36,13 +36,23 @@
 #include <assert.h>
 #include <time.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include <algorithm>
 #include <sstream>
 
 #include "dictionary_impl.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include "utf8.h"
 
-unsigned char terminal_keyword[] = { 0xc2, 0xb6 };
+// U+00B6, sorts after all the words; zero terminated as it is used as a C string
+unsigned char terminal_keyword[] = { 0xc2, 0xb6, 0 };
 
 
 // Create a dictionary instance
@@ -65,55 +75,95 @@ Dictionary::~Dictionary()
 const char DictImpl::DATA_DELIMITER = '\x00';
 const char DictImpl::WORD_DELIMITER = '\n';
 
-DictImpl::DictImpl(const char *filename, bool doCheckIntegrity) : fileName(filename), buf(nullptr)
+/// A dictzip file if the name ends with .dz, a plain file otherwise
+static File *createFile(const char *filename)
 {
-  compressor = nullptr;
-
   if(strlen(filename) > 3 && strcmp(&filename[strlen(filename) - 3], ".dz") == 0)
   {
-    fdata = new DZFile();
+    return new DZFile();
   }
   else
   {
-    fdata = new File();
+    return new File();
   }
+}
+
+DictImpl::DictImpl(const char *filename, bool doCheckIntegrity) : fileName(filename), buf(nullptr)
+{
+  compressor = nullptr;
+  sharedCache = nullptr;
+  verifyOnRead = false;
+  clearEntry();
+
+  backBuf = new char [BACK_BUF_SIZE];
+  backBufPos = 0;
+  backBufLen = 0;
+
+  scanBuf = nullptr;
+  scanBufPos = 0;
+  scanBufLen = 0;
+
+  fdata = createFile(filename);
 
   if(fdata->open(filename) < 0) {
     setError(strerror(errno));
     return;
   }
 
-  // find and set the position of the last word
-  firstEntryPos = 0;
-  lastEntryPos  = fdata->size() - 2;
-  lastEntryPos  = findPrev(lastEntryPos);
+  // another process may have loaded the dictionary already
+  sharedCache = SharedCache::attach(filename, fdata->getChunkLength());
+  if(sharedCache != nullptr) {
+    size_t size;
+    const char *snapshot = sharedCache->getSnapshot(size);
+    if(!loadSnapshot(snapshot, size)) {
+      delete sharedCache;
+      sharedCache = nullptr;
+    }
+  }
+
+  if(sharedCache == nullptr) {
+    // find and set the position of the last word
+    firstEntryPos = 0;
+    lastEntryPos  = fdata->size() - 2;
+    lastEntryPos  = findPrev(lastEntryPos);
 
-  // In case the file ends with 0x00 0x10
-  {
-    char lastBytes[2] =
+    // In case the file ends with 0x00 0x10
     {
-      1, 1
-    };
-    fdata->read(fdata->size() - 2, (char*)&lastBytes, 2);
+      char lastBytes[2] =
+      {
+        1, 1
+      };
+      fdata->read(fdata->size() - 2, (char*)&lastBytes, 2);
+
+      if(lastBytes[0]==DATA_DELIMITER && lastBytes[1] == 10) {
+//        fprintf( stderr, "ends with EOL; la: %d\n", lastEntryPos );
+        lastEntryPos = findPrev(lastEntryPos-2);
+//        fprintf( stderr, "la: %d\n", lastEntryPos );
+      }
+    }
+
+    // read dictionary header
+    // set the position of the first word
+    firstEntryPos = readProperties();
 
-    if(lastBytes[0]==DATA_DELIMITER && lastBytes[1] == 10) {
-//      fprintf( stderr, "ends with EOL; la: %d\n", lastEntryPos );
-      lastEntryPos = findPrev(lastEntryPos-2);
-//      fprintf( stderr, "la: %d\n", lastEntryPos );
+    // fix the indices
+    for(std::vector<IndexEntry>::iterator it = index.begin(); it != index.end(); ++it) {
+      (*it).pos += firstEntryPos;
+    }
+
+    if(errorDescr.empty()) {
+      sharedCache = SharedCache::create(filename, saveSnapshot(), fdata->getChunkCount(),
+                                        fdata->getChunkLength());
     }
   }
 
-  // read dictionary header
-  // set the position of the first word
-  firstEntryPos = readProperties();
+  fdata->setSharedCache(sharedCache);
   currPos = firstEntryPos;
 
-  buf = new char [maxEntryLength];
+  // the backward buffer may hold a part of the header
+  backBufLen = 0;
 
-  // fix the indices
-  for(std::vector<IndexEntry>::iterator it = index.begin(); it != index.end(); ++it) {
-    (*it).pos += firstEntryPos;
-  }
+  buf = new char [maxEntryLength];
 
   // check the integrity
   if(doCheckIntegrity) checkIntegrity();
@@ -126,7 +176,11 @@ DictImpl::~DictImpl()
   if(buf)
     delete [] buf;
 
+  delete [] backBuf;
+  delete [] scanBuf;
+
   delete fdata;
+  delete sharedCache;
 }
 
 const std::string &DictImpl::getName() const
@@ -142,18 +196,34 @@ const std::string &DictImpl::getFileName() const
 
 bool DictImpl::findEntry(const std::string &w, bool &subword)
 {
-  long b, e;
+  TraceScope lookupScope(TRACE_LOOKUP);
+  off_t b, e;
   bool found;
   CanonizedWord cw;
 
   b = firstEntryPos;
   e = lastEntryPos;
 
+  BEDIC_STAT(stats.lookups, 1);
+  if(isEmpty()) {
+    clearEntry();
+    currPos = firstEntryPos;
+    subword = false;
+    return false;
+  }
+
   CanonizedWord word = canonizeWord(w);
 
-//  struct timeval tv;
-//  gettimeofday(&tv, NULL);
-//  fprintf(stderr, "findEntry: > %s %015ld %015ld\n", word.c_str(), tv.tv_sec, tv.tv_usec);
+  if(lookupCache.isEnabled()) {
+    const CachedLookup *cached = lookupCache.find(word);
+    if(cached != nullptr) {
+      currPos = cached->pos;
+      memcpy(buf, cached->entry.data(), cached->entry.size());
+      buf[cached->entry.size()] = DATA_DELIMITER;
+      subword = false;
+      return parseEntry(buf + cached->entry.size()) && cached->found;
+    }
+  }
 
   // First search the index
   bsearchIndex(word, b, e);
@@ -163,7 +233,7 @@ bool DictImpl::findEntry(const std::string &w, bool &subword)
   if(b >= e)
   {
     readEntry(b);
-    cw    = canonizeWord(currWord);
+    canonizeWord(wordData, wordLength, cw);
     found = compare(word, cw) == 0;
   }
   else
@@ -172,21 +242,20 @@ bool DictImpl::findEntry(const std::string &w, bool &subword)
   }
 
   // Binary search on dictionary
+  TraceScope bisectionScope(TRACE_BISECTION, b);
   while(b < e)
   {
-    // operation on unsiged numbers to save one more bit
-    long m = (long)(((unsigned long)b+(unsigned long)e)/2);
+    off_t m = b + (e - b) / 2;
+    BEDIC_STAT(stats.bisectionSteps, 1);
     m = findPrev(m);
     if((m < 0) || !readEntry(m))
     {
-      currWord  = std::string();
-      currSense = std::string();
-      senseCompressed = false;
+      clearEntry();
       currPos = firstEntryPos;
       return false;
     }
 
-    cw = canonizeWord(currWord);
+    canonizeWord(wordData, wordLength, cw);
 //  printf("findEntry: compare %s:%s\n", word.c_str(), cw.c_str());
     int cmp = compare(word, cw);
     if(cmp == 0)
@@ -201,13 +270,20 @@ bool DictImpl::findEntry(const std::string &w, bool &subword)
     else
     {
       b = findNext(m+1);
+      if(b < 0)
+      {
+        clearEntry();
+        currPos = firstEntryPos;
+        return false;
+      }
     }
   }
+  bisectionScope.finish();
 
   if(!found)
   {           // findNext(m+1) can move position to the matching word
     readEntry(b);
-    cw = canonizeWord(currWord);
+    canonizeWord(wordData, wordLength, cw);
     int cmp = compare(word, cw);
     found = cmp == 0;
     // Fix disabled because it was rather counterintuitive
@@ -220,21 +296,195 @@ bool DictImpl::findEntry(const std::string &w, bool &subword)
   }
 
   subword = false; //TODO: fix it: cw.substr(0, word.size()) == word;
+
+  if(lookupCache.isEnabled() && errorDescr.empty() && nextPos > currPos) {
+    CachedLookup result = { currPos, found, std::string(buf, nextPos - currPos - 1) };
+    lookupCache.insert(word, result);
+  }
 // printf("findEntry: meaning=%s\n", currSense.c_str());
 
-// gettimeofday(&tv, NULL);
-// fprintf(stderr, "findEntry: < %015ld %015ld\n", tv.tv_sec, tv.tv_usec);
   return found;
 }
 
+bool DictImpl::findEntries(const std::vector<std::string> &words, std::vector<LookupResult> &results)
+{
+  TraceScope lookupScope(TRACE_LOOKUP);
+
+  /// A word being looked up: the range [b, e) of findEntry, then the entry at b
+  struct Probe
+  {
+    size_t n;
+    CanonizedWord word;
+    off_t b, e;
+    off_t start;
+    std::vector<char> window;
+  };
+
+  results.assign(words.size(), LookupResult());
+  if(isEmpty()) {
+    return true;
+  }
+  std::vector<Probe> probes;
+  std::vector<size_t> fallback;
+  CanonizedWord cw;
+
+  // the words are searched LOOKUP_BATCH_SIZE at a time, which bounds the
+  // memory of the blocks and is enough to keep the device busy
+  off_t fileSize = fdata->size();
+  for(size_t first = 0; first < words.size(); first += LOOKUP_BATCH_SIZE) {
+    size_t last = std::min(words.size(), first + LOOKUP_BATCH_SIZE);
+    for(size_t n = first; n < last; n++) {
+      Probe probe;
+      probe.n = n;
+      probe.word = canonizeWord(words[n]);
+
+      if(lookupCache.isEnabled()) {
+        const CachedLookup *cached = lookupCache.find(probe.word);
+        if(cached != nullptr) {
+          currPos = cached->pos;
+          memcpy(buf, cached->entry.data(), cached->entry.size());
+          buf[cached->entry.size()] = DATA_DELIMITER;
+          if(!parseEntry(buf + cached->entry.size())) {
+            return false;
+          }
+          results[n].keyword = getWord();
+          results[n].description = getSense();
+          results[n].matches = cached->found;
+          BEDIC_STAT(stats.lookups, 1);
+          continue;
+        }
+      }
+
+      probe.b = firstEntryPos;
+      probe.e = lastEntryPos;
+      bsearchIndex(probe.word, probe.b, probe.e);
+      probes.push_back(std::move(probe));
+    }
+
+    // Every round reads, at once, the block of each word that findEntry
+    // would read next: the one that ends at the middle of the range while
+    // bisecting, the entry at b at the end. A word whose entry does not
+    // fit in its block is looked up with findEntry.
+    while(!probes.empty()) {
+      std::vector<ReadRequest> requests(probes.size());
+      for(size_t i = 0; i < probes.size(); i++) {
+        Probe &probe = probes[i];
+        off_t end;
+        if(probe.b < probe.e) {
+          off_t m = probe.b + (probe.e - probe.b) / 2;
+          probe.start = std::max<off_t>(firstEntryPos, m - BACK_BUF_SIZE + 1);
+          end = m + maxEntryLength;
+        } else {
+          probe.start = std::min(probe.b, lastEntryPos);
+          end = probe.start + maxEntryLength;
+        }
+
+        probe.window.resize(std::min(end, fileSize) - probe.start);
+        ReadRequest request = { probe.start, &probe.window[0], (int) probe.window.size(), -1 };
+        if(verifyRange(request.pos, request.len)) {
+          requests[i] = request;
+        }
+      }
+      fdata->readBatch(&requests[0], requests.size());
+
+      std::vector<Probe> pending;
+      for(size_t i = 0; i < probes.size(); i++) {
+        Probe &probe = probes[i];
+        const char *window = &probe.window[0];
+        int length = requests[i].result;
+        bool bisecting = probe.b < probe.e;
+
+        // start of the entry, as found by findPrev
+        off_t p = probe.start;
+        if(bisecting) {
+          BEDIC_STAT(stats.bisectionSteps, 1);
+          off_t m = probe.b + (probe.e - probe.b) / 2;
+          int k = m - probe.start;
+          if(k >= length) {
+            fallback.push_back(probe.n);
+            continue;
+          }
+
+          while(k >= 0 && window[k] != DATA_DELIMITER) {
+            k--;
+          }
+          if(k < 0 && probe.start != firstEntryPos) {
+            fallback.push_back(probe.n);
+            continue;
+          }
+          p = probe.start + k + 1;
+        }
+
+        const char *entry = window + (p - probe.start);
+        const char *pp = length <= p - probe.start ? nullptr :
+          (const char *) memchr(entry, DATA_DELIMITER, length - (p - probe.start));
+        if(pp == nullptr || pp - entry >= maxEntryLength) {
+          fallback.push_back(probe.n);
+          continue;
+        }
+
+        memcpy(buf, entry, pp - entry + 1);
+        currPos = p;
+        if(!parseEntry(buf + (pp - entry))) {
+          return false;
+        }
+
+        canonizeWord(wordData, wordLength, cw);
+        int cmp = compare(probe.word, cw);
+        if(bisecting && cmp != 0) {
+          if(cmp < 0) {
+            probe.e = p;
+          } else {
+            probe.b = p + 1 > lastEntryPos ? lastEntryPos : nextPos;
+          }
+          pending.push_back(std::move(probe));
+          continue;
+        }
+
+        LookupResult &result = results[probe.n];
+        result.keyword = getWord();
+        result.description = getSense();
+        result.matches = cmp == 0;
+        BEDIC_STAT(stats.lookups, 1);
+
+        if(lookupCache.isEnabled() && nextPos > currPos) {
+          CachedLookup cached = { currPos, result.matches, std::string(buf, nextPos - currPos - 1) };
+          lookupCache.insert(probe.word, cached);
+        }
+      }
+      probes.swap(pending);
+    }
+  }
+
+  for(size_t i = 0; i < fallback.size(); i++) {
+    bool subword;
+    LookupResult &result = results[fallback[i]];
+    result.matches = findEntry(words[fallback[i]], subword);
+    if(!errorDescr.empty()) {
+      return false;
+    }
+    result.keyword = getWord();
+    result.description = getSense();
+  }
+
+  return errorDescr.empty();
+}
+
 bool DictImpl::nextEntry()
 {
-  long pos;
+  off_t pos;
+
+  if(isEmpty()) {
+    return false;
+  }
 
   if(nextPos > 0) {
     pos = nextPos;
   } else {
     pos = findNext(currPos+1);
+    if(pos < 0) {
+      return false;
+    }
   }
 
   if(pos > lastEntryPos) {
@@ -248,42 +498,290 @@ bool DictImpl::nextEntry()
   return readEntry(pos);
 }
 
+bool DictImpl::previousEntry()
+{
+  if(currPos <= firstEntryPos) {
+    return false;
+  }
+
+  // currPos-1 is the delimiter of the previous entry
+  off_t pos = findPrev(currPos - 2);
+  if(pos < 0) {
+    return false;
+  }
+
+  return readEntry(pos);
+}
+
 bool DictImpl::firstEntry()
 {
-  return readEntry(firstEntryPos);
+  return !isEmpty() && readEntry(firstEntryPos);
 }
 
 bool DictImpl::lastEntry()
 {
-  return readEntry(lastEntryPos);
+  return !isEmpty() && readEntry(lastEntryPos);
 }
 
 bool DictImpl::randomEntry()
 {
-  return readEntry(findNext(firstEntryPos + (long)
+  return !isEmpty() && readEntry(findNext(firstEntryPos + (off_t)
                      ((((double) lastEntryPos) * rand()) /
                        (RAND_MAX + (double) firstEntryPos))));
 }
 
+long DictImpl::getEntryCount()
+{
+  if(isEmpty()) {
+    return 0;
+  }
+
+  if(entryCount < 0) {
+    long n = 0;
+    off_t pos = firstEntryPos;
+    while(pos < lastEntryPos) {
+      pos = findNext(pos);
+      if(pos < 0) {
+        return -1;
+      }
+      n++;
+    }
+
+    entryCount = n + 1;
+  }
+
+  return entryCount;
+}
+
+bool DictImpl::seekOrdinal(long n)
+{
+  if(n < 0 || n >= getEntryCount()) {
+    return false;
+  }
+
+  loadOrdinalIndex();
+
+  off_t pos = firstEntryPos;
+  long k = n;
+  if(ordinalStep > 0 && n / ordinalStep < (long) ordinalIndex.size()) {
+    pos = ordinalIndex[n / ordinalStep];
+    k = n % ordinalStep;
+  }
+
+  for( ; k > 0; k--) {
+    pos = findNext(pos);
+    if(pos < 0) {
+      return false;
+    }
+  }
+
+  return readEntry(pos);
+}
+
+long DictImpl::rankOf(const std::string &word)
+{
+  if(isEmpty()) {
+    return 0;
+  }
+
+  bool subword;
+  bool found = findEntry(word, subword);
+  if(!errorDescr.empty()) {
+    return -1;
+  }
+
+  long rank = ordinalOf(currPos);
+  if(rank < 0 || found) {
+    return rank;
+  }
+
+  // findEntry stops at the last entry if the word sorts after all of them
+  CanonizedWord cw;
+  canonizeWord(wordData, wordLength, cw);
+  if(compare(cw, canonizeWord(word)) < 0) {
+    rank++;
+  }
+
+  return rank;
+}
+
+void DictImpl::setCacheSize(size_t entries)
+{
+  lookupCache.setCapacity(entries);
+}
+
+void DictImpl::setSequentialAccess(bool sequential)
+{
+  if(sequential && scanBuf == nullptr) {
+    scanBuf = new char [SCAN_BUF_SIZE];
+  } else if(!sequential) {
+    delete [] scanBuf;
+    scanBuf = nullptr;
+  }
+  scanBufLen = 0;
+
+  fdata->setSequential(sequential);
+}
+
+void DictImpl::setChunkCacheFile(bool enable)
+{
+  fdata->setChunkCacheFile(enable);
+}
+
+void DictImpl::getCacheStats(LookupCacheStats &stats) const
+{
+  lookupCache.getStats(stats);
+}
+
+#ifdef BEDIC_STATS
+bool DictImpl::getStats(DictionaryStats &result) const
+{
+  result = DictionaryStats();
+  stats.addTo(result);
+  fdata->stats.addTo(result);
+  if(compressor != nullptr)
+    compressor->stats.addTo(result);
+  result.canonicalizations += canonicalizations.get();
+
+  LookupCacheStats cacheStats;
+  lookupCache.getStats(cacheStats);
+  result.cacheHits = cacheStats.hits;
+  result.cacheMisses = cacheStats.misses;
+
+  return true;
+}
+
+void DictImpl::resetStats()
+{
+  stats.reset();
+  fdata->stats.reset();
+  if(compressor != nullptr)
+    compressor->stats.reset();
+  canonicalizations.reset();
+  lookupCache.resetStats();
+}
+#else
+bool DictImpl::getStats(DictionaryStats &result) const
+{
+  result = DictionaryStats();
+  return false;
+}
+
+void DictImpl::resetStats()
+{
+}
+#endif
+
+long DictImpl::ordinalOf(off_t pos)
+{
+  loadOrdinalIndex();
+
+  off_t p = firstEntryPos;
+  long n = 0;
+
+  if(ordinalStep > 0 && ordinalIndex.size() > 0) {
+    std::vector<off_t>::const_iterator it =
+      std::upper_bound(ordinalIndex.begin(), ordinalIndex.end(), pos);
+    if(it != ordinalIndex.begin()) {
+      --it;
+      p = *it;
+      n = (it - ordinalIndex.begin()) * ordinalStep;
+    }
+  }
+
+  while(p < pos) {
+    p = findNext(p);
+    if(p < 0) {
+      return -1;
+    }
+    n++;
+  }
+
+  return n;
+}
+
+void DictImpl::loadOrdinalIndex()
+{
+  if(ordinalIndexText.empty()) {
+    return;
+  }
+
+  // the sampling step followed by the offsets of every step-th entry,
+  // relative to the first entry and separated by spaces
+  const char *s = ordinalIndexText.c_str();
+  char *eptr;
+  ordinalStep = strtol(s, &eptr, 10);
+  while(ordinalStep > 0 && *eptr == ' ') {
+    s = eptr + 1;
+    ordinalIndex.push_back(strtoll(s, &eptr, 10) + firstEntryPos);
+  }
+
+  if(ordinalStep <= 0 || *eptr != '\0') {
+    ordinalIndex.clear();
+    ordinalStep = 0;
+  }
+
+  std::string().swap(ordinalIndexText);
+}
+
 const std::string &DictImpl::getWord() const
 {
+  if(!currWordValid)
+  {
+    currWord.assign(wordData, wordLength);
+    currWordValid = true;
+  }
+
   return currWord;
 }
 
 const std::string &DictImpl::getSense() const
 {
-  if(senseCompressed)
+  if(!currSenseValid)
   {
-    currSense = unescape(currSense);
-    currSense = compressor->decode(currSense);
-    senseCompressed = false;
+    currSense.assign(senseData, senseLength);
+    if(senseCompressed)
+    {
+      currSense = unescape(currSense);
+      currSense = compressor->decode(currSense);
+      senseCompressed = false;
+    }
+    currSenseValid = true;
   }
 
   return currSense;
 }
 
-void DictImpl::bsearchIndex(const CanonizedWord &s, long &b, long &e)
+const char *DictImpl::getWordData(size_t &length) const
+{
+  length = wordLength;
+  return wordData;
+}
+
+const char *DictImpl::getSenseData(size_t &length) const
+{
+  if(senseCompressed || currSenseValid)
+  {
+    const std::string &sense = getSense();
+    length = sense.size();
+    return sense.data();
+  }
+
+  length = senseLength;
+  return senseData;
+}
+
+void DictImpl::clearEntry()
 {
+  wordData = senseData = "";
+  wordLength = senseLength = 0;
+  currWordValid = currSenseValid = false;
+  senseCompressed = false;
+}
+
+void DictImpl::bsearchIndex(const CanonizedWord &s, off_t &b, off_t &e)
+{
+  TraceScope scope(TRACE_INDEX_SEARCH);
   int ib, ie, m;
 
   ib = m = 0;
@@ -295,6 +793,7 @@ void DictImpl::bsearchIndex(const CanonizedWord &s, long &b, long &e)
 
   while(ib < ie) {
     m = (ib+ie) / 2;
+    BEDIC_STAT(stats.indexProbes, 1);
     int cmp = compare(s, index[m].word);
 //  printf("bsearchIndex: compare %s:%s\n", (const char*) s.utf8(),
 //         (const char*) index[m]->word.utf8());
@@ -331,8 +830,9 @@ void DictImpl::bsearchIndex(const CanonizedWord &s, long &b, long &e)
   }
 }
 
-bool DictImpl::readEntry(long pos)
+bool DictImpl::readEntry(off_t pos)
 {
+  TraceScope scope(TRACE_READ_ENTRY, pos);
   int clen = maxEntryLength / 4;
   int n = 0;
 
@@ -351,9 +851,9 @@ bool DictImpl::readEntry(long pos)
       clen = maxEntryLength - n;
     }
 
-    int i = fdata->read(currPos + n, &buf[n], clen);
+    int i = readData(currPos + n, &buf[n], clen);
     if(i < 0) {
-      setError(strerror(errno));
+      clearEntry();
       return false;
     } else if(i == 0) {
       break;
@@ -368,9 +868,15 @@ bool DictImpl::readEntry(long pos)
 
   if(pp == 0) {
     setError("entry too long");
+    clearEntry();
     return false;
   }
 
+  return parseEntry(pp);
+}
+
+bool DictImpl::parseEntry(const char *pp)
+{
   char *p = (char *) memchr(buf, WORD_DELIMITER, pp-buf);
   if(p == 0) {
     std::stringstream s;
@@ -378,25 +884,27 @@ bool DictImpl::readEntry(long pos)
       << buf
       << "'";
     setError(s.str());
+    clearEntry();
     return false;
   }
-  *p = '\0';
-  currWord = std::string(buf);
+
+  currWordValid = currSenseValid = false;
   if(compressor) {
-    currWord = unescape(currWord);
-    currWord = compressor->decode(currWord);
+    currWord = compressor->decode(unescape(std::string(buf, p-buf)));
+    currWordValid = true;
+    wordData = currWord.data();
+    wordLength = currWord.size();
+  } else {
+    wordData = buf;
+    wordLength = p-buf;
   }
 
-  *pp = '\0';
   nextPos = currPos + (pp-buf) + 1;
 
-  currSense = std::string(p+1);
-  senseCompressed = false;
-  if(compressor) {
-    senseCompressed = true;
-//  currSense = unescape(currSense);
-//  currSense = compressor->decode(currSense);
-  }
+  // the sense is unescaped and decoded only when asked for
+  senseData = p+1;
+  senseLength = pp-(p+1);
+  senseCompressed = compressor != nullptr;
 
 //  printf("readEntry: currPos=%ld, nextPos=%ld, currSense=%s, currWord=%s\n",
 //         currPos, nextPos, currSense.c_str(), currWord.c_str());
@@ -406,10 +914,8 @@ bool DictImpl::readEntry(long pos)
   return true;
 }
 
-long DictImpl::findPrev(long pos)
+off_t DictImpl::findPrev(off_t pos)
 {
-  char s[256];
-
   if(pos < firstEntryPos) {
     return firstEntryPos;
   }
@@ -418,33 +924,43 @@ long DictImpl::findPrev(long pos)
     return lastEntryPos;
   }
 
-  long n = pos;
+  off_t n = pos;
 
   while(n > firstEntryPos) {
-    int len = sizeof(s);
-    if((n-len) < firstEntryPos) {
-      len = n - firstEntryPos + 1;
-    }
+    if(n < backBufPos || n >= backBufPos + backBufLen) {
+      // read the block that ends at n
+      off_t start = n - BACK_BUF_SIZE + 1;
+      if(start < firstEntryPos) {
+        start = firstEntryPos;
+      }
 
-    int k = fdata->read(n - len + 1, s, len);
-    if(k != len) {
-      setError(strerror(errno));
-      return -1;
+      int len = n - start + 1;
+      int k = readData(start, backBuf, len);
+      if(k != len) {
+        backBufLen = 0;
+        if(k >= 0) setError("unexpected end of file");
+        return -1;
+      }
+
+      backBufPos = start;
+      backBufLen = len;
     }
 
-    for(int i = len - 1; i >= 0; i--) {
-      if(s[i] == DATA_DELIMITER) {
-        return (n-len) + i + 2;
+    for(long i = n - backBufPos; i >= 0; i--) {
+      if(backBuf[i] == DATA_DELIMITER) {
+        BEDIC_STAT(stats.scanBytes, n - backBufPos - i + 1);
+        return backBufPos + i + 1;
       }
     }
 
-    n -= len;
+    BEDIC_STAT(stats.scanBytes, n - backBufPos + 1);
+    n = backBufPos - 1;
   }
 
   return firstEntryPos;
 }
 
-long DictImpl::findNext(long pos)
+off_t DictImpl::findNext(off_t pos)
 {
   char s[256];
 
@@ -458,11 +974,10 @@ long DictImpl::findNext(long pos)
 
   while(1)
   {
-    int n = fdata->read(pos, s, sizeof(s));
+    int n = readData(pos, s, sizeof(s));
 
     if(n < 0) {
-      setError(strerror(errno));
-      return false;
+      return -1;
     }
 
     if(n == 0) {
@@ -472,20 +987,22 @@ long DictImpl::findNext(long pos)
 
     char *p = (char *) memchr(s, DATA_DELIMITER, n);
     if(p != 0) {
+      BEDIC_STAT(stats.scanBytes, (p - s) + 1);
       pos += (p - s) + 1;
       break;
     }
 
+    BEDIC_STAT(stats.scanBytes, n);
     pos += n;
   }
 
   return pos;
 }
 
-int DictImpl::readProperties()
+off_t DictImpl::readProperties()
 {
   properties.clear();
-  int pos = 0;
+  off_t pos = 0;
 
   while(1) {
     std::string line;
@@ -545,25 +1062,8 @@ int DictImpl::readProperties()
     }
   }
 
-  // read compression method
-  ns = properties["compression-method"];
-  if(ns.size() == 0) {
-    ns = "none";
-  }
-
-  if(ns == "shcm") {
-    compressor = SHCM::create();
-    ns = properties["shcm-tree"];
-    if(ns.size() == 0) {
-      setError("no shcm tree");
-      return 0;
-    }
-
-    // this is unnecessary second unescape
-    // i am leaving it for now for backward compatibility
-    // with already broken dictionaries 
-    ns = unescape(ns);
-    compressor->startDecode(ns);
+  if(!initCompressor()) {
+    return 0;
   }
 
   // read the index
@@ -587,7 +1087,7 @@ int DictImpl::readProperties()
     std::string spos(idx, k+1);
     char *eptr;
 
-    long l = strtol(spos.c_str(), &eptr, 0);
+    off_t l = strtoll(spos.c_str(), &eptr, 0);
     if(*eptr != '\0') {
       index.clear();
       break;
@@ -599,14 +1099,168 @@ int DictImpl::readProperties()
   } while (n < (int) ns.size());
 
   properties.erase("index");
+
+  // the ordinal index can be megabytes of text, it is parsed by the
+  // first ordinal lookup, see loadOrdinalIndex
+  ordinalIndex.clear();
+  ordinalStep = 0;
+  ordinalIndexText.clear();
+  std::map<std::string, std::string>::iterator ordinals = properties.find("ordinal-index");
+  if(ordinals != properties.end()) {
+    ordinalIndexText.swap(ordinals->second);
+    properties.erase(ordinals);
+  }
+
+  // the checksums are checked once the size of the data part is known,
+  // see checkIntegrity
+  // a block size of 0 tells that the dictionary has no checksums
+  ns = properties["block-checksums"];
+  if(ns.size() == 0) {
+    checksums = BlockChecksums(0);
+  } else if(!checksums.parse(ns)) {
+    setError("invalid block-checksums property");
+  }
+  blockState.assign(checksums.getBlockCount(), BLOCK_UNCHECKED);
+  properties.erase("block-checksums");
+
+  entryCount = -1;
+  std::map<std::string, std::string>::const_iterator items = properties.find("items");
+  if(items != properties.end() && items->second.size() != 0) {
+    char *eptr;
+    long n = strtol(items->second.c_str(), &eptr, 0);
+    if(*eptr == '\0' && n > 0) {
+      entryCount = n;
+    }
+  }
   return pos;
 }
 
-int DictImpl::getLine(std::string &line, int &pos)
+bool DictImpl::initCompressor()
+{
+  // read compression method
+  std::string ns = properties["compression-method"];
+  if(ns.size() == 0) {
+    ns = "none";
+  }
+
+  if(ns == "shcm") {
+    compressor = SHCM::create();
+    ns = properties["shcm-tree"];
+    if(ns.size() == 0) {
+      setError("no shcm tree");
+      return false;
+    }
+
+    // this is unnecessary second unescape
+    // i am leaving it for now for backward compatibility
+    // with already broken dictionaries 
+    ns = unescape(ns);
+    compressor->startDecode(ns);
+  }
+
+  return true;
+}
+
+std::string DictImpl::saveSnapshot() const
+{
+  SnapshotWriter writer;
+  writer.put<long long>(firstEntryPos);
+  writer.put<long long>(lastEntryPos);
+  writer.put(maxWordLength);
+  writer.put(maxEntryLength);
+  writer.put(entryCount);
+
+  writer.put<unsigned long long>(properties.size());
+  std::map<std::string, std::string>::const_iterator it;
+  for(it = properties.begin(); it != properties.end(); ++it) {
+    writer.putString(it->first);
+    writer.putString(it->second);
+  }
+
+  writer.put<unsigned long long>(index.size());
+  for(size_t i = 0; i < index.size(); i++) {
+    writer.putVector(index[i].word);
+    writer.put<long long>(index[i].pos);
+  }
+
+  writer.put(ordinalStep);
+  writer.putVector(ordinalIndex);
+  writer.putString(ordinalIndexText);
+  writer.putString(checksums.getBlockSize() > 0 ? checksums.toString() : std::string());
+
+  saveCollation(writer);
+  return writer.getData();
+}
+
+bool DictImpl::loadSnapshot(const char *data, size_t size)
+{
+  SnapshotReader reader(data, size);
+  long long first = 0, last = 0;
+  int wordLength = 0, entryLength = 0;
+  long count = 0;
+  reader.get(first);
+  reader.get(last);
+  reader.get(wordLength);
+  reader.get(entryLength);
+  reader.get(count);
+
+  std::map<std::string, std::string> props;
+  unsigned long long n = 0;
+  reader.get(n);
+  for(unsigned long long i = 0; i < n && reader.isValid(); i++) {
+    std::string key, value;
+    reader.getString(key);
+    reader.getString(value);
+    props[key] = value;
+  }
+
+  std::vector<IndexEntry> idx;
+  n = 0;
+  reader.get(n);
+  for(unsigned long long i = 0; i < n && reader.isValid(); i++) {
+    CanonizedWord word;
+    long long pos = 0;
+    reader.getVector(word);
+    reader.get(pos);
+    idx.push_back(IndexEntry(word, pos));
+  }
+
+  long step = 0;
+  std::vector<off_t> ordinals;
+  std::string ordinalsText, sums;
+  reader.get(step);
+  reader.getVector(ordinals);
+  reader.getString(ordinalsText);
+  reader.getString(sums);
+
+  BlockChecksums blockSums(0);
+  if(!reader.isValid() || (!sums.empty() && !blockSums.parse(sums)) || !loadCollation(reader) ||
+     !reader.atEnd() || entryLength <= 0) {
+    return false;
+  }
+
+  firstEntryPos = first;
+  lastEntryPos = last;
+  maxWordLength = wordLength;
+  maxEntryLength = entryLength;
+  entryCount = count;
+  properties.swap(props);
+  index.swap(idx);
+  ordinalStep = step;
+  ordinalIndex.swap(ordinals);
+  ordinalIndexText.swap(ordinalsText);
+  checksums = blockSums;
+  blockState.assign(checksums.getBlockCount(), BLOCK_UNCHECKED);
+  name = properties["id"];
+
+  return initCompressor();
+}
+
+int DictImpl::getLine(std::string &line, off_t &pos)
 {
-  char line_buf[90];
+  char line_buf[1024];
   int i;
-  int p;
+  off_t p;
 
   line.erase();
   p = pos;
@@ -687,6 +1341,139 @@ bool DictImpl::checkIntegrity()
     }
   }
 
+  // the blocks themselves are checked when they are read
+  if(checksums.getBlockSize() > 0) {
+    if(checksums.getBlockCount() != checksums.getBlockCount(fdata->size() - firstEntryPos)) {
+      setError("Integrity failure: file size does not match the block checksums");
+      return false;
+    }
+
+    verifyOnRead = true;
+  }
+
+  return true;
+}
+
+bool DictImpl::verifyRange(off_t pos, int len)
+{
+  if(verifyOnRead && len > 0 && pos >= firstEntryPos) {
+    long blockSize = checksums.getBlockSize();
+    size_t last = (pos + len - 1 - firstEntryPos) / blockSize;
+    if(last >= blockState.size()) {
+      last = blockState.size() - 1;
+    }
+
+    for(size_t i = (pos - firstEntryPos) / blockSize; i <= last; i++) {
+      if(blockState[i] != BLOCK_GOOD && !verifyBlock(i)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+int DictImpl::readData(off_t pos, char *data, int len)
+{
+  if(!verifyRange(pos, len)) {
+    return -1;
+  }
+
+  if(scanBuf != nullptr && len <= SCAN_BUF_SIZE) {
+    if(pos < scanBufPos || pos + len > scanBufPos + scanBufLen) {
+      scanBufLen = 0;
+      int n = fdata->read(pos, scanBuf, SCAN_BUF_SIZE);
+      if(n < 0) {
+        setError(strerror(errno));
+        return n;
+      }
+
+      scanBufPos = pos;
+      scanBufLen = n;
+    }
+
+    int n = std::max<off_t>(0, std::min<off_t>(len, scanBufPos + scanBufLen - pos));
+    memcpy(data, scanBuf + (pos - scanBufPos), n);
+    return n;
+  }
+
+  int n = fdata->read(pos, data, len);
+  if(n < 0) {
+    setError(strerror(errno));
+  }
+
+  return n;
+}
+
+DictImpl::BlockState DictImpl::checkBlock(File *file, size_t i, std::vector<char> &data) const
+{
+  long blockSize = checksums.getBlockSize();
+  off_t start = firstEntryPos + (off_t) i * blockSize;
+  off_t len = std::min<off_t>(blockSize, file->size() - start);
+  data.resize(blockSize);
+
+  if(len <= 0 || file->read(start, &data[0], len) != len) {
+    return BLOCK_CORRUPT;
+  }
+
+  return BlockChecksums::checksum(&data[0], len) == checksums.getChecksum(i) ? BLOCK_GOOD : BLOCK_CORRUPT;
+}
+
+bool DictImpl::verifyBlock(size_t i)
+{
+  if(blockState[i] == BLOCK_UNCHECKED) {
+    std::vector<char> data;
+    blockState[i] = checkBlock(fdata, i, data);
+  }
+
+  if(blockState[i] == BLOCK_CORRUPT) {
+    std::stringstream s;
+    s << "Integrity failure: checksum mismatch in block " << i;
+    setError(s.str());
+    return false;
+  }
+
+  return true;
+}
+
+bool DictImpl::verifyChecksums(int threads)
+{
+  if(!checkIntegrity()) {
+    return false;
+  }
+
+  if(blockState.empty()) {
+    return true;
+  }
+
+  // a contiguous range of blocks per thread, so that each reads its
+  // part of the file sequentially; the threads write to different
+  // elements of blockState
+  ThreadPool pool(threads);
+  int parts = std::min<size_t>(pool.getThreadCount(), blockState.size());
+  pool.run(parts, [this, parts](int part) {
+    size_t from = blockState.size() * part / parts;
+    size_t to = blockState.size() * (part + 1) / parts;
+
+    // the blocks left unchecked are checked below with fdata
+    File *file = createFile(fileName.c_str());
+    if(file->open(fileName.c_str()) >= 0) {
+      std::vector<char> data;
+      for(size_t i = from; i < to; i++) {
+        if(blockState[i] == BLOCK_UNCHECKED) {
+          blockState[i] = checkBlock(file, i, data);
+        }
+      }
+    }
+    delete file;
+  });
+
+  for(size_t i = 0; i < blockState.size(); i++) {
+    if(!verifyBlock(i)) {
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -753,81 +1540,142 @@ std::string DictImpl::unescape(const std::string &str) {
 
 CanonizedWord CollationComparator::canonizeWord(const std::string &word)
 {
-  std::string s = word;
-  for(unsigned int i = 0; i < ignoreChars.size(); i++) {
-    std::string::size_type n;
-    while((n = s.find(ignoreChars[i])) != std::string::npos) {
-      s.erase(n, ignoreChars[i].size());
+  CanonizedWord ss;
+  canonizeWord(word.c_str(), word.size(), ss);
+  return ss;
+}
+
+void CollationComparator::canonizeWord(const char *sPtr, int len, CanonizedWord &ss)
+{
+  const char *sEnd = sPtr + len;
+
+  BEDIC_STAT(canonicalizations, 1);
+  ss.clear();
+  ss.reserve(len);
+  while(sPtr < sEnd) {
+    // Runs of ASCII do not need to go through the UTF-8 decoder
+    int n = Utf8::asciiSpan(sPtr, sEnd - sPtr);
+    for(const char *aEnd = sPtr + n; sPtr < aEnd; sPtr++) {
+      unsigned int unit = canonizeRune((unsigned char) *sPtr);
+      if(unit != SKIP_UNIT)
+        ss.push_back(unit);
     }
-  }
 
-  CanonizedWord ss;
-//  ss.reserve( maxWordLength );
-  const char *sPtr = s.c_str();
-  while(*sPtr != 0) {
-    int rune = Utf8::chartorune(&sPtr);
+    if(sPtr == sEnd || *sPtr == 0) break;
+
+    unsigned int rune;
+    if(sEnd - sPtr >= 4) {
+      rune = Utf8::chartorune(&sPtr);
+    }
+    else {
+      // Do not let the decoder read past the end of the word
+      char tail[5] = { 0, 0, 0, 0, 0 };
+      memcpy(tail, sPtr, sEnd - sPtr);
+      const char *t = tail;
+      rune = Utf8::chartorune(&t);
+      sPtr += t - tail;
+    }
     if(rune == 128) break;
 
-    if(useCharPrecedence) {
-      std::map<int, int>::iterator itcol = charPrecedence.find(rune);
-      if(itcol == charPrecedence.end())
-        ss.push_back((unsigned short)(charPrecedenceUnknown + rune));
-      else
-        ss.push_back(itcol->second);
+    unsigned int unit = canonizeRune(rune);
+    if(unit != SKIP_UNIT)
+      ss.push_back(unit);
+  }
+
+  if(useCharPrecedence) {
+    // Lay the key out as [groups..., 0, units...]. Groups start at 1, so a
+    // word whose groups are a prefix of another word's groups sorts first,
+    // and units only break ties between words with the same groups.
+    size_t n = ss.size();
+    unsigned int unknown = charPrecedenceUnknown;
+
+    ss.resize(2 * n + 1);
+    for(size_t i = n; i > 0; i--) {
+      unsigned int unit = ss[i - 1];
+      ss[n + i] = unit;
+      ss[i - 1] = precedenceGroups[unit >= unknown ? unknown : unit];
     }
-    else
-      ss.push_back(Utf8::runetoupper(rune));
+    ss[n] = 0;
   }
-  return ss;
 }
 
-int CollationComparator::compare(const CanonizedWord &s1, const CanonizedWord &s2)
+void CollationComparator::setUnit(unsigned int rune, unsigned int unit)
 {
-  CanonizedWord::const_iterator it1 = s1.begin();
-  CanonizedWord::const_iterator it2 = s2.begin();
-  if(useCharPrecedence)
-  {
-    for( ;it1 != s1.end() && it2 != s2.end(); ++it1, ++it2)
-    {
-      // handle characters that are not defined in the collation string
-      int ind1 = *it1 >= charPrecedenceUnknown ? charPrecedenceUnknown : *it1;
-      int ind2 = *it2 >= charPrecedenceUnknown ? charPrecedenceUnknown : *it2;
-      if(precedenceGroups[ind1] < precedenceGroups[ind2]) return -1;
-      if(precedenceGroups[ind1] > precedenceGroups[ind2]) return 1;
-    }
+  unsigned int page = rune >> 8;
+  if(page >= unitPage.size())
+    unitPage.resize(page + 1, 0);
+
+  if(unitPage[page] == 0) {
+    unitPage[page] = unitTable.size() >> 8;
+    for(unsigned int r = page << 8; r < ((page + 1) << 8); r++)
+      unitTable.push_back(defaultUnit(r));
+  }
 
-    if(it1 == s1.end() && it2 == s2.end())
-    {
-      for(it1 = s1.begin(), it2 = s2.begin(); it1 != s1.end() && it2 != s2.end(); ++it1, ++it2)
-      {
-        if(*it1 < *it2) return -1;
-        if(*it1 > *it2) return 1;
-      }
-      return 0;
-    }
+  unitTable[(unitPage[page] << 8) | (rune & 0xFF)] = unit;
+}
 
-    if(it1 == s1.end()) return -1;
+/**
+ * Index of the first position where a and b differ, or n if the first n
+ * units are equal
+ */
+static size_t firstMismatch(const unsigned int *a, const unsigned int *b, size_t n)
+{
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  for( ; i + 8 <= n; i += 8) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+    unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi32(va, vb));
+    if(mask != 0xFFFFFFFFu)
+      return i + __builtin_ctz(~mask) / 4;
+  }
+#endif
+
+#if defined(__SSE2__)
+  for( ; i + 4 <= n; i += 4) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+    unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(va, vb));
+    if(mask != 0xFFFF)
+      return i + __builtin_ctz(~mask) / 4;
+  }
+#endif
 
-    return 1;
+  for( ; i < n; i++) {
+    if(a[i] != b[i])
+      return i;
   }
-  else
-  {                      // No char precedence
-    for( ;it1 != s1.end() && it2 != s2.end(); ++it1, ++it2)
-    {
-      if(*it1 < *it2) return -1;
-      if(*it1 > *it2) return 1;
-    }
 
-    if(it1 == s1.end() && it2 == s2.end()) return 0;
-    if(it1 == s1.end()) return -1;
+  return n;
+}
 
-    return 1;
-  }
+int CollationComparator::compare(const CanonizedWord &s1, const CanonizedWord &s2)
+{
+  // Sort keys of both collation modes compare lexicographically,
+  // see canonizeWord for the layout used with char-precedence
+  size_t n = s1.size() < s2.size() ? s1.size() : s2.size();
+  size_t i = firstMismatch(s1.data(), s2.data(), n);
+
+  if(i < n)
+    return s1[i] < s2[i] ? -1 : 1;
+
+  if(s1.size() == s2.size()) return 0;
+
+  return s1.size() < s2.size() ? -1 : 1;
 }
 
 void CollationComparator::setCollation(const std::string &collationDef,
                                        const std::string &ic)
 {
+  // the collation may be set again, as SQLite dictionaries do when
+  // their properties change
+  ignoreChars.clear();
+  charPrecedence.clear();
+  precedenceGroups.clear();
+  useCharPrecedence = false;
+  charPrecedenceUnknown = 0;
+
   if(collationDef.size() != 0)
   {
     int order = 0;
@@ -894,5 +1742,84 @@ void CollationComparator::setCollation(const std::string &collationDef,
 
     ignoreChars.push_back(std::string(t, (s-t)));
   }
-  
+
+  // Compile the collation table, page 0 is never used
+  unitPage.clear();
+  unitTable.assign(256, 0);
+
+  if(useCharPrecedence) {
+    std::map<int, int>::const_iterator it;
+    for(it = charPrecedence.begin(); it != charPrecedence.end(); ++it)
+      setUnit(it->first, it->second);
+  }
+
+  // Ignored characters win over char-precedence
+  for(unsigned int i = 0; i < ignoreChars.size(); i++) {
+    const char *t = ignoreChars[i].c_str();
+    setUnit(Utf8::chartorune(&t), SKIP_UNIT);
+  }
+}
+
+void CollationComparator::saveCollation(SnapshotWriter &writer) const
+{
+  writer.put<unsigned long long>(ignoreChars.size());
+  for(size_t i = 0; i < ignoreChars.size(); i++)
+    writer.putString(ignoreChars[i]);
+
+  std::vector<int> precedence;
+  std::map<int, int>::const_iterator it;
+  for(it = charPrecedence.begin(); it != charPrecedence.end(); ++it) {
+    precedence.push_back(it->first);
+    precedence.push_back(it->second);
+  }
+  writer.putVector(precedence);
+
+  writer.putVector(precedenceGroups);
+  writer.put(useCharPrecedence);
+  writer.put(useCharPrecedence ? charPrecedenceUnknown : 0);
+  writer.putVector(unitPage);
+  writer.putVector(unitTable);
+}
+
+bool CollationComparator::loadCollation(SnapshotReader &reader)
+{
+  std::vector<std::string> ic;
+  unsigned long long n = 0;
+  reader.get(n);
+  for(unsigned long long i = 0; i < n && reader.isValid(); i++) {
+    std::string c;
+    reader.getString(c);
+    ic.push_back(c);
+  }
+
+  std::vector<int> precedence, groups;
+  std::vector<unsigned short> pages;
+  std::vector<unsigned int> table;
+  bool usePrecedence = false;
+  int unknown = 0;
+  reader.getVector(precedence);
+  reader.getVector(groups);
+  reader.get(usePrecedence);
+  reader.get(unknown);
+  reader.getVector(pages);
+  reader.getVector(table);
+
+  // every page must be in the table
+  if(!reader.isValid() || precedence.size() % 2 != 0 || table.size() < 256 || table.size() % 256 != 0)
+    return false;
+  for(size_t i = 0; i < pages.size(); i++) {
+    if(((size_t) pages[i] << 8) >= table.size())
+      return false;
+  }
+
+  ignoreChars.swap(ic);
+  charPrecedence.clear();
+  for(size_t i = 0; i < precedence.size(); i += 2)
+    charPrecedence[precedence[i]] = precedence[i + 1];
+  precedenceGroups.swap(groups);
+  useCharPrecedence = usePrecedence;
+  charPrecedenceUnknown = unknown;
+  unitPage.swap(pages);
+  unitTable.swap(table);
+  return true;
 }
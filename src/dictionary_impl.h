@@ -28,13 +28,20 @@
 #ifndef DICTIONARY_IMPL_H
 #define DICTIONARY_IMPL_H
 
+#include <sys/types.h>
+
 #include <string>
 #include <vector>
 #include <map>
 
+#include "block_checksums.h"
 #include "dictionary.h"
 #include "file.h"
+#include "lookup_cache.h"
+#include "shared_cache.h"
 #include "shcm.h"
+#include "stats.h"
+#include "utf8.h"
 
 /**
  * DictImpl class implements the abstract Dictionary class
@@ -85,7 +92,13 @@
 
 struct entry_type;
 
-typedef std::vector<unsigned short> CanonizedWord;
+/**
+ * Canonical form of a word (sort key), one unit per rune (runes can be
+ * above U+FFFF). With char-precedence the precedence groups of all the
+ * runes come first, followed by 0 and the units, so that keys always
+ * compare lexicographically.
+ */
+typedef std::vector<unsigned int> CanonizedWord;
 
 class CollationComparator 
 {
@@ -96,9 +109,32 @@ protected:
   bool useCharPrecedence;
   int charPrecedenceUnknown;
 
+  /// Unit of the runes that are left out of the canonized word
+  static const unsigned int SKIP_UNIT = 0xFFFFFFFF;
+
+  /**
+   * Compiled collation table, built by setCollation from charPrecedence
+   * and ignoreChars. unitPage is indexed by rune >> 8 and gives the page
+   * of 256 units in unitTable, 0 for pages where all the runes get the
+   * default unit.
+   */
+  std::vector<unsigned short> unitPage;
+  std::vector<unsigned int> unitTable;
+
 public:
+#ifdef BEDIC_STATS
+  /// Words canonized with this collation
+  StatCounter canonicalizations;
+#endif
+
   void setCollation(const std::string &collationDef, const std::string &ignoreChars);
 
+  /// Appends the compiled collation to a snapshot, see SharedCache
+  void saveCollation(SnapshotWriter &writer) const;
+
+  /// Reads a collation written by saveCollation
+  bool loadCollation(SnapshotReader &reader);
+
   /**
    * Compares two words
    * The words should be put in canonical form before this method is called
@@ -114,11 +150,41 @@ public:
    *
    * All the characters in the word are upper-cased.
    * All the characters that should be ignored are removed.
+   * With char-precedence the key is [groups..., 0, units...].
    *
    * @param s   The word to canonize
    * @return  canonical form of the word
    */
   CanonizedWord canonizeWord(const std::string &s);
+
+  /**
+   * Canonizes len bytes of s (not necessarily zero terminated) into ss.
+   * Stops at a zero byte or an invalid UTF-8 sequence.
+   */
+  void canonizeWord(const char *s, int len, CanonizedWord &ss);
+
+protected:
+  /// Canonical unit of a single rune, SKIP_UNIT for ignored characters
+  unsigned int canonizeRune(unsigned int rune) const
+  {
+    unsigned int page = rune >> 8;
+    if(page < unitPage.size() && unitPage[page] != 0)
+      return unitTable[(unitPage[page] << 8) | (rune & 0xFF)];
+
+    return defaultUnit(rune);
+  }
+
+  /// Unit of a rune that is neither in char-precedence nor ignored
+  unsigned int defaultUnit(unsigned int rune) const
+  {
+    if(useCharPrecedence)
+      return charPrecedenceUnknown + rune;
+
+    return Utf8::runetoupper(rune);
+  }
+
+  /// Sets the unit of a rune in the compiled table
+  void setUnit(unsigned int rune, unsigned int unit);
 };
 
 
@@ -172,6 +238,19 @@ public:
    */
   virtual bool findEntry(const std::string &word, bool &subword);
 
+  /**
+   * Looks for several words at once, with the same results as findEntry
+   * for each of them. The binary searches run in lockstep: every step
+   * reads the blocks of all the words still searched with one
+   * File::readBatch, so that a cold lookup of n words waits for the
+   * device about as long as a lookup of one.
+   *
+   * The internal word pointer is left at an undefined entry.
+   *
+   * @return true if no error occurred
+   */
+  virtual bool findEntries(const std::vector<std::string> &words, std::vector<LookupResult> &results);
+
   /**
    * Moves the internal word pointer to the next word.
    * If the pointer is set to the last word, it is not changed.
@@ -180,6 +259,14 @@ public:
    */
   virtual bool nextEntry();
 
+  /**
+   * Moves the internal word pointer to the previous word.
+   * If the pointer is set to the first word, it is not changed.
+   *
+   * @return true if the pointer is moved
+   */
+  virtual bool previousEntry();
+
   /**
    * Moves the internal word pointer to the first word.
    * 
@@ -201,6 +288,50 @@ public:
    */
   virtual bool randomEntry();
 
+  /**
+   * Returns the number of entries, from the items property if present
+   *
+   * @return number of entries, or -1 if error
+   */
+  virtual long getEntryCount();
+
+  /// The data part of an empty dictionary has no entry to start at
+  virtual bool isEmpty() const
+  {
+    return lastEntryPos < firstEntryPos;
+  }
+
+  /**
+   * Moves the internal word pointer to the n-th entry (counted from 0).
+   * Uses the ordinal index if the dictionary has one, otherwise walks
+   * from the first entry.
+   *
+   * @return true if the word is read successfully
+   */
+  virtual bool seekOrdinal(long n);
+
+  /**
+   * Returns the number of entries that sort before the word and moves
+   * the internal word pointer to the first entry not smaller than it.
+   *
+   * @return rank of the word, or -1 if error
+   */
+  virtual long rankOf(const std::string &word);
+
+  virtual void setCacheSize(size_t entries);
+  virtual void getCacheStats(LookupCacheStats &stats) const;
+
+  /**
+   * In sequential mode readData reads SCAN_BUF_SIZE bytes at a time
+   * into scanBuf, and the file is told to read ahead
+   */
+  virtual void setSequentialAccess(bool sequential);
+
+  virtual void setChunkCacheFile(bool enable);
+
+  virtual bool getStats(DictionaryStats &stats) const;
+  virtual void resetStats();
+
   /**
    * Returns the word pointed by the internal word pointer
    *
@@ -215,6 +346,16 @@ public:
    */
   virtual const std::string &getSense() const;
 
+  /**
+   * Returns the current word without copying it, see Dictionary::getWordData
+   */
+  virtual const char *getWordData(size_t &length) const;
+
+  /**
+   * Returns the sense without copying it, see Dictionary::getSenseData
+   */
+  virtual const char *getSenseData(size_t &length) const;
+
   /**
    * Returns error description or zero if no error 
    *
@@ -235,14 +376,34 @@ public:
     return properties[key];
   }
 
+  /// All the properties of the header, except the index properties
+  const std::map<std::string, std::string> &getProperties() const {
+    return properties;
+  }
+
   /**
    * Check integrity of the dictionary file.
    *
+   * If the dictionary has block checksums, also checks that they cover
+   * the whole file and turns on their verification: from then on every
+   * block is checked the first time it is read, and reading a corrupted
+   * block fails.
+   *
    * @return  true if integrity check is succesfull - dictionary file is not
    *          corrupted.
    */
   bool checkIntegrity();
 
+  /**
+   * Checks all the blocks against their checksums, each thread reading
+   * a part of the file with its own descriptor. Blocks already checked
+   * are skipped. Without block checksums, the same as checkIntegrity.
+   *
+   * @param threads  number of threads, 0 for one per processor
+   * @return  true if no block is corrupted
+   */
+  virtual bool verifyChecksums(int threads);
+
 protected:
 
   /**
@@ -253,19 +414,19 @@ protected:
   struct IndexEntry
   {
     CanonizedWord word;
-    long pos;
+    off_t pos;
 
-    IndexEntry(const CanonizedWord &w, long p) : word(w), pos(p) { }
+    IndexEntry(const CanonizedWord &w, off_t p) : word(w), pos(p) { }
   };
 
   /// File descriptor to the dictionary file
   File *fdata;
 
   /// Position of the first entry
-  long firstEntryPos;
+  off_t firstEntryPos;
 
   /// Position of the last entry
-  long lastEntryPos;
+  off_t lastEntryPos;
 
   /// Error description
   std::string errorDescr;
@@ -276,33 +437,94 @@ protected:
   int maxWordLength;
   int maxEntryLength;
 
-  /// General purpose buffer
+  /// General purpose buffer, holds the current entry
   char *buf;
 
-  /// Current word
-  std::string currWord;
+  /// Current word, points into buf or to currWord if compressed
+  const char *wordData;
+  size_t wordLength;
+
+  /// The sense of the current word, points into buf
+  const char *senseData;
+  size_t senseLength;
 
-  /// The sense of the current word
+  /// Current word, only built when asked for
+  mutable std::string currWord;
+  mutable bool currWordValid;
+
+  /// The sense of the current word, only built when asked for
   mutable std::string currSense;
+  mutable bool currSenseValid;
 
   /// Senses are compressed using the SHC compressor
   mutable bool senseCompressed;
 
+  /// Sets the current entry to an empty word
+  void clearEntry();
+
+  /// Buffer for scanning backward, keeps the last block read by findPrev
+  char *backBuf;
+  off_t backBufPos;
+  int backBufLen;
+
+  /// Buffer of the sequential mode, holds the last block read by readData
+  char *scanBuf;
+  off_t scanBufPos;
+  int scanBufLen;
+
   /// Current position
-  long currPos;
+  off_t currPos;
 
   /// Next position, or -1 if not defined
-  long nextPos;
+  off_t nextPos;
 
   /// Index table
   std::vector<IndexEntry> index;
 
+  /// Positions of every ordinalStep-th entry (ordinal-index property)
+  std::vector<off_t> ordinalIndex;
+  long ordinalStep;
+
+  /// The ordinal-index property until loadOrdinalIndex parses it
+  std::string ordinalIndexText;
+
+  /// Number of entries, -1 if not known yet
+  long entryCount;
+
+  /// Result of findEntry: the entry as it is in buf
+  struct CachedLookup
+  {
+    off_t pos;
+    bool found;
+    std::string entry;
+  };
+
+  LookupCache<CachedLookup> lookupCache;
+
+#ifdef BEDIC_STATS
+  /// Counters of the searches, the file and the compressor have their own
+  StatCounters stats;
+#endif
+
+  /// The block-checksums property
+  BlockChecksums checksums;
+
+  /// State of every block, see verifyBlock
+  enum BlockState { BLOCK_UNCHECKED, BLOCK_GOOD, BLOCK_CORRUPT };
+  std::vector<unsigned char> blockState;
+
+  /// Blocks are checked when they are first read
+  bool verifyOnRead;
+
   /// Property values
   std::map<std::string, std::string> properties;
 
   /// The SHC compressor
   SHCM *compressor;
 
+  /// Cache shared with other processes, null if disabled
+  SharedCache *sharedCache;
+
   /// Set an error description
   void setError(const std::string &err) {
     errorDescr = err; 
@@ -320,7 +542,54 @@ protected:
    * Updates properties field with the values of the
    * properties read from the header.
    */
-  int readProperties();
+  off_t readProperties();
+
+  /// Sets up the compressor named by the compression-method property
+  bool initCompressor();
+
+  /**
+   * What readProperties and the constructor work out from the file: the
+   * properties, the positions of the entries, the index and the
+   * collation. A process that finds the snapshot in the shared cache
+   * loads it instead of reading the header.
+   */
+  std::string saveSnapshot() const;
+
+  /// Loads a snapshot written by saveSnapshot, returns false if it is invalid
+  bool loadSnapshot(const char *data, size_t size);
+
+  /**
+   * Reads len bytes of the data part from the file, checking the blocks
+   * they span first if verifyOnRead is set. Sets the error description
+   * if the read fails or a block is corrupted.
+   *
+   * @return number of bytes read, or -1 if error
+   */
+  int readData(off_t pos, char *data, int len);
+
+  /**
+   * Checks the blocks that len bytes at pos span if verifyOnRead is set,
+   * as readData does before reading
+   *
+   * @return false if a block is corrupted
+   */
+  bool verifyRange(off_t pos, int len);
+
+  /**
+   * Checks block i against its checksum and records the result in
+   * blockState. Sets the error description if the block is corrupted.
+   *
+   * @return true if the block is not corrupted
+   */
+  bool verifyBlock(size_t i);
+
+  /**
+   * Reads block i from file into data and compares it with its checksum.
+   * Used by verifyBlock and, with a file per thread, by verifyChecksums.
+   *
+   * @return BLOCK_GOOD or BLOCK_CORRUPT
+   */
+  BlockState checkBlock(File *file, size_t i, std::vector<char> &data) const;
 
   /**
    * Reads a line from the header.
@@ -333,12 +602,14 @@ protected:
    *
    * @return next line
    */
-  int getLine(std::string &, int &);
+  int getLine(std::string &, off_t &);
 
   /**
    * Reads an entry starting from the specified position.
    *
-   * Updates currWord, currSense, currPos and nextPos fields.
+   * Updates wordData, senseData, currPos and nextPos fields.
+   * The word and the sense are left in buf and copied to currWord and
+   * currSense only when they are asked for.
    *
    * The method expects that pos points to the start of an
    * entry. If not, the results are undefined.
@@ -347,7 +618,13 @@ protected:
    *
    * @return true if read was succesful
    */
-  bool readEntry(long pos);
+  bool readEntry(off_t pos);
+
+  /**
+   * Sets the current entry to the one in buf, which ends at end (the
+   * data delimiter). currPos must be set.
+   */
+  bool parseEntry(const char *end);
 
   /**
    * Looks backward for a start of an entry.
@@ -359,11 +636,14 @@ protected:
    * the last entry, the position of the last entry is
    * returned.
    *
+   * The last block read is kept in backBuf, so stepping backward
+   * entry by entry reads the file only once per block.
+   *
    * @param pos   position to start scanning backward from
    *
    * @return start position of an entry
    */
-  long findPrev(long pos);
+  off_t findPrev(off_t pos);
 
   /** 
    * Looks forward for a start of an entry.
@@ -379,7 +659,7 @@ protected:
    *
    * @return start position of an entry
    */
-  long findNext(long pos);
+  off_t findNext(off_t pos);
 
   /**
    * Index lookup
@@ -391,7 +671,19 @@ protected:
    * @param b output param. sets the start of the region
    * @param e output param. sets the end of the region
    */
-  void bsearchIndex(const CanonizedWord &s, long &b, long &e);
+  void bsearchIndex(const CanonizedWord &s, off_t &b, off_t &e);
+
+  /**
+   * Ordinal of the entry at pos, counted by walking forward from the
+   * nearest ordinal index sample (or from the first entry)
+   *
+   * @param pos  start of an entry
+   * @return ordinal of the entry, or -1 if error
+   */
+  long ordinalOf(off_t pos);
+
+  /// Parses ordinalIndexText into ordinalIndex if not done yet
+  void loadOrdinalIndex();
 
   // Entry delimiter character
   static const char DATA_DELIMITER;
@@ -399,6 +691,15 @@ protected:
   // Word delimiter character
   static const char WORD_DELIMITER;
 
+  // Size of the backward scanning buffer
+  static const int BACK_BUF_SIZE = 4096;
+
+  // Words searched in lockstep by findEntries
+  static const size_t LOOKUP_BATCH_SIZE = 256;
+
+  // Size of the buffer of the sequential mode
+  static const int SCAN_BUF_SIZE = 1 << 20;
+
 public:
   /// Convert the string s to escape codes
   static std::string escape(const std::string &s);
@@ -0,0 +1,329 @@
+/**
+ * @file   dictionary_writer.cpp
+ * @brief  Write a bedic dictionary, optionally dictzip compressed
+ * @author Lyndon Hill and others
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include <zlib.h>
+}
+
+#include <algorithm>
+#include <vector>
+
+#include "dictionary_writer.h"
+#include "dictionary_impl.h"
+
+DictionaryWriter::DictionaryWriter() : dataSize(0), lastIndexOffset(-32769), lastIndexStart(0),
+                                       lastEntryOffset(0),
+                                       entries(0), maxWordLength(0), maxEntryLength(0),
+                                       memberChunks(MEMBER_CHUNKS)
+{
+  spool = tmpfile();
+  if(spool == nullptr)
+    setError(strerror(errno));
+
+  ordinalIndex = "64";
+}
+
+DictionaryWriter::~DictionaryWriter()
+{
+  if(spool != nullptr)
+    fclose(spool);
+}
+
+bool DictionaryWriter::addEntry(const char *keyword, size_t keywordLength, const char *description,
+                                size_t descriptionLength)
+{
+  if(spool == nullptr)
+    return false;
+
+  // The same sampling as xerox: a word every 32kB, every 64th entry
+  if(lastIndexOffset + 32768 < dataSize) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "\n%lld", (long long) dataSize);
+    lastIndexStart = index.size();
+    index += (char) 0;
+    index.append(keyword, keywordLength);
+    index += buf;
+    lastIndexOffset = dataSize;
+  }
+
+  if(entries % 64 == 0) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), " %lld", (long long) dataSize);
+    ordinalIndex += buf;
+  }
+
+  size_t length = keywordLength + descriptionLength + 2;
+  if(fwrite(keyword, 1, keywordLength, spool) != keywordLength || fputc('\n', spool) == EOF ||
+     fwrite(description, 1, descriptionLength, spool) != descriptionLength ||
+     fputc('\0', spool) == EOF) {
+    setError(strerror(errno));
+    return false;
+  }
+
+  checksums.add(keyword, keywordLength);
+  checksums.add("\n", 1);
+  checksums.add(description, descriptionLength);
+  checksums.add("", 1);
+
+  if(maxWordLength < keywordLength)
+    maxWordLength = keywordLength;
+  if(maxEntryLength < length)
+    maxEntryLength = length;
+
+  lastEntryOffset = dataSize;
+  dataSize += length;
+  entries++;
+
+  return true;
+}
+
+std::string DictionaryWriter::makeHeader()
+{
+  std::map<std::string, std::string> prop(properties);
+  char buf[256];
+
+  // xerox does not index the last entry
+  std::string idx = index;
+  if(entries > 0 && lastIndexOffset == lastEntryOffset)
+    idx.resize(lastIndexStart);
+
+  snprintf(buf, sizeof(buf), "%u", (unsigned int) maxEntryLength);
+  prop["max-entry-length"] = buf;
+  snprintf(buf, sizeof(buf), "%u", (unsigned int) maxWordLength);
+  prop["max-word-length"] = buf;
+  prop["compression-method"] = "none";
+  prop.erase("shcm-tree");
+
+  if(idx.size() > 0)
+    prop["index"] = idx;
+  else
+    prop.erase("index");
+
+  prop["ordinal-index"] = ordinalIndex;
+  prop["block-checksums"] = checksums.toString();
+
+  snprintf(buf, sizeof(buf), "%lld", (long long) dataSize);
+  prop["dict-size"] = buf;
+  snprintf(buf, sizeof(buf), "%ld", entries);
+  prop["items"] = buf;
+
+  time_t currentTime;
+  time(&currentTime);
+  asctime_r(localtime(&currentTime), buf);
+  prop["builddate"] = buf;
+
+  std::string header;
+  std::map<std::string, std::string>::iterator it;
+  for(it = prop.begin(); it != prop.end(); ++it) {
+    header += DictImpl::escape(it->first);
+    header += '=';
+    header += DictImpl::escape(it->second);
+    header += '\n';
+  }
+  header += (char) 0;
+
+  return header;
+}
+
+int DictionaryWriter::readData(const std::string &header, size_t &headerPos, char *buf, int len)
+{
+  int n = 0;
+  if(headerPos < header.size()) {
+    n = std::min<size_t>(len, header.size() - headerPos);
+    memcpy(buf, header.data() + headerPos, n);
+    headerPos += n;
+  }
+
+  if(n < len) {
+    size_t r = fread(buf + n, 1, len - n, spool);
+    if(r < (size_t) (len - n) && ferror(spool)) {
+      setError(strerror(errno));
+      return -1;
+    }
+    n += r;
+  }
+
+  return n;
+}
+
+bool DictionaryWriter::writePlain(int fd, const std::string &header)
+{
+  std::vector<char> buf(CHUNK_LENGTH);
+  size_t headerPos = 0;
+
+  for(;;) {
+    int n = readData(header, headerPos, &buf[0], buf.size());
+    if(n < 0) return false;
+    if(n == 0) return true;
+
+    if(::write(fd, &buf[0], n) != n) {
+      setError(strerror(errno));
+      return false;
+    }
+  }
+}
+
+static void putShort(unsigned char *p, unsigned int x)
+{
+  p[0] = x & 0xff;
+  p[1] = (x >> 8) & 0xff;
+}
+
+static void putLong(unsigned char *p, unsigned long x)
+{
+  putShort(p, x & 0xffff);
+  putShort(p + 2, (x >> 16) & 0xffff);
+}
+
+/**
+ * The dictzip format is gzip with an "RA" extra field listing the
+ * compressed size of every chunk. Each chunk ends with a full flush, so
+ * the chunks can be inflated independently. The chunk count of a member
+ * is limited, larger dictionaries are written as several members, which
+ * DZFile reads as one file.
+ */
+bool DictionaryWriter::writeDictZip(int fd, const std::string &header)
+{
+  off_t total = header.size() + dataSize;
+  long chunkCount = (total + CHUNK_LENGTH - 1) / CHUNK_LENGTH;
+
+  z_stream zstream;
+  memset(&zstream, 0, sizeof(zstream));
+  if(deflateInit2(&zstream, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+    setError("Cannot initialize the compressor");
+    return false;
+  }
+
+  size_t headerPos = 0;
+  bool ok = true;
+  for(long i = 0; ok && i < chunkCount; i += memberChunks) {
+    ok = writeMember(fd, header, headerPos, std::min<long>(memberChunks, chunkCount - i), zstream);
+    deflateReset(&zstream);
+  }
+  deflateEnd(&zstream);
+
+  return ok;
+}
+
+bool DictionaryWriter::writeMember(int fd, const std::string &header, size_t &headerPos, long chunkCount,
+                                   z_stream &zstream)
+{
+  off_t start = lseek(fd, 0, SEEK_CUR);
+  int xlen = 10 + 2 * chunkCount;
+  std::vector<unsigned char> head(12 + xlen, 0);
+  head[0] = 0x1f;
+  head[1] = 0x8b;
+  head[2] = Z_DEFLATED;
+  head[3] = 0x04;                // FEXTRA
+  putLong(&head[4], time(nullptr));
+  head[8] = 2;                   // best compression
+  head[9] = 3;                   // Unix
+  putShort(&head[10], xlen);
+  head[12] = 'R';
+  head[13] = 'A';
+  putShort(&head[14], xlen - 4);
+  putShort(&head[16], 1);        // version
+  putShort(&head[18], CHUNK_LENGTH);
+  putShort(&head[20], chunkCount);
+
+  // the chunk sizes are filled in when the chunks are written
+  if(start < 0 || ::write(fd, &head[0], head.size()) != (int) head.size()) {
+    setError(strerror(errno));
+    return false;
+  }
+
+  std::vector<char> in(CHUNK_LENGTH);
+  std::vector<char> out(deflateBound(&zstream, CHUNK_LENGTH) + 64);
+  unsigned long crc = crc32(0, nullptr, 0);
+  unsigned long size = 0;
+
+  for(long i = 0; i <= chunkCount; i++) {
+    int n = 0;
+    if(i < chunkCount) {
+      n = readData(header, headerPos, &in[0], in.size());
+      if(n <= 0) {
+        setError("Unexpected end of the entries");
+        return false;
+      }
+      crc = crc32(crc, (const Bytef *) &in[0], n);
+      size += n;
+    }
+
+    // The last (empty) deflate block is not a part of any chunk
+    zstream.next_in = (Bytef *) &in[0];
+    zstream.avail_in = n;
+    zstream.next_out = (Bytef *) &out[0];
+    zstream.avail_out = out.size();
+    int rc = deflate(&zstream, i < chunkCount ? Z_FULL_FLUSH : Z_FINISH);
+    if((rc != Z_OK && rc != Z_STREAM_END) || zstream.avail_in != 0) {
+      setError("Compression failed");
+      return false;
+    }
+
+    int length = out.size() - zstream.avail_out;
+    if(i < chunkCount) {
+      if(length > 0xffff) {
+        setError("Compressed chunk too large");
+        return false;
+      }
+      putShort(&head[22 + 2 * i], length);
+    }
+
+    if(::write(fd, &out[0], length) != length) {
+      setError(strerror(errno));
+      return false;
+    }
+  }
+
+  unsigned char trailer[8];
+  putLong(trailer, crc);
+  putLong(trailer + 4, size & 0xffffffffUL);
+  if(::write(fd, trailer, sizeof(trailer)) != sizeof(trailer) ||
+     pwrite(fd, &head[22], 2 * chunkCount, start + 22) != 2 * chunkCount) {
+    setError(strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+bool DictionaryWriter::write(const char *fileName, bool dictzip)
+{
+  if(spool == nullptr || !errorDescr.empty())
+    return false;
+
+  if(fflush(spool) != 0 || fseek(spool, 0, SEEK_SET) != 0) {
+    setError(strerror(errno));
+    return false;
+  }
+
+  int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if(fd < 0) {
+    setError(strerror(errno));
+    return false;
+  }
+
+  std::string header = makeHeader();
+  bool ok = dictzip ? writeDictZip(fd, header) : writePlain(fd, header);
+
+  if(fsync(fd) != 0 && ok) {
+    setError(strerror(errno));
+    ok = false;
+  }
+  close(fd);
+
+  if(!ok)
+    unlink(fileName);
+
+  return ok;
+}
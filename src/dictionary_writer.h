@@ -0,0 +1,103 @@
+/**
+ * @file   dictionary_writer.h
+ * @brief  Write a bedic dictionary, optionally dictzip compressed
+ * @author Lyndon Hill and others
+ */
+
+#pragma once
+#ifndef DICTIONARY_WRITER_H
+#define DICTIONARY_WRITER_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+
+extern "C" {
+#include <zlib.h>
+}
+
+#include "block_checksums.h"
+
+/**
+ * @class DictionaryWriter
+ *
+ * Writes a dictionary from entries added in dictionary order. The index,
+ * ordinal-index, block-checksums and the other properties set by xerox
+ * are computed on the way. The header (with the index) precedes the entries, so the
+ * entries are spooled to a temporary file until write() is called.
+ */
+class DictionaryWriter
+{
+public:
+  DictionaryWriter();
+  ~DictionaryWriter();
+
+  /// Sets a header property; the properties computed by the writer are replaced
+  void setProperty(const std::string &name, const std::string &value)
+  {
+    properties[name] = value;
+  }
+
+  /// Appends an entry, the entries must be added sorted
+  bool addEntry(const char *keyword, size_t keywordLength, const char *description,
+                size_t descriptionLength);
+
+  /// Writes the dictionary to fileName, dictzip compressed or not
+  bool write(const char *fileName, bool dictzip);
+
+  /// Sets the chunks in a dictzip member, to test files of several members
+  void setMemberChunks(long chunks)
+  {
+    memberChunks = chunks > 0 && chunks < MEMBER_CHUNKS ? chunks : MEMBER_CHUNKS;
+  }
+
+  const std::string &getError() const
+  {
+    return errorDescr;
+  }
+
+  /// Length of uncompressed data in a dictzip chunk
+  static const int CHUNK_LENGTH = 58315;
+
+  /// Chunks in a dictzip member, limited by the 16 bit length of the extra field
+  static const int MEMBER_CHUNKS = (0xffff - 10) / 2;
+
+protected:
+  std::map<std::string, std::string> properties;
+  std::string errorDescr;
+
+  FILE *spool;       ///< The entries
+  off_t dataSize;    ///< Size of the entries
+
+  std::string index;
+  std::string ordinalIndex;
+  off_t lastIndexOffset;
+  size_t lastIndexStart;   ///< Start of the last pair in index
+  off_t lastEntryOffset;
+  long entries;
+  size_t maxWordLength;
+  size_t maxEntryLength;
+  long memberChunks;
+  BlockChecksums checksums;
+
+  std::string makeHeader();
+  bool writePlain(int fd, const std::string &header);
+  bool writeDictZip(int fd, const std::string &header);
+
+  /// Writes a dictzip member of chunkCount chunks, the last may be shorter
+  bool writeMember(int fd, const std::string &header, size_t &headerPos, long chunkCount,
+                   z_stream &zstream);
+
+  /// Reads up to len bytes of the header followed by the entries
+  int readData(const std::string &header, size_t &headerPos, char *buf, int len);
+
+  void setError(const std::string &error)
+  {
+    if(errorDescr.empty())
+      errorDescr = error;
+  }
+};
+
+#endif  /* DICTIONARY_WRITER_H */
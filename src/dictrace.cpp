@@ -0,0 +1,174 @@
+/**
+ * @file   dictrace.cpp
+ * @brief  Traces lookups and writes the spans in the Chrome trace-event
+ *         format, to be opened in chrome://tracing or Perfetto
+ * @author Lyndon Hill and others
+ *
+ * The words are given with --word, or read from the standard input one
+ * per line. With several dictionaries the lookups go through a
+ * MultiDictionary, so the spans of its threads are traced too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bedic.h"
+#include "multi_dictionary.h"
+#include "trace.h"
+
+#define PROG_NAME "dictrace"
+
+static void printHelp()
+{
+  std::cerr << "Usage: " PROG_NAME " [--output file.json] [--buffer spans] [--format] "
+            << "[--word word]... dicfile...\n"
+            << "Looks up the words (read from stdin if none is given) and writes a Chrome trace\n"
+            << "to the output file (default trace.json)\n";
+}
+
+static void writeJsonString(FILE *fh, const char *s)
+{
+  fputc('"', fh);
+  for(; *s != 0; s++) {
+    if(*s == '"' || *s == '\\')
+      fprintf(fh, "\\%c", *s);
+    else if((unsigned char) *s < 0x20)
+      fprintf(fh, "\\u%04x", *s);
+    else
+      fputc(*s, fh);
+  }
+  fputc('"', fh);
+}
+
+/// Writes the spans as complete ("X") events, times in microseconds from the first span
+static void writeChromeTrace(FILE *fh, const std::vector<TraceSpan> &spans)
+{
+  unsigned long long origin = spans.empty() ? 0 : spans[0].start;
+  for(unsigned int i = 0; i < spans.size(); i++)
+    if(spans[i].start < origin) origin = spans[i].start;
+
+  fprintf(fh, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for(unsigned int i = 0; i < spans.size(); i++) {
+    const TraceSpan &span = spans[i];
+    fprintf(fh, "{\"name\":");
+    writeJsonString(fh, Trace::getPhaseName(span.phase));
+    fprintf(fh, ",\"cat\":\"bedic\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,"
+            "\"args\":{\"arg\":%lld}}%s\n",
+            (span.start - origin) / 1000.0, (span.end - span.start) / 1000.0, span.thread, span.arg,
+            i + 1 < spans.size() ? "," : "");
+  }
+  fprintf(fh, "]}\n");
+}
+
+int main(int argc, char **argv)
+{
+  // Not stdout, loadDictionary prints to it
+  const char *output = "trace.json";
+  size_t bufferSize = 1 << 20;
+  bool format = false;
+  std::vector<std::string> words;
+
+  static struct option cmdLineOptions[] = {
+    { "help", no_argument, nullptr, 'e' },
+    { "output", required_argument, nullptr, 'o' },
+    { "buffer", required_argument, nullptr, 'b' },
+    { "format", no_argument, nullptr, 'f' },
+    { "word", required_argument, nullptr, 'w' },
+    { nullptr, 0, nullptr, 0 }
+  };
+
+  int optionIndex = 0;
+  while(1) {
+    int c = getopt_long(argc, argv, "o:b:fw:", cmdLineOptions, &optionIndex);
+    if(c == -1) break;
+
+    switch(c) {
+    case 'o':
+      output = optarg;
+      break;
+    case 'b':
+      bufferSize = strtoul(optarg, nullptr, 10);
+      break;
+    case 'f':
+      format = true;
+      break;
+    case 'w':
+      words.push_back(optarg);
+      break;
+    default:
+      printHelp();
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<const char *> fileNames(argv + optind, argv + argc);
+  if(fileNames.empty() || bufferSize == 0) {
+    printHelp();
+    return EXIT_FAILURE;
+  }
+
+  if(words.empty()) {
+    char line[1024];
+    while(fgets(line, sizeof(line), stdin) != nullptr) {
+      line[strcspn(line, "\r\n")] = 0;
+      if(line[0] != 0) words.push_back(line);
+    }
+  }
+
+  std::string errorMessage;
+  std::vector<StaticDictionary *> dictionaries;
+  for(unsigned int i = 0; i < fileNames.size(); i++) {
+    StaticDictionary *dic = StaticDictionary::loadDictionary(fileNames[i], false, errorMessage);
+    if(dic == nullptr) {
+      std::cerr << PROG_NAME ": " << fileNames[i] << ": " << errorMessage << "\n";
+      return EXIT_FAILURE;
+    }
+    dictionaries.push_back(dic);
+  }
+
+  StaticDictionary *dic = dictionaries[0];
+  if(dictionaries.size() > 1) {
+    dic = createMultiDictionary(dictionaries, dictionaries.size(), errorMessage);
+    if(dic == nullptr) {
+      std::cerr << PROG_NAME ": " << errorMessage << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Only the lookups are traced, not the loading
+  Trace::setBufferSize(bufferSize);
+  for(unsigned int i = 0; i < words.size(); i++) {
+    bool matches;
+    DictionaryIteratorHandle it = dic->findEntryHandle(words[i].c_str(), matches);
+    // at the end there is no description
+    const char *sense = it.isValid() ? it->getDescription() : nullptr;
+    if(sense == nullptr) continue;
+
+    std::string description = sense;
+    if(format)
+      formatDicEntry(description);
+  }
+
+  std::vector<TraceSpan> spans;
+  size_t lost = Trace::collectSpans(spans);
+  Trace::setBufferSize(0);
+  if(lost != 0)
+    std::cerr << PROG_NAME ": " << lost << " spans lost, increase --buffer\n";
+
+  FILE *fh = fopen(output, "w");
+  if(fh == nullptr) {
+    perror(output);
+    return EXIT_FAILURE;
+  }
+  writeChromeTrace(fh, spans);
+  fclose(fh);
+
+  delete dic;
+  return EXIT_SUCCESS;
+}
@@ -29,6 +29,7 @@
 
 #include "bedic.h"
 #include "dictionary_impl.h"    // Collation
+#include "lookup_cache.h"
 
 #include "utf8.h"
 
@@ -39,7 +40,8 @@ static int compare_callback(void *collationPtr, int len1, const void *s1, int le
 
 enum StmtID { S_GET_PROPERTY = 0, S_SET_PROPERTY, S_INSERT_ENTRY, S_FIND_NEXT,
               S_UPDATE_ENTRY, S_REMOVE_ENTRY, S_GET_DESCRIPTION, S_FIND_NEXT_OR_SAME,
-              S_COUNT };
+              S_FIND_PREVIOUS, S_FIND_LAST, S_ENTRY_COUNT, S_RANK, S_SEEK_ORDINAL,
+              S_ADD_TOMBSTONE, S_REMOVE_TOMBSTONE, S_LIST_TOMBSTONES, S_COUNT };
 
 
 class SQLiteDictionaryIterator;
@@ -49,6 +51,9 @@ class SQLiteDictionary : public DynamicDictionary
   friend DynamicDictionary *createSQLiteDictionary(const char *fileName, const char *name,
                                                    std::string &errorMessage);
   friend DynamicDictionary *loadSQLiteDictionary(const char *fileName, std::string &errorMessage);
+  friend bool clearSQLiteDictionary(const char *fileName, std::string &errorMessage);
+  friend bool getSQLiteTombstones(DynamicDictionary *dic, std::vector<std::string> &keywords);
+  friend bool setSQLiteTombstone(DynamicDictionary *dic, const char *keyword, bool removed);
   friend class SQLiteDictionaryIterator;
 
   std::string name, fileName, errorString;
@@ -61,6 +66,29 @@ class SQLiteDictionary : public DynamicDictionary
 
   CollationComparator collationComparator;
 
+  bool hasTombstones;   ///< Whether the tombstones table exists
+
+  /// Result of findEntry: the first keyword not smaller and its description
+  struct CachedLookup
+  {
+    std::string keyword;
+    std::string description;
+    bool atEnd;
+  };
+
+  LookupCache<CachedLookup> lookupCache;
+
+#ifdef BEDIC_STATS
+  StatCounters stats;
+#endif
+
+  /// sqlite3_step, counted in the stats
+  int step(sqlite3_stmt *stmt)
+  {
+    BEDIC_STAT(stats.sqliteSteps, 1);
+    return sqlite3_step(stmt);
+  }
+
 protected:
   /**
    * Constructor
@@ -74,7 +102,23 @@ protected:
    */
   bool bind();
 
-  bool findNext(const char *keyword, std::string &next, bool or_same);
+  /**
+   * Finds the keyword following (or equal to, if or_same) keyword.
+   * Past the last entry, next is set to the terminal keyword and atEnd to true.
+   */
+  bool findNext(const char *keyword, std::string &next, bool or_same, bool &atEnd);
+
+  /**
+   * Finds the keyword preceding keyword, or the last keyword if keyword is
+   * null. found is set to false if there is no such keyword.
+   */
+  bool findPrevious(const char *keyword, std::string &previous, bool &found);
+
+  /// Runs a count query, keyword is bound to ?1 if not null, -1 if error
+  long count(StmtID stmt_id, const char *keyword);
+
+  /// Applies the collation properties and reorders the entries
+  bool updateCollation();
 
 public:
   ~SQLiteDictionary();
@@ -84,6 +128,15 @@ public:
 
   virtual DictionaryIteratorPtr findEntry(const char *keyword, bool &matches);
 
+  virtual DictionaryIteratorHandle beginHandle();
+  virtual DictionaryIteratorHandle endHandle();
+
+  virtual DictionaryIteratorHandle findEntryHandle(const char *keyword, bool &matches);
+
+  virtual long getEntryCount();
+  virtual DictionaryIteratorPtr seekOrdinal(long n);
+  virtual long rankOf(const char *keyword);
+
   virtual CollationComparator   *getCollationComparator()
   {
     return &collationComparator;
@@ -97,6 +150,20 @@ public:
 
   virtual const char *getErrorMessage();  
 
+  virtual void setCacheSize(size_t entries)
+  {
+    lookupCache.setCapacity(entries);
+  }
+
+  virtual bool getCacheStats(LookupCacheStats &stats)
+  {
+    lookupCache.getStats(stats);
+    return true;
+  }
+
+  virtual bool getStats(DictionaryStats &result);
+  virtual void resetStats();
+
   virtual bool isMetaEditable()
   {
     return true;
@@ -113,15 +180,23 @@ class SQLiteDictionaryIterator : public DictionaryIterator
 {
   SQLiteDictionary *dic;
   std::string keyword, description;
+  bool isEnd;
 
 public:
-  SQLiteDictionaryIterator(SQLiteDictionary *dic, const char *kword) : dic(dic),
-                                                                       keyword(kword)
+  SQLiteDictionaryIterator(SQLiteDictionary *dic, const char *kword, bool isEnd = false) :
+                                        dic(dic), keyword(kword), isEnd(isEnd)
+  {
+  }
+
+  SQLiteDictionaryIterator(SQLiteDictionary *dic, const std::string &kword,
+                           const std::string &description, bool isEnd) :
+                           dic(dic), keyword(kword), description(description), isEnd(isEnd)
   {
   }
 
-  ~SQLiteDictionaryIterator()
+  bool atEnd()
   {
+    return isEnd;
   }
 
   const char *getKeyword()
@@ -134,6 +209,8 @@ public:
     if(!description.empty()) 
       return description.c_str();
 
+    if(isEnd) return nullptr;
+
     sqlite3 *db = dic->getDB();
     if(db == nullptr) return nullptr;
 
@@ -142,11 +219,15 @@ public:
 
     sqlite3_bind_text(stmt, 1, keyword.c_str(), keyword.size(), SQLITE_TRANSIENT);
 
-    int rc = sqlite3_step(stmt);
+    int rc = dic->step(stmt);
     if(rc == SQLITE_ROW)
     {
+      // The statement is shared, so the column is copied (reusing the buffer)
       const char *str = (const char *)sqlite3_column_text(stmt, 0);
-      description = str != nullptr ? str : "";
+      if(str != nullptr)
+        description.assign(str, sqlite3_column_bytes(stmt, 0));
+      else
+        description.clear();
     }
     else
     {
@@ -160,27 +241,50 @@ public:
     return description.c_str();
   }
 
+  virtual StringRef getKeywordRef()
+  {
+    return StringRef(keyword.data(), keyword.size());
+  }
+
+  virtual StringRef getDescriptionRef()
+  {
+    const char *s = getDescription();
+    if(s == nullptr) return StringRef();
+
+    return StringRef(description.data(), description.size());
+  }
+
   bool nextEntry()
   {
-    std::string next;
-    if(!dic->findNext(keyword.c_str(), next, false))
+    if(isEnd)
       return false;
 
-    keyword = next;
-    description = "";
+    // findNext copies the bound keyword, so it can write straight into it
+    if(!dic->findNext(keyword.c_str(), keyword, false, isEnd))
+      return false;
+
+    description.clear();
 
     return true;
   }
 
   bool previousEntry()
   {
-    return false;
+    bool found;
+    if(!dic->findPrevious(isEnd ? nullptr : keyword.c_str(), keyword, found) || !found)
+      return false;
+
+    isEnd = false;
+    description.clear();
+
+    return true;
   }
 };
 
 
 // Constructor
-SQLiteDictionary::SQLiteDictionary(const char *fname) : fileName(fname), _db(nullptr)
+SQLiteDictionary::SQLiteDictionary(const char *fname) : fileName(fname), _db(nullptr),
+                                                        hasTombstones(false)
 {
   memset(statement, 0, sizeof(sqlite3_stmt*)*S_COUNT);
 }
@@ -224,7 +328,23 @@ static const char *statement_sql[S_COUNT] = {
   //S_GET_DESCRIPTION
   "select description from entries where keyword=?1",
   //S_FIND_NEXT_OR_SAME
-  "select keyword from entries where keyword >= ?1 limit 1"
+  "select keyword from entries where keyword >= ?1 limit 1",
+  //S_FIND_PREVIOUS
+  "select keyword from entries where keyword < ?1 order by keyword desc limit 1",
+  //S_FIND_LAST
+  "select keyword from entries order by keyword desc limit 1",
+  //S_ENTRY_COUNT
+  "select count(*) from entries",
+  //S_RANK
+  "select count(*) from entries where keyword < ?1",
+  //S_SEEK_ORDINAL
+  "select keyword from entries order by keyword limit 1 offset ?1",
+  //S_ADD_TOMBSTONE
+  "insert or replace into tombstones (keyword) values( ?1 )",
+  //S_REMOVE_TOMBSTONE
+  "delete from tombstones where keyword=?1",
+  //S_LIST_TOMBSTONES
+  "select keyword from tombstones order by keyword"
 };
 
 sqlite3_stmt *SQLiteDictionary::getStmt(StmtID stmt_id)
@@ -247,8 +367,29 @@ sqlite3_stmt *SQLiteDictionary::getStmt(StmtID stmt_id)
   }
 }
 
+const char database_schema[] = 
+"create table entries ("
+"  keyword varchar(200) PRIMARY KEY COLLATE bedic,"
+"  description varchar(1024000),"
+"  create_date int,"
+"  modif_date int );"
+""
+"create table properties ("
+"  tag varchar(200) PRIMARY KEY,"
+"  value varchar(1024000) );";
+
+// Keywords removed from the static part of a hybrid dictionary
+const char tombstones_schema[] =
+"create table if not exists tombstones ("
+"  keyword varchar(200) PRIMARY KEY COLLATE bedic );";
+
 bool SQLiteDictionary::bind()
 {
+  // Dictionaries created before tombstones were introduced lack the table,
+  // a read-only one cannot get it and has no tombstones. The schema must
+  // not change once statements have been prepared.
+  hasTombstones = sqlite3_exec(getDB(), tombstones_schema, nullptr, nullptr, nullptr) == SQLITE_OK;
+
   bool success = getProperty("id", name);
   if(!success || name.empty()) return false;
 
@@ -266,17 +407,6 @@ bool SQLiteDictionary::bind()
 
 //=============================
 
-const char database_schema[] = 
-"create table entries ("
-"  keyword varchar(200) PRIMARY KEY COLLATE bedic,"
-"  description varchar(1024000),"
-"  create_date int,"
-"  modif_date int );"
-""
-"create table properties ("
-"  tag varchar(200) PRIMARY KEY,"
-"  value varchar(1024000) );";
-
 DynamicDictionary *createSQLiteDictionary(const char *fileName, const char *name,
                                           std::string &errorMessage)
 {
@@ -308,6 +438,8 @@ DynamicDictionary *createSQLiteDictionary(const char *fileName, const char *name
   // create tables
   char *errmsg = nullptr;
   rc = sqlite3_exec(db, database_schema, nullptr, nullptr, &errmsg);
+  if(rc == SQLITE_OK)
+    rc = sqlite3_exec(db, tombstones_schema, nullptr, nullptr, &errmsg);
   if(rc != SQLITE_OK) {
     if(errmsg != nullptr) {
       errorMessage = errmsg;
@@ -385,9 +517,76 @@ DynamicDictionary *loadSQLiteDictionary(const char *fileName, std::string &error
   return dic;
 }
 
+/**
+ * Removes all entries, keeping the properties. Used when the entries
+ * have been merged into the static part of a hybrid dictionary.
+ */
+bool clearSQLiteDictionary(const char *fileName, std::string &errorMessage)
+{
+  SQLiteDictionary dic(fileName);
+  sqlite3 *db = dic.getDB();
+  if(db == nullptr) {
+    errorMessage = dic.getErrorMessage();
+    return false;
+  }
+
+  char *error = nullptr;
+  const char *sql = "begin; delete from entries; delete from tombstones; commit";
+  if(sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+    sqlite3_exec(db, "rollback", nullptr, nullptr, nullptr);
+    errorMessage = error != nullptr ? error : "Cannot clear the dictionary";
+    sqlite3_free(error);
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Lists the keywords removed from the static part of a hybrid
+ * dictionary, in dictionary order.
+ */
+bool getSQLiteTombstones(DynamicDictionary *dynamic_dic, std::vector<std::string> &keywords)
+{
+  SQLiteDictionary *dic = static_cast<SQLiteDictionary *>(dynamic_dic);
+  keywords.clear();
+  if(!dic->hasTombstones) return true;
+
+  sqlite3_stmt *stmt = dic->getStmt(S_LIST_TOMBSTONES);
+  if(stmt == nullptr) return false;
+
+  int rc;
+  while((rc = dic->step(stmt)) == SQLITE_ROW)
+    keywords.push_back((const char *) sqlite3_column_text(stmt, 0));
+
+  if(rc != SQLITE_DONE)
+    dic->errorString = sqlite3_errmsg(dic->getDB());
+  sqlite3_reset(stmt);
+
+  return rc == SQLITE_DONE;
+}
+
+/// Adds the tombstone of keyword if removed, otherwise deletes it
+bool setSQLiteTombstone(DynamicDictionary *dynamic_dic, const char *keyword, bool removed)
+{
+  SQLiteDictionary *dic = static_cast<SQLiteDictionary *>(dynamic_dic);
+  sqlite3_stmt *stmt = dic->getStmt(removed ? S_ADD_TOMBSTONE : S_REMOVE_TOMBSTONE);
+  if(stmt == nullptr) return false;
+
+  sqlite3_bind_text(stmt, 1, keyword, strlen(keyword), SQLITE_TRANSIENT);
+  if(dic->step(stmt) != SQLITE_DONE) {
+    dic->errorString = sqlite3_errmsg(dic->getDB());
+    sqlite3_reset(stmt);
+    return false;
+  }
+  sqlite3_reset(stmt);
+
+  return true;
+}
+
 //============== Search ==============
 
-bool SQLiteDictionary::findNext(const char *keyword, std::string &next, bool or_same)
+bool SQLiteDictionary::findNext(const char *keyword, std::string &next, bool or_same, bool &atEnd)
 {
   sqlite3 *db = getDB();
   if(db == nullptr) return false;
@@ -396,12 +595,14 @@ bool SQLiteDictionary::findNext(const char *keyword, std::string &next, bool or_
   if(stmt == nullptr) return false;
 
   sqlite3_bind_text(stmt, 1, keyword, strlen( keyword ), SQLITE_TRANSIENT);
-  int rc = sqlite3_step(stmt);
+  int rc = step(stmt);
 
   if(rc == SQLITE_ROW) {
-    next = (const char *)sqlite3_column_text(stmt, 0);
+    next.assign((const char *)sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0));
+    atEnd = false;
   } else if(rc == SQLITE_DONE) {
-    next = (char *)(terminal_keyword);  // FIXME do proper C++ cast
+    next = reinterpret_cast<const char *>(terminal_keyword);
+    atEnd = true;
   } else {
     errorString = std::string(sqlite3_errmsg(db));
     sqlite3_reset(stmt);
@@ -413,30 +614,193 @@ bool SQLiteDictionary::findNext(const char *keyword, std::string &next, bool or_
   return true;
 }
 
-DictionaryIteratorPtr SQLiteDictionary::begin()
+bool SQLiteDictionary::findPrevious(const char *keyword, std::string &previous, bool &found)
 {
-  std::string first;
-  if(!findNext("", first, false)) {
-    return DictionaryIteratorPtr(nullptr);
+  sqlite3 *db = getDB();
+  if(db == nullptr) return false;
+
+  sqlite3_stmt *stmt = getStmt(keyword != nullptr ? S_FIND_PREVIOUS : S_FIND_LAST);
+  if(stmt == nullptr) return false;
+
+  if(keyword != nullptr)
+    sqlite3_bind_text(stmt, 1, keyword, strlen(keyword), SQLITE_TRANSIENT);
+  int rc = step(stmt);
+
+  if(rc == SQLITE_ROW) {
+    previous.assign((const char *)sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0));
+    found = true;
+  } else if(rc == SQLITE_DONE) {
+    found = false;
+  } else {
+    errorString = std::string(sqlite3_errmsg(db));
+    sqlite3_reset(stmt);
+    return false;
   }
 
-  return DictionaryIteratorPtr(new SQLiteDictionaryIterator(this, first.c_str()));
+  sqlite3_reset(stmt);
+
+  return true;
+}
+
+DictionaryIteratorPtr SQLiteDictionary::begin()
+{
+  return beginHandle().release();
 }
 
 DictionaryIteratorPtr SQLiteDictionary::end()
 {
-  return DictionaryIteratorPtr(new SQLiteDictionaryIterator(this, (char *)(terminal_keyword)));  // FIXME do proper C++ cast
+  return endHandle().release();
 }
 
 DictionaryIteratorPtr SQLiteDictionary::findEntry(const char *keyword, bool &matches)
 {
+  return findEntryHandle(keyword, matches).release();
+}
+
+DictionaryIteratorHandle SQLiteDictionary::beginHandle()
+{
+  DictionaryIteratorHandle it;
+  std::string first;
+  bool atEnd;
+  if(findNext("", first, false, atEnd))
+    it.emplace<SQLiteDictionaryIterator>(this, first.c_str(), atEnd);
+
+  return it;
+}
+
+DictionaryIteratorHandle SQLiteDictionary::endHandle()
+{
+  DictionaryIteratorHandle it;
+  it.emplace<SQLiteDictionaryIterator>(this, reinterpret_cast<const char *>(terminal_keyword), true);
+  return it;
+}
+
+DictionaryIteratorHandle SQLiteDictionary::findEntryHandle(const char *keyword, bool &matches)
+{
+  DictionaryIteratorHandle it;
+  CanonizedWord word;
+
+  BEDIC_STAT(stats.lookups, 1);
+
+  // The keywords are compared with the collation, so equally canonized
+  // queries find the same entry
+  if(lookupCache.isEnabled()) {
+    collationComparator.canonizeWord(keyword, strlen(keyword), word);
+    const CachedLookup *cached = lookupCache.find(word);
+    if(cached != nullptr) {
+      matches = !cached->atEnd && cached->keyword == keyword;
+      it.emplace<SQLiteDictionaryIterator>(this, cached->keyword, cached->description, cached->atEnd);
+      return it;
+    }
+  }
+
   std::string result;
-  if(!findNext(keyword, result, true)) {
-    return DictionaryIteratorPtr(nullptr);
+  bool atEnd;
+  if(!findNext(keyword, result, true, atEnd))
+    return it;
+
+  matches = !atEnd && result == keyword;
+  it.emplace<SQLiteDictionaryIterator>(this, result.c_str(), atEnd);
+
+  // A lookup is nearly always followed by reading the description
+  if(lookupCache.isEnabled()) {
+    CachedLookup lookup = { result, std::string(), atEnd };
+    if(!atEnd) {
+      const char *description = it->getDescription();
+      if(description == nullptr) return DictionaryIteratorHandle();
+      lookup.description = description;
+    }
+    lookupCache.insert(word, lookup);
   }
 
-  matches = (result == keyword);
-  return DictionaryIteratorPtr(new SQLiteDictionaryIterator(this, result.c_str()));
+  return it;
+}
+
+#ifdef BEDIC_STATS
+bool SQLiteDictionary::getStats(DictionaryStats &result)
+{
+  result = DictionaryStats();
+  stats.addTo(result);
+  result.canonicalizations = collationComparator.canonicalizations.get();
+
+  LookupCacheStats cacheStats;
+  lookupCache.getStats(cacheStats);
+  result.cacheHits = cacheStats.hits;
+  result.cacheMisses = cacheStats.misses;
+
+  return true;
+}
+
+void SQLiteDictionary::resetStats()
+{
+  stats.reset();
+  collationComparator.canonicalizations.reset();
+  lookupCache.resetStats();
+}
+#else
+bool SQLiteDictionary::getStats(DictionaryStats &result)
+{
+  result = DictionaryStats();
+  return false;
+}
+
+void SQLiteDictionary::resetStats()
+{
+}
+#endif
+
+long SQLiteDictionary::count(StmtID stmt_id, const char *keyword)
+{
+  sqlite3 *db = getDB();
+  if(db == nullptr) return -1;
+
+  sqlite3_stmt *stmt = getStmt(stmt_id);
+  if(stmt == nullptr) return -1;
+
+  if(keyword != nullptr)
+    sqlite3_bind_text(stmt, 1, keyword, strlen(keyword), SQLITE_TRANSIENT);
+
+  long n = -1;
+  if(step(stmt) == SQLITE_ROW)
+    n = (long)sqlite3_column_int64(stmt, 0);
+  else
+    errorString = std::string(sqlite3_errmsg(db));
+
+  sqlite3_reset(stmt);
+
+  return n;
+}
+
+long SQLiteDictionary::getEntryCount()
+{
+  return count(S_ENTRY_COUNT, nullptr);
+}
+
+long SQLiteDictionary::rankOf(const char *keyword)
+{
+  return count(S_RANK, keyword);
+}
+
+DictionaryIteratorPtr SQLiteDictionary::seekOrdinal(long n)
+{
+  sqlite3 *db = getDB();
+  if(db == nullptr || n < 0) return DictionaryIteratorPtr(nullptr);
+
+  sqlite3_stmt *stmt = getStmt(S_SEEK_ORDINAL);
+  if(stmt == nullptr) return DictionaryIteratorPtr(nullptr);
+
+  sqlite3_bind_int64(stmt, 1, n);
+
+  DictionaryIteratorPtr it(nullptr);
+  int rc = step(stmt);
+  if(rc == SQLITE_ROW)
+    it = DictionaryIteratorPtr(new SQLiteDictionaryIterator(this, (const char *)sqlite3_column_text(stmt, 0)));
+  else if(rc != SQLITE_DONE)
+    errorString = std::string(sqlite3_errmsg(db));
+
+  sqlite3_reset(stmt);
+
+  return it;
 }
 
 //============== State ==============
@@ -468,7 +832,7 @@ bool SQLiteDictionary::getProperty(const char *propertyName, std::string &proper
   if(stmt == nullptr) return false;
   
   sqlite3_bind_text(stmt, 1, propertyName, strlen(propertyName), SQLITE_TRANSIENT);
-  if(sqlite3_step( stmt ) == SQLITE_ROW) {
+  if(step(stmt) == SQLITE_ROW) {
     propertyValue = (const char *)sqlite3_column_text(stmt, 0);
   }
   sqlite3_reset(stmt);
@@ -487,7 +851,7 @@ bool SQLiteDictionary::setProperty(const char *propertyName, const char *propert
   int rc;
   sqlite3_bind_text(stmt, 1, propertyName, strlen(propertyName), SQLITE_TRANSIENT);
   sqlite3_bind_text(stmt, 2, propertyValue, strlen(propertyValue), SQLITE_TRANSIENT);
-  rc = sqlite3_step(stmt);
+  rc = step(stmt);
   if(rc != SQLITE_DONE) {
     errorString = std::string(sqlite3_errmsg(db));
     sqlite3_reset(stmt);
@@ -495,6 +859,30 @@ bool SQLiteDictionary::setProperty(const char *propertyName, const char *propert
   }
   sqlite3_reset(stmt);
 
+  // The entries must be ordered with the collation that is used when the
+  // dictionary is loaded again
+  if(strcmp(propertyName, "collation") == 0 || strcmp(propertyName, "search-ignore-chars") == 0)
+    return updateCollation();
+
+  return true;
+}
+
+bool SQLiteDictionary::updateCollation()
+{
+  std::string collationString, ignoreChars;
+  if(!getProperty("collation", collationString) || !getProperty("search-ignore-chars", ignoreChars))
+    return false;
+
+  collationComparator.setCollation(collationString, ignoreChars);
+  lookupCache.clear();
+
+  char *error = nullptr;
+  if(sqlite3_exec(getDB(), "reindex bedic", nullptr, nullptr, &error) != SQLITE_OK) {
+    errorString = error != nullptr ? error : "Cannot reindex the dictionary";
+    sqlite3_free(error);
+    return false;
+  }
+
   return true;
 }
 
@@ -511,12 +899,13 @@ DictionaryIteratorPtr SQLiteDictionary::insertEntry(const char *keyword)
   sqlite3_bind_text(stmt, 1, keyword, strlen(keyword), SQLITE_TRANSIENT);
   int create_time = (int)time(nullptr);
   sqlite3_bind_int(stmt, 2, create_time);
-  if(sqlite3_step(stmt) != SQLITE_DONE) {
+  if(step(stmt) != SQLITE_DONE) {
     errorString = std::string(sqlite3_errmsg(db));
     sqlite3_reset(stmt);
     return DictionaryIteratorPtr(nullptr);
   }
   sqlite3_reset(stmt);
+  lookupCache.clear();
 
   return DictionaryIteratorPtr(new SQLiteDictionaryIterator(this, keyword));
 }
@@ -535,12 +924,13 @@ bool SQLiteDictionary::updateEntry(const DictionaryIteratorPtr &entry, const cha
   sqlite3_bind_text(stmt, 2, description, strlen(description), SQLITE_TRANSIENT);
   int modif_time = (int)time(nullptr);
   sqlite3_bind_int(stmt, 3, modif_time);
-  if(sqlite3_step(stmt) != SQLITE_DONE) {
+  if(step(stmt) != SQLITE_DONE) {
     errorString = std::string(sqlite3_errmsg(db));
     sqlite3_reset(stmt);
     return false;
   }
   sqlite3_reset(stmt);
+  lookupCache.clear();
 
   return true;
 }
@@ -556,12 +946,13 @@ bool SQLiteDictionary::removeEntry(const DictionaryIteratorPtr &entry)
   if(stmt == nullptr) return false;
 
   sqlite3_bind_text(stmt, 1, entry->getKeyword(), strlen(entry->getKeyword()), SQLITE_TRANSIENT);
-  if(sqlite3_step(stmt) != SQLITE_DONE) {
+  if(step(stmt) != SQLITE_DONE) {
     errorString = std::string(sqlite3_errmsg(db));
     sqlite3_reset(stmt);
     return false;
   }
   sqlite3_reset(stmt);
+  lookupCache.clear();
 
   return true;
 }
@@ -572,10 +963,10 @@ bool SQLiteDictionary::removeEntry(const DictionaryIteratorPtr &entry)
 
 static int compare_callback(void *collationPtr, int len1, const void *s1, int len2, const void *s2)
 {
-  CanonizedWord w1(15), w2(15);
+  CanonizedWord w1, w2;
   CollationComparator *comparator = static_cast<CollationComparator *>(collationPtr);
-  w1 = comparator->canonizeWord(std::string((char *)s1, len1));
-  w2 = comparator->canonizeWord(std::string((char *)s2, len2));
+  comparator->canonizeWord((const char *)s1, len1, w1);
+  comparator->canonizeWord((const char *)s2, len2, w2);
   return comparator->compare(w1, w2);
 }
 
@@ -11,7 +11,14 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
 #include "file.h"
+#include "trace.h"
 
 #define OUT_BUFFER_SIZE 8192
 
@@ -40,21 +47,75 @@ int File::close() {
   return ret;
 }
 
-int File::size() {
-  int p = lseek(fd, 0, SEEK_CUR);
-  int ret = lseek(fd, 0, SEEK_END);
+off_t File::size() {
+  off_t p = lseek(fd, 0, SEEK_CUR);
+  off_t ret = lseek(fd, 0, SEEK_END);
   lseek(fd, p, SEEK_SET);
   return ret;
 }
 
-int File::read(int offset, char* buf, int buflen) {
+int File::read(off_t offset, char* buf, int buflen) {
   lseek(fd, offset, SEEK_SET);
-  return ::read(fd, buf, buflen);
+  int n = ::read(fd, buf, buflen);
+  BEDIC_STAT(stats.readCalls, 1);
+  BEDIC_STAT(stats.readBytes, n > 0 ? n : 0);
+  return n;
+}
+
+void File::readBatch(ReadRequest *requests, int count) {
+  readRequests(fd, requests, count);
+  BEDIC_STAT(stats.readCalls, count);
+  for(int i = 0; i < count; i++) {
+    BEDIC_STAT(stats.readBytes, requests[i].result > 0 ? requests[i].result : 0);
+  }
+}
+
+void File::setSequential(bool sequential) {
+#ifdef POSIX_FADV_SEQUENTIAL
+  if(fd >= 0) {
+    posix_fadvise(fd, 0, 0, sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL);
+  }
+#endif
+}
+
+int File::getChunkCount() {
+  return 0;
+}
+
+int File::getChunkLength() {
+  return 0;
+}
+
+void File::setSharedCache(SharedCache *) {
+}
+
+void File::setChunkCacheFile(bool) {
 }
 
 
 
-DZFile::DZFile() : chunks(NULL), inbuf(NULL), outbuf(NULL)
+/**
+ * The thread inflates the chunks from next up to limit; the reader
+ * moves limit as it reads. Chunks before first, the one read last, are
+ * dropped.
+ */
+struct DZFile::Prefetch
+{
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::map<int, std::vector<char> > ready;   ///< inflated chunks, empty if error
+  int first;
+  int next;
+  int limit;
+  int inflating;                             ///< chunk being inflated, -1 if none
+  bool stop;
+
+  Prefetch() : first(0), next(0), limit(0), inflating(-1), stop(false) {}
+};
+
+DZFile::DZFile() : chunks(NULL), chunkSizes(NULL), inbuf(NULL), outbuf(NULL), prefetch(NULL),
+  sharedCache(NULL), chunkCache(NULL)
 {
   zstream.zalloc    = 0;
   zstream.zfree     = 0;
@@ -70,16 +131,17 @@ DZFile::~DZFile() {
   inflateEnd(&zstream);
 }
 
-int DZFile::open(const char *fname) {
-  int ret = File::open(fname);
-  if(ret < 0) {
-    return ret;
-  }
+/// Little endian 32 bit number
+static unsigned long getLong(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long) p[3] << 24);
+}
 
+off_t DZFile::readMember(off_t offset, off_t fileSize, std::vector<off_t> &offsets,
+                         std::vector<int> &sizes, off_t &end) {
   unsigned char buf[22];
   int flags;
 
-  if(::read(fd, buf, sizeof(buf)) != sizeof(buf)) {
+  if(pread(fd, buf, sizeof(buf), offset) != sizeof(buf)) {
     return -1;
   }
 
@@ -99,65 +161,154 @@ int DZFile::open(const char *fname) {
     return -1;
   }
 
-  chunkLen = buf[18] + (buf[19]<<8);
-  chunkCount = buf[20] + (buf[21]<<8);
-  unsigned char* tmp = new unsigned char[chunkCount * 2];
-  chunks = new int[chunkCount + 1];
-  ::read(fd, tmp, chunkCount * 2);
-  chunks[0] = 0;
-  for(int i = 0; i < chunkCount; i++) {
-    int x = tmp[i*2] | (tmp[i*2+1]<<8);
-    chunks[i+1] = chunks[i] + x;
+  int xlen = buf[10] + (buf[11]<<8);
+  int memberChunkLen = buf[18] + (buf[19]<<8);
+  int memberChunkCount = buf[20] + (buf[21]<<8);
+  if(memberChunkLen == 0 || (chunkLen != 0 && memberChunkLen != chunkLen)) {
+    return -1;
   }
-  delete[] tmp;
+  chunkLen = memberChunkLen;
 
-  // FNAME
-  if(flags & 0x08) {
-    while(::read(fd, buf, 1)) {
-      if(buf[0] == 0) {
-        break;
+  unsigned char* tmp = new unsigned char[memberChunkCount * 2];
+  bool ok = pread(fd, tmp, memberChunkCount * 2, offset + sizeof(buf)) == memberChunkCount * 2;
+
+  // FNAME and COMMENT are zero terminated
+  off_t pos = offset + 12 + xlen;
+  for(int field = 0x08; ok && field <= 0x10; field <<= 1) {
+    if(flags & field) {
+      while((ok = pread(fd, buf, 1, pos++) == 1) && buf[0] != 0) {
       }
     }
   }
 
-  // COMMENT
-  if(flags & 0x10) {
-    while(::read(fd, buf, 1)) {
-      if(buf[0] == 0) {
-        break;
+  // FHCRC
+  if(flags & 0x02) {
+    pos += 2;
+  }
+
+  for(int i = 0; ok && i < memberChunkCount; i++) {
+    int x = tmp[i*2] | (tmp[i*2+1]<<8);
+    offsets.push_back(pos);
+    sizes.push_back(x);
+    pos += x;
+  }
+  delete[] tmp;
+
+  if(!ok) {
+    return -1;
+  }
+
+  // The member ends with the trailer, which follows the chunks or, if
+  // the last chunk did not end the deflate stream, an empty final block
+  end = pos + 8;
+  if(end + 2 > fileSize || pread(fd, buf, 2, end) != 2 || buf[0] != 0x1f || buf[1] != 0x8b) {
+    unsigned char tail[64];
+    int n = pread(fd, tail, sizeof(tail), pos);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    unsigned char out[16];
+    if(n > 0 && inflateInit2(&zs, -15) == Z_OK) {
+      zs.next_in = tail;
+      zs.avail_in = n;
+      zs.next_out = out;
+      zs.avail_out = sizeof(out);
+      if(inflate(&zs, Z_FINISH) == Z_STREAM_END && zs.total_out == 0) {
+        end = pos + zs.total_in + 8;
       }
+      inflateEnd(&zs);
     }
   }
 
-  // FHCRC
-  if(flags & 0x02) {
-    ::read(fd, buf, 2);
+  if(end > fileSize) {
+    end = fileSize;
   }
 
-  // update chunk offsets
-  int cstart = lseek(fd, 0, SEEK_CUR);
-  for(int i = 0; i <= chunkCount; i++) {
-    chunks[i] += cstart;
+  if(pread(fd, buf, 4, end - 4) != 4) {
+    return -1;
+  }
+
+  return getLong(buf);
+}
+
+int DZFile::open(const char *fname) {
+  int ret = File::open(fname);
+  if(ret < 0) {
+    return ret;
   }
 
-  lseek(fd, -4, SEEK_END);
-  ::read(fd, buf, 4);
-  fsize = buf[0] | (buf[1]<<8) | (buf[2]<<16) | (buf[3]<<24);
+  off_t fileSize = File::size();
+  std::vector<off_t> offsets;
+  std::vector<int> sizes;
+  off_t offset = 0;
+  chunkLen = 0;
+  fsize = 0;
+
+  while(1) {
+    off_t end;
+    off_t memberSize = readMember(offset, fileSize, offsets, sizes, end);
+    if(memberSize < 0) {
+      return -1;
+    }
+
+    // only the last chunk of the file may be shorter
+    fsize += memberSize;
+    if(end >= fileSize) {
+      break;
+    }
 
-  inbuf  = new char[chunkLen];
+    unsigned char magic[2];
+    if(pread(fd, magic, 2, end) != 2 || magic[0] != 0x1f || magic[1] != 0x8b) {
+      // not another member, use the size in the last trailer as before
+      unsigned char buf[4];
+      if(pread(fd, buf, 4, fileSize - 4) != 4) {
+        return -1;
+      }
+      fsize += (off_t) getLong(buf) - memberSize;
+      break;
+    }
+
+    if(fsize != (off_t) offsets.size() * chunkLen) {
+      return -1;
+    }
+    offset = end;
+  }
+
+  chunkCount = offsets.size();
+  chunks = new off_t[chunkCount];
+  chunkSizes = new int[chunkCount];
+  int maxChunkSize = chunkLen;
+  for(int i = 0; i < chunkCount; i++) {
+    chunks[i] = offsets[i];
+    chunkSizes[i] = sizes[i];
+    // chunks of incompressible data grow
+    if(sizes[i] > maxChunkSize) maxChunkSize = sizes[i];
+  }
+
+  inbuf  = new char[maxChunkSize];
   outbufsize = chunkLen + chunkLen / 9 + 12;
   outbuf = new char[outbufsize];
   cchunk = -1;
+  fileName = fname;
 
   return 0;
 }
 
 int DZFile::close() {
+  stopPrefetch();
+
+  delete chunkCache;
+  chunkCache = NULL;
+
   if(chunks) {
     delete[] chunks;
     chunks = 0;
   }
 
+  if(chunkSizes) {
+    delete[] chunkSizes;
+    chunkSizes = 0;
+  }
+
   if(inbuf) {
     delete[] inbuf;
     inbuf = 0;
@@ -171,7 +322,7 @@ int DZFile::close() {
   return File::close();
 }
 
-int DZFile::size() {
+off_t DZFile::size() {
   if(fd < 0) {
     return -1;
   }
@@ -179,37 +330,80 @@ int DZFile::size() {
   return fsize;
 }
 
-int DZFile::read(int pos, char *buf, int buflen) {
+int DZFile::inflateChunk(z_stream &zs, int cp, const char *in, char *out) {
+  TraceScope scope(TRACE_INFLATE, cp);
+  BEDIC_STAT(stats.chunksInflated, 1);
+  zs.next_in = (Bytef *) in;
+  zs.avail_in = chunkSizes[cp];
+  zs.next_out = (Bytef *) out;
+  zs.avail_out = outbufsize;
+  int rc = inflate(&zs, Z_PARTIAL_FLUSH);
+  if(rc == Z_STREAM_END) {
+    // the last chunk of a member may hold the final block
+    inflateReset(&zs);
+  } else if(rc != Z_OK) {
+    return -1;
+  }
+
+  return zs.next_out - (Bytef *) out;
+}
+
+int DZFile::read(off_t pos, char *buf, int buflen) {
   if(fd < 0) {
     return -1;
   }
 
   int cp = pos / chunkLen;
-  int co = pos - cp * chunkLen;
+  int co = pos - (off_t) cp * chunkLen;
 
   int n = buflen;
   while(n>0 && cp<chunkCount) {
-    if (cchunk != cp) {
-      lseek(fd, chunks[cp], SEEK_SET);
-      ::read(fd, inbuf, chunks[cp+1] - chunks[cp]);
-      zstream.next_in = (Bytef *) inbuf;
-      zstream.avail_in = chunks[cp+1] - chunks[cp];
-      zstream.next_out = (Bytef *) outbuf;
-      zstream.avail_out = outbufsize;
-      if(inflate(&zstream, Z_PARTIAL_FLUSH) != Z_OK) {
-        return -1;
+    // the chunks in the cache file are copied from it, not inflated
+    const char *out = chunkCache != NULL ? chunkCache->getChunk(cp) : NULL;
+    int outlen;
+    if(out != NULL) {
+      BEDIC_STAT(stats.chunkHits, 1);
+      outlen = std::min<off_t>(chunkLen, fsize - (off_t) cp * chunkLen);
+    } else {
+      if(cchunk == cp) {
+        BEDIC_STAT(stats.chunkHits, 1);
+      } else if(prefetch != NULL && takePrefetched(cp)) {
+        cchunk = cp;
+      } else {
+        cchunk = -1;
+        if(sharedCache != NULL && sharedCache->loadChunk(cp, outbuf, outbuflen)) {
+          BEDIC_STAT(stats.chunkHits, 1);
+        } else {
+          lseek(fd, chunks[cp], SEEK_SET);
+          ::read(fd, inbuf, chunkSizes[cp]);
+          BEDIC_STAT(stats.readCalls, 1);
+          BEDIC_STAT(stats.readBytes, chunkSizes[cp]);
+          outbuflen = inflateChunk(zstream, cp, inbuf, outbuf);
+          if(outbuflen < 0) {
+            return -1;
+          }
+
+          if(sharedCache != NULL) {
+            sharedCache->storeChunk(cp, outbuf, outbuflen);
+          }
+        }
+
+        cchunk = cp;
+        if(chunkCache != NULL) {
+          chunkCache->storeChunk(cp, outbuf, outbuflen);
+        }
       }
 
-      cchunk = cp;
-      outbuflen = zstream.next_out - (Bytef *) outbuf;
+      out = outbuf;
+      outlen = outbuflen;
     }
 
     int len = n;
-    if(co+len > outbuflen) {
-      len = outbuflen-co;
+    if(co+len > outlen) {
+      len = outlen-co;
     }
 
-    memcpy(&buf[buflen - n], &outbuf[co], len);
+    memcpy(&buf[buflen - n], &out[co], len);
 
     co = 0;
     cp++;
@@ -218,3 +412,252 @@ int DZFile::read(int pos, char *buf, int buflen) {
 
   return buflen - n;
 }
+
+void DZFile::setSequential(bool sequential) {
+  File::setSequential(sequential);
+
+  if(!sequential) {
+    stopPrefetch();
+  } else if(prefetch == NULL && fd >= 0 && chunkCount > 1) {
+    prefetch = new Prefetch();
+    prefetch->thread = std::thread(&DZFile::prefetchChunks, this);
+  }
+}
+
+int DZFile::getChunkCount() {
+  return fd < 0 ? 0 : chunkCount;
+}
+
+int DZFile::getChunkLength() {
+  return fd < 0 ? 0 : chunkLen;
+}
+
+void DZFile::setSharedCache(SharedCache *cache) {
+  sharedCache = cache;
+}
+
+void DZFile::setChunkCacheFile(bool enable) {
+  if(fd < 0 || enable == (chunkCache != NULL)) {
+    return;
+  }
+
+  // the prefetch thread looks at the cache
+  bool sequential = prefetch != NULL;
+  stopPrefetch();
+
+  if(enable) {
+    chunkCache = ChunkCacheFile::open(fileName.c_str(), fsize, chunkCount, chunkLen);
+  } else {
+    delete chunkCache;
+    chunkCache = NULL;
+  }
+
+  if(sequential) {
+    setSequential(true);
+  }
+}
+
+void DZFile::stopPrefetch() {
+  if(prefetch == NULL) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(prefetch->mutex);
+    prefetch->stop = true;
+  }
+  prefetch->changed.notify_all();
+  prefetch->thread.join();
+
+  delete prefetch;
+  prefetch = NULL;
+}
+
+void DZFile::prefetchChunks() {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  inflateInit2(&zs, -15);
+  std::vector<char> in;
+
+  std::unique_lock<std::mutex> lock(prefetch->mutex);
+  while(!prefetch->stop) {
+    if(prefetch->next >= prefetch->limit || prefetch->next >= chunkCount) {
+      prefetch->changed.wait(lock);
+      continue;
+    }
+
+    int cp = prefetch->inflating = prefetch->next++;
+    lock.unlock();
+
+    in.resize(chunkSizes[cp]);
+    std::vector<char> out(outbufsize);
+    int n = -1;
+    const char *cached = chunkCache != NULL ? chunkCache->getChunk(cp) : NULL;
+    if(cached != NULL) {
+      BEDIC_STAT(stats.chunkHits, 1);
+      n = std::min<off_t>(chunkLen, fsize - (off_t) cp * chunkLen);
+      memcpy(&out[0], cached, n);
+    } else if(sharedCache != NULL && sharedCache->loadChunk(cp, &out[0], n)) {
+      BEDIC_STAT(stats.chunkHits, 1);
+    } else if(pread(fd, &in[0], chunkSizes[cp], chunks[cp]) == chunkSizes[cp]) {
+      BEDIC_STAT(stats.readCalls, 1);
+      BEDIC_STAT(stats.readBytes, chunkSizes[cp]);
+      n = inflateChunk(zs, cp, &in[0], &out[0]);
+      if(n > 0 && sharedCache != NULL) {
+        sharedCache->storeChunk(cp, &out[0], n);
+      }
+    }
+    out.resize(n > 0 ? n : 0);
+
+    lock.lock();
+    prefetch->inflating = -1;
+    if(cp >= prefetch->first && cp < prefetch->limit) {
+      prefetch->ready[cp].swap(out);
+    }
+    prefetch->changed.notify_all();
+  }
+
+  inflateEnd(&zs);
+}
+
+bool DZFile::takePrefetched(int cp) {
+  std::vector<char> chunk;
+  {
+    std::unique_lock<std::mutex> lock(prefetch->mutex);
+    std::map<int, std::vector<char> > &ready = prefetch->ready;
+
+    // a jump: start over from cp
+    if(ready.count(cp) == 0 && prefetch->inflating != cp) {
+      ready.clear();
+      prefetch->next = cp;
+    }
+
+    prefetch->first = cp;
+    prefetch->limit = std::min(cp + 1 + PREFETCH_CHUNKS, chunkCount);
+    ready.erase(ready.begin(), ready.lower_bound(cp));
+    prefetch->changed.notify_all();
+
+    prefetch->changed.wait(lock, [&ready, cp]() { return ready.count(cp) != 0; });
+    chunk.swap(ready[cp]);
+    ready.erase(cp);
+  }
+
+  if(chunk.empty()) {
+    return false;
+  }
+
+  memcpy(outbuf, &chunk[0], chunk.size());
+  outbuflen = chunk.size();
+  return true;
+}
+
+void DZFile::readBatch(ReadRequest *requests, int count) {
+  if(fd < 0) {
+    for(int i = 0; i < count; i++) {
+      requests[i].result = -1;
+    }
+    return;
+  }
+
+  // the chunks of all the requests, except the one already inflated and
+  // those in the cache file
+  std::vector<int> needed;
+  for(int i = 0; i < count; i++) {
+    if(requests[i].len <= 0 || requests[i].pos < 0) {
+      continue;
+    }
+
+    int last = std::min<off_t>((requests[i].pos + requests[i].len - 1) / chunkLen, chunkCount - 1);
+    for(int cp = requests[i].pos / chunkLen; cp <= last; cp++) {
+      if(cp != cchunk && (chunkCache == NULL || chunkCache->getChunk(cp) == NULL)) {
+        needed.push_back(cp);
+      }
+    }
+  }
+  std::sort(needed.begin(), needed.end());
+  needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+  // the chunks that are not in the shared cache are read
+  std::vector<std::vector<char> > data(needed.size());
+  std::vector<int> lengths(needed.size(), -1);
+  std::vector<ReadRequest> reads;
+  std::vector<size_t> readChunks;
+  for(size_t i = 0; i < needed.size(); i++) {
+    data[i].resize(std::max(chunkSizes[needed[i]], outbufsize));
+    if(sharedCache != NULL && sharedCache->loadChunk(needed[i], &data[i][0], lengths[i])) {
+      BEDIC_STAT(stats.chunkHits, 1);
+      continue;
+    }
+
+    ReadRequest read = { chunks[needed[i]], &data[i][0], chunkSizes[needed[i]], 0 };
+    reads.push_back(read);
+    readChunks.push_back(i);
+  }
+  if(!reads.empty()) {
+    File::readBatch(&reads[0], reads.size());
+  }
+
+  // inflated in place of the compressed data, which is copied to inbuf
+  for(size_t r = 0; r < reads.size(); r++) {
+    size_t i = readChunks[r];
+    if(reads[r].result == chunkSizes[needed[i]]) {
+      memcpy(inbuf, &data[i][0], reads[r].result);
+      lengths[i] = inflateChunk(zstream, needed[i], inbuf, &data[i][0]);
+      if(lengths[i] > 0 && sharedCache != NULL) {
+        sharedCache->storeChunk(needed[i], &data[i][0], lengths[i]);
+      }
+    }
+  }
+
+  for(size_t i = 0; chunkCache != NULL && i < needed.size(); i++) {
+    if(lengths[i] > 0) {
+      chunkCache->storeChunk(needed[i], &data[i][0], lengths[i]);
+    }
+  }
+
+  for(int i = 0; i < count; i++) {
+    ReadRequest &request = requests[i];
+    request.result = 0;
+    if(request.len <= 0 || request.pos < 0) {
+      continue;
+    }
+
+    int cp = request.pos / chunkLen;
+    int co = request.pos - (off_t) cp * chunkLen;
+    int n = request.len;
+    while(n > 0 && cp < chunkCount) {
+      const char *out = chunkCache != NULL ? chunkCache->getChunk(cp) : NULL;
+      int outlen;
+      if(out != NULL) {
+        BEDIC_STAT(stats.chunkHits, 1);
+        outlen = std::min<off_t>(chunkLen, fsize - (off_t) cp * chunkLen);
+      } else if(cp == cchunk) {
+        BEDIC_STAT(stats.chunkHits, 1);
+        out = outbuf;
+        outlen = outbuflen;
+      } else {
+        size_t k = std::lower_bound(needed.begin(), needed.end(), cp) - needed.begin();
+        out = &data[k][0];
+        outlen = lengths[k];
+      }
+
+      if(outlen < 0) {
+        request.result = -1;
+        break;
+      } else if(co >= outlen) {
+        break;
+      }
+
+      int len = std::min(n, outlen - co);
+      memcpy(&request.buf[request.len - n], &out[co], len);
+
+      co = 0;
+      cp++;
+      n -= len;
+    }
+
+    if(request.result == 0) {
+      request.result = request.len - n;
+    }
+  }
+}
@@ -8,10 +8,20 @@
 #ifndef FILE_H
 #define FILE_H
 
+#include <sys/types.h>
+
 extern "C" {
 #include <zlib.h>
 }
 
+#include <string>
+#include <vector>
+
+#include "async_reader.h"
+#include "chunk_cache_file.h"
+#include "shared_cache.h"
+#include "stats.h"
+
 /**
  * @class File
  */
@@ -25,12 +35,54 @@ public:
 
   virtual int open(const char *fname);
   virtual int close();
-  virtual int size();
-  virtual int read(int pos, char *buf, int buflen);
+  virtual off_t size();
+  virtual int read(off_t pos, char *buf, int buflen);
+
+  /**
+   * Reads all the requests at once, see readRequests. Sets the result of
+   * every request like read does; returns when all are done.
+   */
+  virtual void readBatch(ReadRequest *requests, int count);
+
+  /**
+   * Tells the kernel whether the file will be read from start to end
+   * (posix_fadvise), so that it reads ahead more
+   */
+  virtual void setSequential(bool sequential);
+
+  /// Chunks of a dictzip file, 0 for a plain file
+  virtual int getChunkCount();
+
+  /// Length of an inflated chunk, 0 for a plain file
+  virtual int getChunkLength();
+
+  /**
+   * Inflated chunks are looked up in the cache before they are read and
+   * stored in it after; the cache is not owned. Set it before
+   * setSequential. Plain files ignore it.
+   */
+  virtual void setSharedCache(SharedCache *cache);
+
+  /**
+   * Keeps the inflated chunks of a dictzip file in a ChunkCacheFile, so
+   * that they are inflated once; does nothing for a plain file or if
+   * the cache file cannot be written
+   */
+  virtual void setChunkCacheFile(bool enable);
+
+#ifdef BEDIC_STATS
+  /// Reads and, for dictzip files, inflated chunks
+  StatCounters stats;
+#endif
 };
 
 /**
  * @class DZFile
+ *
+ * A dictzip file: a gzip member whose RA extra field lists the
+ * compressed size of every chunk. The chunk count is 16 bit, so larger
+ * files are made of several members; they must all have the same chunk
+ * length and only the last chunk of the file may be shorter.
  */
 class DZFile : public File {
 public:
@@ -39,20 +91,82 @@ public:
 
   virtual int open(const char *fname) override;
   virtual int close() override;
-  virtual int size() override;
-  virtual int read(int pos, char *buf, int buflen) override;
+  virtual off_t size() override;
+  virtual int read(off_t pos, char *buf, int buflen) override;
+
+  /// Reads the compressed chunks of all the requests at once
+  virtual void readBatch(ReadRequest *requests, int count) override;
+
+  /**
+   * Also starts (or stops) a thread that inflates the PREFETCH_CHUNKS
+   * chunks that follow the one read last, so that a scan of the file
+   * inflates in parallel with its reader
+   */
+  virtual void setSequential(bool sequential) override;
+
+  virtual int getChunkCount() override;
+  virtual int getChunkLength() override;
+  virtual void setSharedCache(SharedCache *cache) override;
+  virtual void setChunkCacheFile(bool enable) override;
+
+  /// Chunks inflated ahead in sequential mode
+  static const int PREFETCH_CHUNKS = 8;
 
 protected:
   z_stream zstream;
-  int   fsize;
+  off_t fsize;
   int   chunkLen;
-  int   chunkCount;
-  int  *chunks;
+  int   chunkCount;  ///< chunks of all the members
+  off_t *chunks;     ///< offset of every chunk in the file
+  int  *chunkSizes;  ///< compressed size of every chunk
   char *inbuf;
   int   outbuflen;
   int   outbufsize;
   char *outbuf;
   int   cchunk;      ///< current chunk
+
+  /// The prefetch thread and the chunks it inflated, see setSequential
+  struct Prefetch;
+  Prefetch *prefetch;
+
+  /// See setSharedCache, null if none
+  SharedCache *sharedCache;
+
+  /// See setChunkCacheFile, null if disabled
+  ChunkCacheFile *chunkCache;
+  std::string fileName;
+
+  /**
+   * Reads the header of the member at offset and finds its end
+   *
+   * @param offsets   the offsets of its chunks are appended
+   * @param sizes     the compressed sizes of its chunks are appended
+   * @param end       set to the offset following the member
+   * @return  uncompressed size of the member, or -1 if error
+   */
+  off_t readMember(off_t offset, off_t fileSize, std::vector<off_t> &offsets, std::vector<int> &sizes,
+                   off_t &end);
+
+  /**
+   * Inflates chunk cp, whose compressed data is in in, into out (of
+   * outbufsize bytes) with zs
+   *
+   * @return  length of the inflated chunk, or -1 if error
+   */
+  int inflateChunk(z_stream &zs, int cp, const char *in, char *out);
+
+  /// Body of the prefetch thread
+  void prefetchChunks();
+
+  /**
+   * Moves chunk cp, inflated by the prefetch thread, to outbuf; waits
+   * for it if it is being inflated and asks for the following chunks
+   *
+   * @return  false if the chunk could not be inflated
+   */
+  bool takePrefetched(int cp);
+
+  void stopPrefetch();
 };
 
 #endif  /* FILE_H */
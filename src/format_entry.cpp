@@ -26,6 +26,8 @@
 #include <sstream>
 #include <iostream>
 
+#include "trace.h"
+
 /**
  * Create an indented string
  * @param out            Output string stream
@@ -52,6 +54,7 @@ bool isFormatted(const std::string &text, int pos);
  */
 std::string formatDicEntry(std::string entry)
 {
+  TraceScope scope(TRACE_FORMAT, entry.size());
   std::ostringstream out;
   bool firstSubstr = true;
 
@@ -20,11 +20,97 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <set>
+
 #include "bedic.h"
 #include "dictionary_impl.h"
+#include "dictionary_writer.h"
 
 class HybridDictionaryIterator;
 
+bool getSQLiteTombstones(DynamicDictionary *dic, std::vector<std::string> &keywords);
+bool setSQLiteTombstone(DynamicDictionary *dic, const char *keyword, bool removed);
+
+/**
+ * Bloom filter of canonized keywords. Canonized words compare equal only
+ * if they are identical, so equal keywords always hash the same.
+ */
+class KeywordFilter
+{
+  std::vector<unsigned long long> bits;
+  unsigned long long mask;
+  size_t keys, capacity;
+
+  static const int HASHES = 4;
+  static const int BITS_PER_KEY = 16;
+
+  static unsigned long long hash(const CanonizedWord &word)
+  {
+    // FNV-1a over the units
+    unsigned long long h = 14695981039346656037ULL;
+    for(unsigned int i = 0; i < word.size(); i++) {
+      h ^= word[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+public:
+  KeywordFilter() : mask(0), keys(0), capacity(0)
+  {
+  }
+
+  /// Empties the filter and sizes it for the expected number of keys
+  void reset(size_t expected)
+  {
+    size_t n = 4096;
+    while(n < expected * BITS_PER_KEY)
+      n *= 2;
+
+    bits.assign(n / 64, 0);
+    mask = n - 1;
+    keys = 0;
+    capacity = n / BITS_PER_KEY;
+  }
+
+  void add(const CanonizedWord &word)
+  {
+    unsigned long long h = hash(word);
+    unsigned long long step = (h >> 32) | 1;
+    for(int i = 0; i < HASHES; i++, h += step)
+      bits[(h & mask) / 64] |= 1ULL << (h & 63);
+    keys++;
+  }
+
+  bool mayContain(const CanonizedWord &word) const
+  {
+    unsigned long long h = hash(word);
+    unsigned long long step = (h >> 32) | 1;
+    for(int i = 0; i < HASHES; i++, h += step)
+      if((bits[(h & mask) / 64] & (1ULL << (h & 63))) == 0)
+        return false;
+    return true;
+  }
+
+  /// Number of keys added since the last reset, removed ones included
+  size_t size() const
+  {
+    return keys;
+  }
+
+  /// Whether more keys were added than the filter was sized for
+  bool isFull() const
+  {
+    return keys > capacity;
+  }
+};
+
 /**
  * Hybrid dictionary consists of a large static (bedic) dictionary
  * and a small dynamic (sqlite) dictionary, which are searched
@@ -43,6 +129,61 @@ protected:
   StaticDictionary  *static_dic;
   DynamicDictionary *dynamic_dic;
 
+  /// An entry of the dynamic dictionary that is not in the static one
+  struct AddedEntry
+  {
+    CanonizedWord word;
+    std::string keyword;
+    long rank;               ///< number of static entries before it
+  };
+
+  /**
+   * What the overlay changes in the ordinals of the static dictionary:
+   * the added entries and the static ranks of the removed ones, both in
+   * order. They are built on the first ordinal call and kept up to date
+   * by the edits.
+   */
+  std::vector<AddedEntry> addedEntries;
+  std::vector<long> removedRanks;
+  bool ordinalsValid;
+
+  bool loadOrdinals();
+  void updateOrdinals(const char *keyword);
+
+  /// Number of added entries before word
+  size_t addedBefore(const CanonizedWord &word);
+
+  /// Number of removed entries before the static entry of rank n
+  long removedBefore(long n) const;
+
+  /// Ordinal of the i-th added entry
+  long addedOrdinal(size_t i) const;
+
+  /**
+   * Filter of the keywords in the dynamic dictionary. It is built on the
+   * first lookup and rebuilt when it gets full or when most of its
+   * keywords have been removed.
+   */
+  KeywordFilter overlayFilter;
+  bool overlayFilterValid;
+  size_t overlayRemoved;
+
+  /// False if the keyword is certainly not in the dynamic dictionary
+  bool mayBeInOverlay(const char *keyword);
+  void addToOverlay(const char *keyword);
+
+  /**
+   * Canonized keywords of the static entries that have been removed. They
+   * are stored in the dynamic dictionary and kept here for the iterators.
+   */
+  std::set<CanonizedWord> tombstones;
+
+  bool loadTombstones();
+  bool isRemoved(const char *keyword);
+
+  /// Removes the tombstone of a keyword that is inserted again
+  bool restoreEntry(const char *keyword);
+
   explicit HybridDictionary(const char *fileName);
   HybridDictionary(StaticDictionary *static_dic, DynamicDictionary *dynamic_dic);
 
@@ -54,6 +195,15 @@ public:
 
   virtual DictionaryIteratorPtr findEntry(const char *keyword, bool &matches);
 
+  virtual DictionaryIteratorHandle beginHandle();
+  virtual DictionaryIteratorHandle endHandle();
+
+  virtual DictionaryIteratorHandle findEntryHandle(const char *keyword, bool &matches);
+
+  virtual long getEntryCount();
+  virtual DictionaryIteratorPtr seekOrdinal(long n);
+  virtual long rankOf(const char *keyword);
+
   virtual const char *getName();
   virtual const char *getFileName();
 
@@ -62,6 +212,21 @@ public:
 
   virtual const char *getErrorMessage();
 
+  /// The static and the dynamic dictionary have separate caches
+  virtual void setCacheSize(size_t entries);
+  virtual bool getCacheStats(LookupCacheStats &stats);
+  virtual bool getStats(DictionaryStats &stats);
+  virtual void resetStats();
+
+  /// The dynamic dictionary is small and read by sqlite
+  virtual void setSequentialAccess(bool sequential);
+
+  /// The static dictionary is the dictzip file
+  virtual void setChunkCacheFile(bool enable);
+
+  /// Only the static dictionary has checksums
+  virtual bool verifyChecksums(int threads);
+
   virtual bool isMetaEditable()
   {
     return false;
@@ -73,7 +238,7 @@ public:
   /// Updates an entry to the dynamic dictionary, creates it if it doesn't exist
   bool updateEntry(const DictionaryIteratorPtr &entry, const char *description);
 
-  /// Removes the entry from the dynamic dictionary
+  /// Removes the entry from the dynamic dictionary, a static entry gets a tombstone
   bool removeEntry(const DictionaryIteratorPtr &entry);
 };
 
@@ -81,56 +246,148 @@ public:
 
 class HybridDictionaryIterator : public DictionaryIterator
 {
-  DictionaryIterator *static_it, *dynamic_it;
+  // Held by value, so the sub-iterators usually live inline in the handles
+  DictionaryIteratorHandle static_it, dynamic_it;
   CollationComparator* cmp;
+  const std::set<CanonizedWord> *tombstones;
+
+  // If the keyword is known not to be in the dynamic dictionary, that side
+  // is only searched once the iterator moves
+  DynamicDictionary *dynamic_dic;
+  std::string pendingKeyword;
+
+  void seekDynamic()
+  {
+    if(dynamic_it.isValid()) return;
+
+    bool matches;
+    dynamic_it = dynamic_dic->findEntryHandle(pendingKeyword.c_str(), matches);
+    word_d_valid = false;
+    order = NoOrder;
+  }
 
   enum { NoOrder = 0, StaticFirst, DynamicFirst, BothSame } order;
 
+  // Canonized keyword of each side, refreshed only after that side moves
+  CanonizedWord word_s, word_d;
+  bool word_s_valid, word_d_valid;
+
+  void canonizeStatic()
+  {
+    if(!word_s_valid) {
+      StringRef keyword = static_it->getKeywordRef();
+      cmp->canonizeWord(keyword.data, keyword.size, word_s);
+      word_s_valid = true;
+    }
+  }
+
+  int compareSides()
+  {
+    canonizeStatic();
+    if(!word_d_valid) {
+      StringRef keyword = dynamic_it->getKeywordRef();
+      cmp->canonizeWord(keyword.data, keyword.size, word_d);
+      word_d_valid = true;
+    }
+
+    return cmp->compare(word_s, word_d);
+  }
+
+  bool isRemoved()
+  {
+    if(tombstones->empty() || static_it->atEnd()) return false;
+
+    canonizeStatic();
+    return tombstones->count(word_s) != 0;
+  }
+
+  /// Moves the static side forward past removed entries
+  void skipForward()
+  {
+    while(isRemoved()) {
+      if(!static_it->nextEntry()) return;
+      word_s_valid = false;
+    }
+  }
+
+  /**
+   * Moves the static side back past removed entries. If all the entries
+   * before are removed, the static side returns where it was and false
+   * is returned.
+   */
+  bool skipBackward()
+  {
+    while(isRemoved()) {
+      if(!static_it->previousEntry()) {
+        skipForward();
+        return false;
+      }
+      word_s_valid = false;
+    }
+
+    return true;
+  }
+
   DictionaryIterator *getFirstIterator()
   {
     switch(order)
     {
       case NoOrder:
       {
-        CanonizedWord word_s = cmp->canonizeWord(static_it->getKeyword());
-        CanonizedWord word_d = cmp->canonizeWord(dynamic_it->getKeyword());
-        int res = cmp->compare( word_s, word_d );
+        // An exhausted side never comes first
+        if(static_it->atEnd()) {
+          order = dynamic_it->atEnd() ? BothSame : DynamicFirst;
+          return dynamic_it.get();
+        }
+        if(dynamic_it->atEnd()) {
+          order = StaticFirst;
+          return static_it.get();
+        }
+
+        int res = compareSides();
         if(res == 0) {
           order = BothSame;
-          return dynamic_it;
+          return dynamic_it.get();
         } else if(res < 0) {
           order = StaticFirst;
-          return static_it;
+          return static_it.get();
         } else {
           order = DynamicFirst;
-          return dynamic_it;
+          return dynamic_it.get();
         }
       }
 
       case DynamicFirst:
-        return dynamic_it;
+        return dynamic_it.get();
 
       case StaticFirst:
-        return static_it;
+        return static_it.get();
 
       case BothSame:
-        return dynamic_it;
+        return dynamic_it.get();
     }
 
-    return static_it;
+    return static_it.get();
   }
 
 public:
-  HybridDictionaryIterator(DictionaryIteratorPtr static_it, DictionaryIteratorPtr dynamic_it,
-                           CollationComparator *cmp) : static_it(static_it.release()),
-                           dynamic_it(dynamic_it.release()), cmp(cmp), order(NoOrder)
+  HybridDictionaryIterator(DictionaryIteratorHandle &&static_it, DictionaryIteratorHandle &&dynamic_it,
+                           CollationComparator *cmp, const std::set<CanonizedWord> *tombstones) :
+                           static_it(std::move(static_it)), dynamic_it(std::move(dynamic_it)),
+                           cmp(cmp), tombstones(tombstones), dynamic_dic(nullptr),
+                           order(NoOrder), word_s_valid(false), word_d_valid(false)
   {
+    skipForward();
   }
 
-  ~HybridDictionaryIterator()
+  /// The static side is at the keyword, which is neither removed nor in the dynamic dictionary
+  HybridDictionaryIterator(DictionaryIteratorHandle &&static_it, DynamicDictionary *dynamic_dic,
+                           const char *keyword, CollationComparator *cmp,
+                           const std::set<CanonizedWord> *tombstones) :
+                           static_it(std::move(static_it)), cmp(cmp), tombstones(tombstones),
+                           dynamic_dic(dynamic_dic), pendingKeyword(keyword), order(StaticFirst),
+                           word_s_valid(false), word_d_valid(false)
   {
-    delete static_it; 
-    delete dynamic_it;
   }
 
   const char *getKeyword()
@@ -143,24 +400,85 @@ public:
     return getFirstIterator()->getDescription();
   }
 
+  bool atEnd()
+  {
+    if(!static_it->atEnd()) return false;
+    seekDynamic();
+    return dynamic_it->atEnd();
+  }
+
+  virtual StringRef getKeywordRef()
+  {
+    return getFirstIterator()->getKeywordRef();
+  }
+
+  virtual StringRef getDescriptionRef()
+  {
+    return getFirstIterator()->getDescriptionRef();
+  }
+
   bool nextEntry()
   {
+    seekDynamic();
     DictionaryIterator *firstIt = getFirstIterator();
 
     bool res = firstIt->nextEntry();
     if(!res) return false;
 
-    if(order == BothSame)
+    if(firstIt == static_it.get())
+      word_s_valid = false;
+    else
+      word_d_valid = false;
+
+    if(order == BothSame) {
       res = static_it->nextEntry();
+      word_s_valid = false;
+    }
+
+    if(!word_s_valid)
+      skipForward();
 
     order = NoOrder;
 
     return res;
   }
 
+  /**
+   * Both sides point to their first entry not smaller than the current
+   * one, so the previous entry is the larger of their previous entries.
+   * The side holding the smaller one is moved forward again.
+   */
   bool previousEntry()
   {
-    return false;
+    seekDynamic();
+    bool static_moved  = static_it->previousEntry();
+    if(static_moved) {
+      word_s_valid = false;
+      static_moved = skipBackward();
+    }
+
+    bool dynamic_moved = dynamic_it->previousEntry();
+
+    if(!static_moved && !dynamic_moved)
+      return false;
+
+    if(dynamic_moved) word_d_valid = false;
+
+    if(static_moved && dynamic_moved) {
+      int res = compareSides();
+      if(res < 0) {
+        static_it->nextEntry();
+        word_s_valid = false;
+      }
+      else if(res > 0) {
+        dynamic_it->nextEntry();
+        word_d_valid = false;
+      }
+    }
+
+    order = NoOrder;
+
+    return true;
   }
 };
 
@@ -168,33 +486,228 @@ public:
 
 DictionaryIteratorPtr HybridDictionary::begin()
 {
-  return DictionaryIteratorPtr(new HybridDictionaryIterator(
-                                static_dic->begin(), dynamic_dic->begin(),
-                                dynamic_dic->getCollationComparator()));
+  return beginHandle().release();
 }
 
 DictionaryIteratorPtr HybridDictionary::end()
 {
-  return DictionaryIteratorPtr(new HybridDictionaryIterator(
-                                static_dic->end(), dynamic_dic->end(),
-                                dynamic_dic->getCollationComparator()));
+  return endHandle().release();
 }
 
 DictionaryIteratorPtr HybridDictionary::findEntry(const char *keyword, bool &matches)
+{
+  return findEntryHandle(keyword, matches).release();
+}
+
+DictionaryIteratorHandle HybridDictionary::beginHandle()
+{
+  DictionaryIteratorHandle it;
+  it.emplace<HybridDictionaryIterator>(static_dic->beginHandle(), dynamic_dic->beginHandle(),
+                                       dynamic_dic->getCollationComparator(), &tombstones);
+  return it;
+}
+
+DictionaryIteratorHandle HybridDictionary::endHandle()
+{
+  DictionaryIteratorHandle it;
+  it.emplace<HybridDictionaryIterator>(static_dic->endHandle(), dynamic_dic->endHandle(),
+                                       dynamic_dic->getCollationComparator(), &tombstones);
+  return it;
+}
+
+DictionaryIteratorHandle HybridDictionary::findEntryHandle(const char *keyword, bool &matches)
 {
   bool matches_static, matches_dynamic;
-  DictionaryIteratorPtr it =  DictionaryIteratorPtr(new HybridDictionaryIterator(
-                                  static_dic->findEntry(keyword, matches_static),
-                                  dynamic_dic->findEntry(keyword, matches_dynamic),
-                                  dynamic_dic->getCollationComparator()));
+  DictionaryIteratorHandle it;
+
+  // Exact matches in the static dictionary usually need no SQLite query
+  DictionaryIteratorHandle static_it = static_dic->findEntryHandle(keyword, matches_static);
+  if(matches_static && isRemoved(keyword))
+    matches_static = false;
+
+  if(matches_static && !mayBeInOverlay(keyword)) {
+    it.emplace<HybridDictionaryIterator>(std::move(static_it), dynamic_dic, keyword,
+                                         dynamic_dic->getCollationComparator(), &tombstones);
+    matches = true;
+    return it;
+  }
+
+  it.emplace<HybridDictionaryIterator>(std::move(static_it),
+                                       dynamic_dic->findEntryHandle(keyword, matches_dynamic),
+                                       dynamic_dic->getCollationComparator(), &tombstones);
   matches = matches_static || matches_dynamic;
   return it;
 }
 
 
+//============== Ordinals ==============
+
+bool HybridDictionary::loadOrdinals()
+{
+  if(ordinalsValid) return true;
+
+  addedEntries.clear();
+  removedRanks.clear();
+
+  // The dynamic dictionary is iterated in order, so are the added entries
+  CollationComparator *cmp = dynamic_dic->getCollationComparator();
+  DictionaryIteratorHandle it = dynamic_dic->beginHandle();
+  if(!it.isValid()) return false;
+
+  for( ; !it->atEnd(); it->nextEntry()) {
+    bool matches;
+    DictionaryIteratorHandle st = static_dic->findEntryHandle(it->getKeyword(), matches);
+    if(!st.isValid()) return false;
+    if(matches) continue;
+
+    AddedEntry entry;
+    entry.keyword = it->getKeyword();
+    entry.word = cmp->canonizeWord(entry.keyword);
+    entry.rank = static_dic->rankOf(entry.keyword.c_str());
+    if(entry.rank < 0) return false;
+    addedEntries.push_back(entry);
+  }
+
+  std::vector<std::string> removed;
+  if(!getSQLiteTombstones(dynamic_dic, removed)) return false;
+
+  for(unsigned int k = 0; k < removed.size(); k++) {
+    long rank = static_dic->rankOf(removed[k].c_str());
+    if(rank < 0) return false;
+    removedRanks.push_back(rank);
+  }
+  std::sort(removedRanks.begin(), removedRanks.end());
+
+  ordinalsValid = true;
+  return true;
+}
+
+// Brings the ordinals up to date after an edit of keyword. On error they
+// are dropped and built again by the next ordinal call.
+void HybridDictionary::updateOrdinals(const char *keyword)
+{
+  if(!ordinalsValid) return;
+  ordinalsValid = false;
+
+  bool inStatic, inDynamic;
+  DictionaryIteratorHandle st = static_dic->findEntryHandle(keyword, inStatic);
+  DictionaryIteratorHandle dy = dynamic_dic->findEntryHandle(keyword, inDynamic);
+  long rank = static_dic->rankOf(keyword);
+  if(!st.isValid() || !dy.isValid() || rank < 0) return;
+
+  CanonizedWord word = dynamic_dic->getCollationComparator()->canonizeWord(keyword);
+  size_t i = addedBefore(word);
+  bool wasAdded = i < addedEntries.size() &&
+    dynamic_dic->getCollationComparator()->compare(addedEntries[i].word, word) == 0;
+  if(inDynamic && !inStatic && !wasAdded) {
+    AddedEntry entry;
+    entry.word = word;
+    entry.keyword = keyword;
+    entry.rank = rank;
+    addedEntries.insert(addedEntries.begin() + i, entry);
+  } else if((!inDynamic || inStatic) && wasAdded) {
+    addedEntries.erase(addedEntries.begin() + i);
+  }
+
+  std::vector<long>::iterator r = std::lower_bound(removedRanks.begin(), removedRanks.end(), rank);
+  bool wasRemoved = r != removedRanks.end() && *r == rank;
+  bool removed = inStatic && isRemoved(keyword);
+  if(removed && !wasRemoved) {
+    removedRanks.insert(r, rank);
+  } else if(!removed && wasRemoved) {
+    removedRanks.erase(r);
+  }
+
+  ordinalsValid = true;
+}
+
+size_t HybridDictionary::addedBefore(const CanonizedWord &word)
+{
+  CollationComparator *cmp = dynamic_dic->getCollationComparator();
+  size_t lo = 0, hi = addedEntries.size();
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(cmp->compare(addedEntries[mid].word, word) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+long HybridDictionary::removedBefore(long n) const
+{
+  return std::lower_bound(removedRanks.begin(), removedRanks.end(), n) - removedRanks.begin();
+}
+
+// The i-th added entry comes after its static rank and the i added entries
+// before it, less the removed entries before it. It grows with i.
+long HybridDictionary::addedOrdinal(size_t i) const
+{
+  return addedEntries[i].rank + (long) i - removedBefore(addedEntries[i].rank);
+}
+
+long HybridDictionary::getEntryCount()
+{
+  long n = static_dic->getEntryCount();
+  if(n < 0 || !loadOrdinals()) return -1;
+
+  return n + addedEntries.size() - removedRanks.size();
+}
+
+long HybridDictionary::rankOf(const char *keyword)
+{
+  long n = static_dic->rankOf(keyword);
+  if(n < 0 || !loadOrdinals()) return -1;
+
+  CanonizedWord word = dynamic_dic->getCollationComparator()->canonizeWord(keyword);
+  return n + addedBefore(word) - removedBefore(n);
+}
+
+DictionaryIteratorPtr HybridDictionary::seekOrdinal(long n)
+{
+  if(n < 0 || !loadOrdinals()) return DictionaryIteratorPtr(nullptr);
+
+  // The first added entry at or after n
+  size_t lo = 0, hi = addedEntries.size();
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(addedOrdinal(mid) < n)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  bool matches;
+  if(lo < addedEntries.size() && addedOrdinal(lo) == n)
+    return findEntry(addedEntries[lo].keyword.c_str(), matches);
+
+  // Otherwise the (n - lo)-th static entry that is not removed. The k-th
+  // removed entry comes after removedRanks[k] - k entries that are not.
+  long s = n - lo;
+  size_t a = 0, b = removedRanks.size();
+  while(a < b) {
+    size_t mid = a + (b - a) / 2;
+    if(removedRanks[mid] - (long) mid <= s)
+      a = mid + 1;
+    else
+      b = mid;
+  }
+  s += a;
+
+  DictionaryIteratorPtr st = static_dic->seekOrdinal(s);
+  if(!st.isValid()) return st;
+
+  std::string keyword = st->getKeyword();
+  return findEntry(keyword.c_str(), matches);
+}
+
 // Constructor
 HybridDictionary::HybridDictionary(StaticDictionary *static_dic, DynamicDictionary *dynamic_dic) :
-                                              static_dic(static_dic), dynamic_dic(dynamic_dic)
+                                              static_dic(static_dic), dynamic_dic(dynamic_dic),
+                                              ordinalsValid(false), overlayFilterValid(false),
+                                              overlayRemoved(0)
 {
 }
 
@@ -233,9 +746,9 @@ DynamicDictionary *createHybridDictionary(const char *fileName, StaticDictionary
     std::string ignore_def;
     bool success = static_dic->getProperty("search-ignore-chars", ignore_def);
 
+    // The static dictionary gives the characters it really ignores, none
+    // if it has char-precedence
     if(success) {
-      if(ignore_def.empty())
-        ignore_def = "-.";
       success = dynamic_dic->setProperty("search-ignore-chars", ignore_def.c_str());
       if(!success) {
         errorMessage = dynamic_dic->getErrorMessage();
@@ -260,18 +773,29 @@ DynamicDictionary *createHybridDictionary(const char *fileName, StaticDictionary
 
 StaticDictionary *loadBedicDictionary(const char* filename, bool doCheckIntegrity, std::string &errorMessage);
 DynamicDictionary *loadSQLiteDictionary(const char *fileName, std::string &errorMessage);
+bool clearSQLiteDictionary(const char *fileName, std::string &errorMessage);
 
-DynamicDictionary *loadHybridDictionary(const char *fileName, std::string &errorMessage)
+// The static part of foo.hdic is foo.dic.dz
+static bool getStaticFileName(const char *fileName, std::string &static_file_name,
+                              std::string &errorMessage)
 {
-  std::string static_file_name = fileName;
+  static_file_name = fileName;
   int len = static_file_name.size();
-  if(len < 6) return nullptr;
-  if(static_file_name.substr(len - 5) != ".hdic") {
+  if(len < 6 || static_file_name.substr(len - 5) != ".hdic") {
     errorMessage = "Invalid hybrid dictionary extension";
-    return nullptr;
+    return false;
   }
   static_file_name.replace(len-5, 5, ".dic.dz");
 
+  return true;
+}
+
+DynamicDictionary *loadHybridDictionary(const char *fileName, std::string &errorMessage)
+{
+  std::string static_file_name;
+  if(!getStaticFileName(fileName, static_file_name, errorMessage))
+    return nullptr;
+
   DynamicDictionary *dynamic_dic = loadSQLiteDictionary(fileName, errorMessage);
   if(dynamic_dic == nullptr)
     return nullptr;
@@ -290,7 +814,152 @@ DynamicDictionary *loadHybridDictionary(const char *fileName, std::string &error
     return nullptr;
   }
 
-  return new HybridDictionary(static_dic, dynamic_dic);
+  HybridDictionary *dic = new HybridDictionary(static_dic, dynamic_dic);
+  if(!dic->loadTombstones()) {
+    errorMessage = dic->getErrorMessage();
+    delete dic;
+    return nullptr;
+  }
+
+  return dic;
+}
+
+// ============= Compaction ==============
+
+struct OverlayEntry
+{
+  std::string keyword;
+  std::string description;
+  CanonizedWord word;
+};
+
+/**
+ * Merges the dynamic dictionary into the static one. The new static
+ * dictionary replaces the old one before the dynamic dictionary is
+ * emptied, so an interrupted compaction leaves entries in both parts,
+ * which is harmless: the dynamic entries override identical ones.
+ */
+bool compactHybridDictionary(const char *fileName, std::string &errorMessage)
+{
+  std::string static_file_name;
+  if(!getStaticFileName(fileName, static_file_name, errorMessage))
+    return false;
+
+  DictImpl static_dic(static_file_name.c_str(), false);
+  if(!static_dic.getError().empty()) {
+    errorMessage = static_dic.getError();
+    return false;
+  }
+  static_dic.setSequentialAccess(true);
+
+  // The dynamic dictionary is small, it is read whole and sorted in the
+  // order of the static dictionary
+  std::vector<OverlayEntry> overlay;
+  std::set<CanonizedWord> removed;
+  {
+    DynamicDictionary *dynamic_dic = loadSQLiteDictionary(fileName, errorMessage);
+    if(dynamic_dic == nullptr)
+      return false;
+
+    std::vector<std::string> tombstones;
+    if(!getSQLiteTombstones(dynamic_dic, tombstones)) {
+      errorMessage = dynamic_dic->getErrorMessage();
+      delete dynamic_dic;
+      return false;
+    }
+    for(unsigned int i = 0; i < tombstones.size(); i++)
+      removed.insert(static_dic.canonizeWord(tombstones[i]));
+
+    DictionaryIteratorHandle it = dynamic_dic->beginHandle();
+    bool success = it.isValid();
+    while(success && !it->atEnd()) {
+      OverlayEntry entry;
+      entry.keyword = it->getKeyword();
+      const char *description = it->getDescription();
+      entry.description = description != nullptr ? description : "";
+      entry.word = static_dic.canonizeWord(entry.keyword);
+      overlay.push_back(entry);
+
+      success = it->nextEntry();
+    }
+
+    if(!success)
+      errorMessage = dynamic_dic->getErrorMessage();
+    delete dynamic_dic;
+    if(!success)
+      return false;
+  }
+
+  std::stable_sort(overlay.begin(), overlay.end(),
+                   [&static_dic](const OverlayEntry &a, const OverlayEntry &b) {
+                     return static_dic.compare(a.word, b.word) < 0;
+                   });
+
+  DictionaryWriter writer;
+  std::map<std::string, std::string>::const_iterator pit;
+  for(pit = static_dic.getProperties().begin(); pit != static_dic.getProperties().end(); ++pit)
+    writer.setProperty(pit->first, pit->second);
+
+  // Merge, the dynamic entries replace the static ones with the same
+  // keyword and the removed static entries are left out
+  CanonizedWord word;
+  unsigned int j = 0;
+  bool more = static_dic.firstEntry();
+  while(more || j < overlay.size()) {
+    size_t wordLength, senseLength;
+    const char *wordData = static_dic.getWordData(wordLength);
+
+    int res = -1;
+    if(!more) {
+      res = 1;
+    }
+    else if(j < overlay.size() || !removed.empty()) {
+      static_dic.canonizeWord(wordData, wordLength, word);
+      if(j < overlay.size())
+        res = static_dic.compare(word, overlay[j].word);
+    }
+
+    bool written = true;
+    if(res < 0) {
+      if(removed.count(word) == 0) {
+        const char *senseData = static_dic.getSenseData(senseLength);
+        written = writer.addEntry(wordData, wordLength, senseData, senseLength);
+      }
+    }
+    else {
+      written = writer.addEntry(overlay[j].keyword.data(), overlay[j].keyword.size(),
+                                overlay[j].description.data(), overlay[j].description.size());
+      j++;
+    }
+
+    if(!written) {
+      errorMessage = writer.getError();
+      return false;
+    }
+
+    if(res <= 0)
+      more = static_dic.nextEntry();
+  }
+
+  if(!static_dic.getError().empty()) {
+    errorMessage = static_dic.getError();
+    return false;
+  }
+
+  std::string new_file_name = static_file_name + ".new";
+  if(!writer.write(new_file_name.c_str(), true)) {
+    errorMessage = writer.getError();
+    unlink(new_file_name.c_str());
+    return false;
+  }
+
+  if(rename(new_file_name.c_str(), static_file_name.c_str()) != 0) {
+    errorMessage = strerror(errno);
+    unlink(new_file_name.c_str());
+    return false;
+  }
+
+  return clearSQLiteDictionary(fileName, errorMessage);
 }
 
 // ============= Properties ==============
@@ -315,7 +984,9 @@ bool HybridDictionary::getProperty(const char *propertyName, std::string &proper
 
 bool HybridDictionary::setProperty(const char *propertyName, const char *propertyValue)
 {
-  return dynamic_dic->setProperty(propertyName, propertyValue);
+  // The collation properties change the canonized keywords
+  overlayFilterValid = false;
+  return dynamic_dic->setProperty(propertyName, propertyValue) && loadTombstones();
 }
 
 const char *HybridDictionary::getErrorMessage()
@@ -325,29 +996,176 @@ const char *HybridDictionary::getErrorMessage()
   return dynamic_dic->getErrorMessage();
 }
 
+void HybridDictionary::setCacheSize(size_t entries)
+{
+  static_dic->setCacheSize(entries);
+  dynamic_dic->setCacheSize(entries);
+}
+
+void HybridDictionary::setSequentialAccess(bool sequential)
+{
+  static_dic->setSequentialAccess(sequential);
+}
+
+void HybridDictionary::setChunkCacheFile(bool enable)
+{
+  static_dic->setChunkCacheFile(enable);
+}
+
+bool HybridDictionary::getCacheStats(LookupCacheStats &stats)
+{
+  LookupCacheStats dynamic_stats;
+  if(!static_dic->getCacheStats(stats) || !dynamic_dic->getCacheStats(dynamic_stats))
+    return false;
+
+  stats.hits += dynamic_stats.hits;
+  stats.misses += dynamic_stats.misses;
+  stats.entries += dynamic_stats.entries;
+  stats.capacity += dynamic_stats.capacity;
+
+  return true;
+}
+
+bool HybridDictionary::getStats(DictionaryStats &stats)
+{
+  DictionaryStats dynamic_stats;
+  if(!static_dic->getStats(stats) || !dynamic_dic->getStats(dynamic_stats))
+    return false;
+
+  stats += dynamic_stats;
+  return true;
+}
+
+void HybridDictionary::resetStats()
+{
+  static_dic->resetStats();
+  dynamic_dic->resetStats();
+}
+
+bool HybridDictionary::verifyChecksums(int threads)
+{
+  return static_dic->verifyChecksums(threads);
+}
+
+// ============= Overlay filter ==============
+
+bool HybridDictionary::mayBeInOverlay(const char *keyword)
+{
+  CollationComparator *cmp = dynamic_dic->getCollationComparator();
+
+  if(!overlayFilterValid || overlayFilter.isFull()) {
+    long count = dynamic_dic->getEntryCount();
+    DictionaryIteratorHandle it = dynamic_dic->beginHandle();
+    if(count < 0 || !it.isValid()) return true;
+
+    overlayFilter.reset(2 * count);
+    for( ; !it->atEnd(); it->nextEntry())
+      overlayFilter.add(cmp->canonizeWord(it->getKeyword()));
+
+    overlayFilterValid = true;
+    overlayRemoved = 0;
+  }
+
+  return overlayFilter.mayContain(cmp->canonizeWord(keyword));
+}
+
+void HybridDictionary::addToOverlay(const char *keyword)
+{
+  if(overlayFilterValid)
+    overlayFilter.add(dynamic_dic->getCollationComparator()->canonizeWord(keyword));
+}
+
+// ============= Tombstones ==============
+
+bool HybridDictionary::loadTombstones()
+{
+  std::vector<std::string> keywords;
+  if(!getSQLiteTombstones(dynamic_dic, keywords)) return false;
+
+  CollationComparator *cmp = dynamic_dic->getCollationComparator();
+  tombstones.clear();
+  for(unsigned int i = 0; i < keywords.size(); i++)
+    tombstones.insert(cmp->canonizeWord(keywords[i]));
+  ordinalsValid = false;
+
+  return true;
+}
+
+bool HybridDictionary::isRemoved(const char *keyword)
+{
+  if(tombstones.empty()) return false;
+
+  return tombstones.count(dynamic_dic->getCollationComparator()->canonizeWord(keyword)) != 0;
+}
+
+bool HybridDictionary::restoreEntry(const char *keyword)
+{
+  if(!isRemoved(keyword)) return true;
+
+  if(!setSQLiteTombstone(dynamic_dic, keyword, false)) return false;
+  tombstones.erase(dynamic_dic->getCollationComparator()->canonizeWord(keyword));
+
+  return true;
+}
+
 // ============= Editing ==============
 
 // Insert an entry to the dynamic dictionary
 DictionaryIteratorPtr HybridDictionary::insertEntry(const char *keyword)
 {
-  return dynamic_dic->insertEntry(keyword);
+  if(!restoreEntry(keyword)) return DictionaryIteratorPtr(nullptr);
+
+  DictionaryIteratorPtr entry = dynamic_dic->insertEntry(keyword);
+  if(entry.isValid())
+    addToOverlay(keyword);
+  updateOrdinals(keyword);
+
+  return entry;
 }
 
 // Updates an entry to the dynamic dictionary, creates it if it doesn't exist
 bool HybridDictionary::updateEntry(const DictionaryIteratorPtr &entry, const char *description)
 {
-  bool matches;
-  DictionaryIteratorPtr placeHolder = dynamic_dic->findEntry(entry->getKeyword(), matches);
+  bool matches = false;
+  DictionaryIteratorPtr placeHolder(nullptr);
+  if(mayBeInOverlay(entry->getKeyword()))
+    placeHolder = dynamic_dic->findEntry(entry->getKeyword(), matches);
+
   if(!matches) {
+    if(!restoreEntry(entry->getKeyword())) return false;
+
     placeHolder = dynamic_dic->insertEntry(entry->getKeyword());
+    updateOrdinals(entry->getKeyword());
     if(!placeHolder.isValid()) return false;
+    addToOverlay(entry->getKeyword());
   }
 
   return dynamic_dic->updateEntry(placeHolder, description);
 }
 
-// Removes the entry from the dynamic dictionary
+// Removes the entry from the dynamic dictionary and hides the static entry
+// with a tombstone. A Bloom filter cannot forget a keyword, so the filter
+// is rebuilt once half of it is stale.
 bool HybridDictionary::removeEntry(const DictionaryIteratorPtr &entry)
 {
-  return dynamic_dic->removeEntry(entry);
+  if(!entry.isValid()) return false;
+
+  bool matches;
+  DictionaryIteratorHandle st = static_dic->findEntryHandle(entry->getKeyword(), matches);
+  if(!st.isValid()) return false;
+
+  if(matches && !isRemoved(entry->getKeyword())) {
+    if(!setSQLiteTombstone(dynamic_dic, entry->getKeyword(), true)) return false;
+    tombstones.insert(dynamic_dic->getCollationComparator()->canonizeWord(entry->getKeyword()));
+  }
+
+  std::string keyword = entry->getKeyword();
+  bool removed = dynamic_dic->removeEntry(entry);
+  updateOrdinals(keyword.c_str());
+  if(!removed) return false;
+
+  if(overlayFilterValid && 2 * ++overlayRemoved > overlayFilter.size())
+    overlayFilterValid = false;
+
+  return true;
 }
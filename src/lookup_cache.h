@@ -0,0 +1,152 @@
+/**
+ * @file   lookup_cache.h
+ * @brief  Bounded cache of lookup results keyed by the canonized keyword
+ * @author Lyndon Hill and others
+ */
+
+#pragma once
+#ifndef LOOKUP_CACHE_H
+#define LOOKUP_CACHE_H
+
+#include <stddef.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "bedic.h"
+
+/// FNV-1a over the units of a canonized word (CanonizedWord in dictionary_impl.h)
+struct CanonizedWordHash
+{
+  size_t operator()(const std::vector<unsigned int> &word) const
+  {
+    unsigned long long h = 14695981039346656037ULL;
+    for(unsigned int i = 0; i < word.size(); i++) {
+      h ^= word[i];
+      h *= 1099511628211ULL;
+    }
+    return (size_t) h;
+  }
+};
+
+/**
+ * @class LookupCache
+ *
+ * Maps canonized keywords to the results of their lookups. The cache
+ * holds a fixed number of results and evicts with the CLOCK algorithm:
+ * a hit marks the slot, and the hand passes over marked slots once
+ * before it evicts them. A cache of capacity 0 is disabled.
+ *
+ * Canonized words compare equal only if they are identical, so they can
+ * be hashed.
+ */
+template <class Value>
+class LookupCache
+{
+public:
+  typedef std::vector<unsigned int> Key;
+
+  LookupCache() : hand(0), hits(0), misses(0)
+  {
+  }
+
+  /// Sets the number of results kept, 0 disables the cache. Empties it.
+  void setCapacity(size_t capacity)
+  {
+    slots.clear();
+    slots.resize(capacity);
+    map.clear();
+    map.reserve(capacity);
+    hand = 0;
+    hits = misses = 0;
+  }
+
+  bool isEnabled() const
+  {
+    return !slots.empty();
+  }
+
+  /// Returns the cached result, or null on a miss
+  const Value *find(const Key &key)
+  {
+    typename std::unordered_map<Key, size_t, CanonizedWordHash>::const_iterator it = map.find(key);
+    if(it == map.end()) {
+      misses++;
+      return nullptr;
+    }
+
+    hits++;
+    Slot &slot = slots[it->second];
+    slot.referenced = true;
+    return &slot.value;
+  }
+
+  void insert(const Key &key, const Value &value)
+  {
+    if(slots.empty()) return;
+
+    // Advance the hand to a slot that was not hit since it last passed
+    while(slots[hand].referenced) {
+      slots[hand].referenced = false;
+      hand = (hand + 1) % slots.size();
+    }
+
+    Slot &slot = slots[hand];
+    if(slot.used)
+      map.erase(slot.key);
+
+    slot.key = key;
+    slot.value = value;
+    slot.used = true;
+    slot.referenced = false;
+    map[key] = hand;
+
+    hand = (hand + 1) % slots.size();
+  }
+
+  /// Forgets all the results, after the dictionary has changed
+  void clear()
+  {
+    if(map.empty()) return;
+
+    for(unsigned int i = 0; i < slots.size(); i++) {
+      slots[i].used = slots[i].referenced = false;
+      slots[i].value = Value();
+    }
+    map.clear();
+  }
+
+  /// Sets the hit and miss counters to 0
+  void resetStats()
+  {
+    hits = misses = 0;
+  }
+
+  void getStats(LookupCacheStats &stats) const
+  {
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.entries = map.size();
+    stats.capacity = slots.size();
+  }
+
+private:
+  struct Slot
+  {
+    Key key;
+    Value value;
+    bool used;
+    bool referenced;
+
+    Slot() : used(false), referenced(false)
+    {
+    }
+  };
+
+  std::vector<Slot> slots;
+  std::unordered_map<Key, size_t, CanonizedWordHash> map;
+  size_t hand;
+  unsigned long hits, misses;
+};
+
+#endif  /* LOOKUP_CACHE_H */
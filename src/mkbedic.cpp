@@ -35,6 +35,7 @@
 #include <sstream>
 #include <set>
 
+#include "block_checksums.h"
 #include "dictionary_impl.h"
 #include "utf8.h"
 
@@ -88,13 +89,13 @@ public:
    * Read the next entry, calling readEntry
    * @return file position of an entry; -1 if end of file
    */
-  virtual long nextEntry(std::string &keyWord, std::string &description) = 0;
+  virtual off_t nextEntry(std::string &keyWord, std::string &description) = 0;
 
   /**
    * Actually ingest the entry data
    * @return false if EOF
    */
-  virtual bool readEntry(long pos, std::string &keyWord, std::string &description) = 0;
+  virtual bool readEntry(off_t pos, std::string &keyWord, std::string &description) = 0;
 };
 
 // ==================================================================
@@ -106,11 +107,11 @@ struct entry_type {
   std::string word;
   CanonizedWord canonizedWord;
   int fidx;
-  int pos;
+  off_t pos;
   int len;
-  int offset;
+  off_t offset;
 
-  entry_type(const std::string &w, const CanonizedWord &canonizedWord, int i, int p) :
+  entry_type(const std::string &w, const CanonizedWord &canonizedWord, int i, off_t p) :
         word(w), canonizedWord(canonizedWord), fidx(i), pos(p)
   {
   }
@@ -176,7 +177,7 @@ void processXerox(XeroxCollationComparator *comparator, DictionarySource *dictSo
   EntryList entries;
   unsigned int mrl = 0;    // maximum entry length
   unsigned int mwl = 0;    // maximum word length
-  long dsize = 0;          // dictionary size
+  off_t dsize = 0;         // dictionary size
 
   std::cerr << "Reading the entries ...\n";
 
@@ -188,7 +189,7 @@ void processXerox(XeroxCollationComparator *comparator, DictionarySource *dictSo
   while(true)
   {
     std::string w, s;
-    long currPos = dictSource->nextEntry(w, s);
+    off_t currPos = dictSource->nextEntry(w, s);
     if(currPos < 0) break;
 
     if(mwl < w.size()) {
@@ -225,21 +226,21 @@ void processXerox(XeroxCollationComparator *comparator, DictionarySource *dictSo
     it_previous = it;
   }
 
-  n = 0;
+  off_t offset = 0;
   for(unsigned int i = 0; i < entries.size(); i++) {
-    entries[i].offset = n;
-    n += entries[i].len;
+    entries[i].offset = offset;
+    offset += entries[i].len;
   }
 
   std::string idx;
-  n = -32769;
+  off_t indexed = -32769;
   char *ibuf = new char [mwl+32];
   for(unsigned int i = 0; i < entries.size() - 1; i++) {
-    if(n + 32768 < entries[i].offset) {
+    if(indexed + 32768 < entries[i].offset) {
       idx += (char) 0;
-      snprintf(ibuf, mwl+32, "%s\n%d", entries[i].word.c_str(), entries[i].offset);
+      snprintf(ibuf, mwl+32, "%s\n%lld", entries[i].word.c_str(), (long long) entries[i].offset);
       idx += ibuf;
-      n = entries[i].offset;
+      indexed = entries[i].offset;
     }
   }
   delete [] ibuf;
@@ -259,7 +260,28 @@ void processXerox(XeroxCollationComparator *comparator, DictionarySource *dictSo
     prop["index"] = idx;
   }
 
-  snprintf(buf, sizeof(buf), "%ld", dsize);
+  // Offset of every 64th entry, for access by ordinal
+  std::string ordinalIdx = "64";
+  for(unsigned int i = 0; i < entries.size(); i += 64) {
+    snprintf(buf, sizeof(buf), " %lld", (long long) entries[i].offset);
+    ordinalIdx += buf;
+  }
+  prop["ordinal-index"] = ordinalIdx;
+
+  // The output may be a pipe, so the checksums are computed before the
+  // header is written, at the cost of reading the entries once more
+  BlockChecksums checksums;
+  for(unsigned int i = 0; i < entries.size(); i++) {
+    std::string w, s;
+    dictSource->readEntry(entries[i].pos, w, s);
+    checksums.add(w.c_str(), w.size());
+    checksums.add("\x0a", 1);
+    checksums.add(s.c_str(), s.size());
+    checksums.add("\x00", 1);
+  }
+  prop["block-checksums"] = checksums.toString();
+
+  snprintf(buf, sizeof(buf), "%lld", (long long) dsize);
   prop["dict-size"] = buf;
 
   snprintf(buf, sizeof(buf), "%ld", (long)entries.size());
@@ -400,7 +422,7 @@ static void readProperties(LineReader *in, std::map<std::string, std::string> &p
  */ 
 class TextDictSrc : public DictionarySource, public LineReader
 {
-  long firstPos;
+  off_t firstPos;
 
 public:
   /// Constructor
@@ -416,7 +438,7 @@ public:
   /// Bookmark the start of the dictionary entries
   void setFirstPos()
   {
-    firstPos = ftell(fh);
+    firstPos = ftello(fh);
   }
 
   /**
@@ -425,7 +447,7 @@ public:
    */
   bool firstEntry() override
   {
-    if(fseek(fh, firstPos, SEEK_SET) != 0)
+    if(fseeko(fh, firstPos, SEEK_SET) != 0)
       throw XeroxException("Cannot read dictionary file (fseek failed)");
 
     return true;
@@ -437,9 +459,9 @@ public:
    * @param description  The description
    * @return  The position of the entry read or -1 if fail (end of file)
    */
-  long nextEntry(std::string &keyWord, std::string &description) override
+  off_t nextEntry(std::string &keyWord, std::string &description) override
   {
-    long pos = ftell(fh);
+    off_t pos = ftello(fh);
     return readEntry(pos, keyWord, description) ? pos : -1;
   }
 
@@ -448,16 +470,12 @@ public:
    * @param pos         Position in file to start reading
    * @param keyWord     The keyword (output)
    * @param description The description (output)
-   * @return  true if successful, throws an exception if dictionary too long, file
-   *          seek failed or a description was missing
+   * @return  true if successful, throws an exception if file seek failed
+   *          or a description was missing
    */
-  bool readEntry(long pos, std::string &keyWord, std::string &description) override
+  bool readEntry(off_t pos, std::string &keyWord, std::string &description) override
   {
-    // Check if we fit into long maximum value, -2000000 to avoid overflow before the check
-    if(pos > LONG_MAX-2000000)
-      throw XeroxException("Maximum dictionary length exceeded");
-
-    if(fseek(fh, pos, SEEK_SET) != 0)
+    if(fseeko(fh, pos, SEEK_SET) != 0)
       throw XeroxException("Cannot read dictionary file (fseek failed)");
 
     do {
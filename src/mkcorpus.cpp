@@ -0,0 +1,503 @@
+/**
+ * @file   mkcorpus.cpp
+ * @brief  Generates synthetic dictionaries in the simplified format read
+ *         by mkbedic, for benchmarks and tests
+ * @author Lyndon Hill and others
+ *
+ * The output depends only on the options and the seed, so the same
+ * dictionary is generated on every run and platform. Headword lengths,
+ * the prefixes the headwords share, the number of senses and the words
+ * of the senses follow Zipfian distributions. Every headword is unique
+ * and uses only the letters listed in the char-precedence header.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "utf8.h"
+
+#define PROG_NAME "mkcorpus"
+
+/// splitmix64, the same sequence on every platform
+class Random
+{
+  unsigned long long state;
+
+public:
+  explicit Random(unsigned long long seed) : state(seed)
+  {
+  }
+
+  unsigned long long next()
+  {
+    unsigned long long z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  /// Uniform in [0, 1)
+  double uniform()
+  {
+    return (next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  /// Uniform in [0, n)
+  unsigned int below(unsigned int n)
+  {
+    return (unsigned int) (uniform() * n);
+  }
+};
+
+/**
+ * @class Zipf
+ * @brief Ranks 0 ... n - 1, rank r with a probability proportional to
+ *        1 / (r + 1)^s
+ */
+class Zipf
+{
+  std::vector<double> cdf;
+
+public:
+  Zipf()
+  {
+  }
+
+  Zipf(unsigned int n, double s) : cdf(n)
+  {
+    double sum = 0;
+    for(unsigned int r = 0; r < n; r++) {
+      sum += 1.0 / pow(r + 1, s);
+      cdf[r] = sum;
+    }
+    for(unsigned int r = 0; r < n; r++)
+      cdf[r] /= sum;
+  }
+
+  unsigned int sample(Random &random) const
+  {
+    if(cdf.size() <= 1) return 0;
+
+    std::vector<double>::const_iterator it = std::upper_bound(cdf.begin(), cdf.end(), random.uniform());
+    return std::min<unsigned int>(it - cdf.begin(), cdf.size() - 1);
+  }
+};
+
+/**
+ * @class SeenFilter
+ * @brief Bloom filter of the headwords already written
+ *
+ * A false positive only makes the generator draw another headword, so
+ * the headwords are unique and the memory stays at 2 bytes per entry.
+ */
+class SeenFilter
+{
+  std::vector<unsigned char> bits;
+  unsigned long long mask;
+
+  static const int probes = 6;
+
+  static unsigned long long hash(const std::string &word)
+  {
+    unsigned long long h = 14695981039346656037ULL;
+    for(unsigned int i = 0; i < word.size(); i++) {
+      h ^= (unsigned char) word[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+public:
+  explicit SeenFilter(unsigned long long entries)
+  {
+    unsigned long long size = 1024;
+    while(size < entries * 16) size *= 2;
+    bits.resize(size / 8);
+    mask = size - 1;
+  }
+
+  /// Adds the word, returns false if it may have been added before
+  bool insert(const std::string &word)
+  {
+    unsigned long long h = hash(word);
+    unsigned long long step = (h >> 32) | 1;
+    bool seen = true;
+    for(int i = 0; i < probes; i++, h += step) {
+      unsigned long long bit = h & mask;
+      if(!(bits[bit >> 3] & (1 << (bit & 7)))) {
+        seen = false;
+        bits[bit >> 3] |= 1 << (bit & 7);
+      }
+    }
+    return !seen;
+  }
+};
+
+/// Letters of a script and the typical length of its words
+struct Script
+{
+  const char *name;
+  unsigned int first, last;     ///< range of the lower case letters
+  int wordLength;               ///< most common headword length
+  const char *partsOfSpeech[4];
+};
+
+static const Script scripts[] = {
+  { "latin", 0x61, 0x7a, 7, { "n", "v", "adj", "adv" } },
+  { "cyrillic", 0x430, 0x44f, 7, { "сущ", "гл", "прил", "нар" } },
+  { "thai", 0xe01, 0xe2e, 6, { "น", "ก", "ว", "นิ" } },
+  { "cjk", 0x4e00, 0x4fff, 2, { "名", "动", "形", "副" } },
+};
+
+static void printHelp()
+{
+  fprintf(stderr,
+          "Usage: " PROG_NAME " [options] outfile\n"
+          "Writes a synthetic dictionary in the simplified format, - writes to stdout.\n"
+          "  --entries, -n N        number of entries (default 1000)\n"
+          "  --script, -s NAME      latin, cyrillic, thai or cjk (default latin)\n"
+          "  --seed, -r N           seed of the generator (default 1)\n"
+          "  --length, -l N         most common headword length (default depends on the script)\n"
+          "  --max-length, -m N     longest headword (default 4 times --length)\n"
+          "  --skew, -z S           Zipf exponent of all the distributions (default 1.0)\n"
+          "  --share, -p P          share of the headwords derived from a recent one (default 0.6)\n"
+          "  --senses, -S N         most senses per entry (default 4)\n"
+          "  --subsenses, -u N      most sub-senses per sense (default 4)\n"
+          "  --sense-words, -w N    most words per sub-sense (default 12)\n"
+          "  --tags, -t P           probability of each optional tag in a sense (default 0.3)\n"
+          "  --help                 print this message\n"
+          "Example: " PROG_NAME " -n 1000000 -s cyrillic ru.txt && mkbedic ru.txt ru.dic\n");
+}
+
+/// Parameters of the generated dictionary, see printHelp
+struct CorpusOptions
+{
+  const Script *script;
+  unsigned long long entries, seed;
+  int wordLength, maxLength;
+  double skew, share, tagDensity;
+  int maxSenses, maxSubsenses, maxSenseWords;
+
+  CorpusOptions() : script(&scripts[0]), entries(1000), seed(1), wordLength(0), maxLength(0),
+                    skew(1.0), share(0.6), tagDensity(0.3), maxSenses(4), maxSubsenses(4),
+                    maxSenseWords(12)
+  {
+  }
+};
+
+/**
+ * @class CorpusGenerator
+ * @brief Writes the header and the entries of a synthetic dictionary
+ */
+class CorpusGenerator : private CorpusOptions
+{
+public:
+  explicit CorpusGenerator(const CorpusOptions &options) : CorpusOptions(options), random(options.seed)
+  {
+  }
+
+  bool write(FILE *fh)
+  {
+    prepare();
+    writeHeader(fh);
+
+    SeenFilter seen(entries);
+    std::string word;
+    for(unsigned long long i = 0; i < entries; i++) {
+      int attempts = 0;
+      do {
+        if(++attempts > 1000) {
+          fprintf(stderr, PROG_NAME ": cannot find %llu unique headwords, increase --max-length\n", entries);
+          return false;
+        }
+        makeHeadword(word);
+      } while(!seen.insert(word));
+
+      recent[i % recent.size()] = word;
+      written = i + 1;
+
+      fputs(word.c_str(), fh);
+      fputc('\n', fh);
+      writeSenses(fh);
+      fputc('\n', fh);
+    }
+
+    if(ferror(fh) != 0) {
+      fprintf(stderr, PROG_NAME ": write error\n");
+      return false;
+    }
+
+    return true;
+  }
+
+private:
+  Random random;
+  std::vector<std::string> letters;
+  std::vector<int> lengths;           ///< headword lengths, most common first
+  Zipf lengthDist, recentDist, senseDist, subsenseDist, senseWordDist, vocabularyDist;
+  std::vector<Zipf> dropDist;         ///< letters not shared with a recent headword
+  std::vector<std::string> recent, vocabulary;
+  unsigned long long written;        ///< headwords written, the last ones are in recent
+
+  void prepare()
+  {
+    for(unsigned int rune = script->first; rune <= script->last; rune++) {
+      char buf[8];
+      int n = Utf8::runetochar(buf, rune);
+      letters.push_back(std::string(buf, n));
+    }
+
+    // Lengths ordered by distance from the most common one
+    lengths.push_back(wordLength);
+    for(int d = 1; d < maxLength; d++) {
+      if(wordLength + d <= maxLength) lengths.push_back(wordLength + d);
+      if(wordLength - d >= 1) lengths.push_back(wordLength - d);
+    }
+
+    lengthDist = Zipf(lengths.size(), skew);
+    recentDist = Zipf(4096, skew);
+    senseDist = Zipf(maxSenses, skew);
+    subsenseDist = Zipf(maxSubsenses, skew);
+    senseWordDist = Zipf(maxSenseWords, skew);
+    for(int n = 0; n <= maxLength; n++)
+      dropDist.push_back(Zipf(n + 1, skew));
+
+    recent.resize(4096);
+    written = 0;
+
+    // Words of the senses, the most frequent words are the shortest
+    for(int i = 0; i < 8192; i++) {
+      std::string word;
+      makeWord(word, lengths[lengthDist.sample(random)]);
+      vocabulary.push_back(word);
+    }
+    std::stable_sort(vocabulary.begin(), vocabulary.end(),
+                     [](const std::string &a, const std::string &b) { return a.size() < b.size(); });
+    vocabularyDist = Zipf(vocabulary.size(), skew);
+  }
+
+  void writeHeader(FILE *fh)
+  {
+    fprintf(fh, "id=Synthetic %s dictionary\n", script->name);
+    fprintf(fh, "description=Generated by " PROG_NAME " with %llu entries\n", entries);
+
+    fputs("char-precedence={ -}", fh);
+    for(unsigned int rune = script->first; rune <= script->last; rune++) {
+      char buf[16];
+      int n = Utf8::runetochar(buf, rune);
+      unsigned int upper = Utf8::runetoupper(rune);
+      if(upper != rune)
+        n += Utf8::runetochar(buf + n, upper);
+      buf[n] = 0;
+      fprintf(fh, "{%s}", buf);
+    }
+    fputs("\n\n", fh);
+  }
+
+  void makeWord(std::string &word, int length)
+  {
+    word.clear();
+    for(int i = 0; i < length; i++)
+      word += letters[random.below(letters.size())];
+  }
+
+  /// Appends the first count letters of word
+  void appendLetters(std::string &out, const std::string &word, int count)
+  {
+    const char *s = word.c_str();
+    for(int i = 0; i < count && *s != 0; i++) {
+      const char *t = s;
+      Utf8::chartorune(&s);
+      out.append(t, s - t);
+    }
+  }
+
+  static int letterCount(const std::string &word)
+  {
+    int n = 0;
+    for(unsigned int i = 0; i < word.size(); i++)
+      if((word[i] & 0xc0) != 0x80) n++;
+    return n;
+  }
+
+  /**
+   * Draws a headword. Most are derived from a recent headword, more often
+   * from the most recent ones, by keeping its letters but the last few.
+   */
+  void makeHeadword(std::string &word)
+  {
+    int length = lengths[lengthDist.sample(random)];
+
+    word.clear();
+    int shared = 0;
+    if(written != 0 && random.uniform() < share) {
+      unsigned int r = recentDist.sample(random) % std::min<unsigned long long>(written, recent.size());
+      const std::string &stem = recent[(written - 1 - r) % recent.size()];
+      int stemLength = std::min(letterCount(stem), maxLength);
+      shared = stemLength - dropDist[stemLength].sample(random);
+      appendLetters(word, stem, shared);
+      length = std::max(length, shared + 1);
+    }
+
+    for(int i = shared; i < length && i < maxLength; i++)
+      word += letters[random.below(letters.size())];
+  }
+
+  void writeWords(FILE *fh)
+  {
+    int count = 1 + senseWordDist.sample(random);
+    for(int i = 0; i < count; i++) {
+      if(i != 0) fputc(' ', fh);
+      fputs(vocabulary[vocabularyDist.sample(random)].c_str(), fh);
+    }
+  }
+
+  void writeSenses(FILE *fh)
+  {
+    int senses = 1 + senseDist.sample(random);
+    for(int i = 0; i < senses; i++) {
+      fputs("{s}", fh);
+      if(random.uniform() < tagDensity)
+        fprintf(fh, "{ps}%s{/ps}", script->partsOfSpeech[random.below(4)]);
+
+      int subsenses = 1 + subsenseDist.sample(random);
+      for(int j = 0; j < subsenses; j++) {
+        fputs("{ss}", fh);
+        if(random.uniform() < tagDensity) {
+          fputs("{ct}", fh);
+          fputs(vocabulary[vocabularyDist.sample(random)].c_str(), fh);
+          fputs("{/ct} ", fh);
+        }
+        writeWords(fh);
+        if(random.uniform() < tagDensity) {
+          fputs("; {ex}{em}", fh);
+          fputs(vocabulary[vocabularyDist.sample(random)].c_str(), fh);
+          fputs("{/em} ", fh);
+          writeWords(fh);
+          fputs("{/ex}", fh);
+        }
+        if(written != 0 && random.uniform() < tagDensity / 4) {
+          fputs(" {sa}", fh);
+          fputs(recent[random.below(std::min<unsigned long long>(written, recent.size()))].c_str(), fh);
+          fputs("{/sa}", fh);
+        }
+        fputs("{/ss}", fh);
+      }
+      fputs("{/s}\n", fh);
+    }
+  }
+};
+
+int main(int argc, char **argv)
+{
+  CorpusOptions options;
+
+  static struct option cmdLineOptions[] = {
+    { "help", no_argument, nullptr, 'e' },
+    { "entries", required_argument, nullptr, 'n' },
+    { "script", required_argument, nullptr, 's' },
+    { "seed", required_argument, nullptr, 'r' },
+    { "length", required_argument, nullptr, 'l' },
+    { "max-length", required_argument, nullptr, 'm' },
+    { "skew", required_argument, nullptr, 'z' },
+    { "share", required_argument, nullptr, 'p' },
+    { "senses", required_argument, nullptr, 'S' },
+    { "subsenses", required_argument, nullptr, 'u' },
+    { "sense-words", required_argument, nullptr, 'w' },
+    { "tags", required_argument, nullptr, 't' },
+    { nullptr, 0, nullptr, 0 }
+  };
+
+  int optionIndex = 0;
+  while(1) {
+    int c = getopt_long(argc, argv, "n:s:r:l:m:z:p:S:u:w:t:", cmdLineOptions, &optionIndex);
+    if(c == -1) break;
+
+    switch(c) {
+    case 'n':
+      options.entries = strtoull(optarg, nullptr, 10);
+      break;
+    case 's':
+      options.script = nullptr;
+      for(unsigned int i = 0; i < sizeof(scripts) / sizeof(scripts[0]); i++)
+        if(!strcmp(optarg, scripts[i].name))
+          options.script = &scripts[i];
+      if(options.script == nullptr) {
+        fprintf(stderr, PROG_NAME ": unknown script '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'r':
+      options.seed = strtoull(optarg, nullptr, 10);
+      break;
+    case 'l':
+      options.wordLength = atoi(optarg);
+      break;
+    case 'm':
+      options.maxLength = atoi(optarg);
+      break;
+    case 'z':
+      options.skew = atof(optarg);
+      break;
+    case 'p':
+      options.share = atof(optarg);
+      break;
+    case 'S':
+      options.maxSenses = atoi(optarg);
+      break;
+    case 'u':
+      options.maxSubsenses = atoi(optarg);
+      break;
+    case 'w':
+      options.maxSenseWords = atoi(optarg);
+      break;
+    case 't':
+      options.tagDensity = atof(optarg);
+      break;
+    default:
+      printHelp();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if(optind != argc - 1) {
+    printHelp();
+    return EXIT_FAILURE;
+  }
+
+  if(options.wordLength <= 0)
+    options.wordLength = options.script->wordLength;
+  if(options.maxLength <= 0)
+    options.maxLength = 4 * options.wordLength;
+  options.maxLength = std::max(options.maxLength, options.wordLength);
+  if(options.maxSenses < 1 || options.maxSubsenses < 1 || options.maxSenseWords < 1) {
+    fprintf(stderr, PROG_NAME ": --senses, --subsenses and --sense-words must be at least 1\n");
+    return EXIT_FAILURE;
+  }
+
+  const char *fileName = argv[optind];
+  FILE *fh = !strcmp(fileName, "-") ? stdout : fopen(fileName, "w");
+  if(fh == nullptr) {
+    perror(fileName);
+    return EXIT_FAILURE;
+  }
+
+  CorpusGenerator generator(options);
+  bool success = generator.write(fh);
+  if(fh != stdout && fclose(fh) != 0) {
+    perror(fileName);
+    success = false;
+  }
+
+  if(!success)
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,447 @@
+/**
+ * @file   multi_dictionary.cpp
+ * @brief  Federated search over many static dictionaries. Iterators do a
+ *         k-way merge of the dictionaries with a heap, lookups search the
+ *         dictionaries in parallel on a thread pool.
+ * @author Lyndon Hill and others
+ */
+
+#include <algorithm>
+
+#include "multi_dictionary.h"
+#include "dictionary_impl.h"
+#include "thread_pool.h"
+
+//============== Iterator ==============
+
+class MultiDictionaryIterator : public DictionaryIterator
+{
+  std::vector<DictionaryIteratorHandle> sides;
+  std::vector<CanonizedWord> words;    ///< Canonized keyword of each side
+  std::vector<int> heap;               ///< Sides not at the end, the smallest on top
+  CollationComparator *cmp;
+
+  /// Orders the sides by keyword, then by dictionary
+  int compareSides(int a, int b)
+  {
+    int res = cmp->compare(words[a], words[b]);
+    return res != 0 ? res : a - b;
+  }
+
+  struct Greater
+  {
+    MultiDictionaryIterator *it;
+
+    bool operator()(int a, int b) const
+    {
+      return it->compareSides(a, b) > 0;
+    }
+  };
+
+  void canonize(int i)
+  {
+    StringRef keyword = sides[i]->getKeywordRef();
+    cmp->canonizeWord(keyword.data, keyword.size, words[i]);
+  }
+
+  void buildHeap()
+  {
+    heap.clear();
+    for(unsigned int i = 0; i < sides.size(); i++)
+      if(!sides[i]->atEnd())
+        heap.push_back(i);
+
+    std::make_heap(heap.begin(), heap.end(), Greater{ this });
+  }
+
+  DictionaryIterator *getFirstIterator()
+  {
+    // At the end all sides return the terminal keyword
+    return heap.empty() ? sides[0].get() : sides[heap.front()].get();
+  }
+
+public:
+  MultiDictionaryIterator(std::vector<DictionaryIteratorHandle> &&sides, CollationComparator *cmp) :
+                          sides(std::move(sides)), words(this->sides.size()), cmp(cmp)
+  {
+    for(unsigned int i = 0; i < this->sides.size(); i++)
+      if(!this->sides[i]->atEnd())
+        canonize(i);
+
+    buildHeap();
+  }
+
+  const char *getKeyword()
+  {
+    return getFirstIterator()->getKeyword();
+  }
+
+  const char *getDescription()
+  {
+    return getFirstIterator()->getDescription();
+  }
+
+  StringRef getKeywordRef()
+  {
+    return getFirstIterator()->getKeywordRef();
+  }
+
+  StringRef getDescriptionRef()
+  {
+    return getFirstIterator()->getDescriptionRef();
+  }
+
+  bool atEnd()
+  {
+    return heap.empty();
+  }
+
+  bool nextEntry()
+  {
+    if(heap.empty()) return false;
+
+    std::pop_heap(heap.begin(), heap.end(), Greater{ this });
+    int i = heap.back();
+
+    // A side that can not move on leaves the heap, the others go on
+    bool moved = sides[i]->nextEntry();
+    if(!moved || sides[i]->atEnd()) {
+      heap.pop_back();
+    }
+    else {
+      canonize(i);
+      std::push_heap(heap.begin(), heap.end(), Greater{ this });
+    }
+
+    return moved;
+  }
+
+  /**
+   * Every side points to its first entry after the previous merged entry,
+   * so the previous merged entry is the largest of their previous entries.
+   * The other sides are moved forward again.
+   */
+  bool previousEntry()
+  {
+    std::vector<char> moved(sides.size(), 0);
+    int last = -1;
+
+    for(unsigned int i = 0; i < sides.size(); i++) {
+      if(!sides[i]->previousEntry()) continue;
+
+      moved[i] = 1;
+      canonize(i);
+      if(last < 0 || compareSides(i, last) > 0)
+        last = i;
+    }
+
+    if(last < 0) return false;
+
+    for(unsigned int i = 0; i < sides.size(); i++) {
+      if(!moved[i] || (int) i == last) continue;
+
+      sides[i]->nextEntry();
+      if(!sides[i]->atEnd())
+        canonize(i);
+    }
+
+    buildHeap();
+
+    return true;
+  }
+};
+
+//============== Dictionary ==============
+
+MultiDictionary::MultiDictionary(const std::vector<StaticDictionary *> &dictionaries, int threads) :
+                                 dictionaries(dictionaries)
+{
+  // Merge in the collation order of the first dictionary
+  CollationComparator *first = dictionaries[0]->getCollationComparator();
+  if(first != nullptr) {
+    cmp = new CollationComparator(*first);
+  }
+  else {
+    std::string precedence, ignoreChars;
+    dictionaries[0]->getProperty("char-precedence", precedence);
+    dictionaries[0]->getProperty("search-ignore-chars", ignoreChars);
+    if(ignoreChars.empty() && precedence.empty())
+      ignoreChars = "-.";
+
+    cmp = new CollationComparator();
+    cmp->setCollation(precedence, ignoreChars);
+  }
+
+  // More threads than dictionaries would never have any work
+  if(threads <= 0)
+    threads = std::thread::hardware_concurrency();
+  pool = new ThreadPool(std::min<int>(threads, dictionaries.size()));
+
+  for(unsigned int i = 0; i < dictionaries.size(); i++) {
+    if(i != 0) name += " + ";
+    name += dictionaries[i]->getName();
+  }
+}
+
+MultiDictionary::~MultiDictionary()
+{
+  delete pool;
+  delete cmp;
+
+  for(unsigned int i = 0; i < dictionaries.size(); i++)
+    delete dictionaries[i];
+}
+
+MultiDictionary *createMultiDictionary(const std::vector<StaticDictionary *> &dictionaries,
+                                       int threads, std::string &errorMessage)
+{
+  if(dictionaries.empty()) {
+    errorMessage = "No dictionaries to search";
+    return nullptr;
+  }
+
+  for(unsigned int i = 0; i < dictionaries.size(); i++) {
+    if(dictionaries[i] == nullptr) {
+      errorMessage = "Invalid dictionary";
+      return nullptr;
+    }
+  }
+
+  return new MultiDictionary(dictionaries, threads);
+}
+
+//============== Search ==============
+
+DictionaryIteratorPtr MultiDictionary::begin()
+{
+  return beginHandle().release();
+}
+
+DictionaryIteratorPtr MultiDictionary::end()
+{
+  return endHandle().release();
+}
+
+DictionaryIteratorPtr MultiDictionary::findEntry(const char *keyword, bool &matches)
+{
+  return findEntryHandle(keyword, matches).release();
+}
+
+// Empty dictionaries have no first entry, they start at their end
+DictionaryIteratorHandle MultiDictionary::beginHandle()
+{
+  std::vector<DictionaryIteratorHandle> sides;
+  for(unsigned int i = 0; i < dictionaries.size(); i++) {
+    sides.push_back(dictionaries[i]->beginHandle());
+    if(!sides.back().isValid() && dictionaries[i]->getEntryCount() == 0)
+      sides.back() = dictionaries[i]->endHandle();
+    if(!sides.back().isValid()) return DictionaryIteratorHandle();
+  }
+
+  DictionaryIteratorHandle it;
+  it.emplace<MultiDictionaryIterator>(std::move(sides), cmp);
+  return it;
+}
+
+DictionaryIteratorHandle MultiDictionary::endHandle()
+{
+  std::vector<DictionaryIteratorHandle> sides;
+  for(unsigned int i = 0; i < dictionaries.size(); i++) {
+    sides.push_back(dictionaries[i]->endHandle());
+    if(!sides.back().isValid()) return DictionaryIteratorHandle();
+  }
+
+  DictionaryIteratorHandle it;
+  it.emplace<MultiDictionaryIterator>(std::move(sides), cmp);
+  return it;
+}
+
+bool MultiDictionary::findEntries(const char *keyword, std::vector<DictionaryIteratorHandle> &found,
+                                  bool &matches)
+{
+  std::vector<char> matched(dictionaries.size(), 0);
+  found.clear();
+  found.resize(dictionaries.size());
+
+  pool->run(dictionaries.size(), [&](int i) {
+    bool m;
+    found[i] = dictionaries[i]->findEntryHandle(keyword, m);
+    matched[i] = m;
+  });
+
+  matches = false;
+  for(unsigned int i = 0; i < dictionaries.size(); i++) {
+    if(!found[i].isValid()) {
+      errorString = dictionaries[i]->getErrorMessage();
+      return false;
+    }
+    matches = matches || matched[i];
+  }
+
+  return true;
+}
+
+DictionaryIteratorHandle MultiDictionary::findEntryHandle(const char *keyword, bool &matches)
+{
+  std::vector<DictionaryIteratorHandle> sides;
+  if(!findEntries(keyword, sides, matches))
+    return DictionaryIteratorHandle();
+
+  DictionaryIteratorHandle it;
+  it.emplace<MultiDictionaryIterator>(std::move(sides), cmp);
+  return it;
+}
+
+bool MultiDictionary::lookup(const char *keyword, int count, std::vector<MultiDictionaryHit> &hits)
+{
+  int n = dictionaries.size();
+  std::vector<std::vector<MultiDictionaryHit> > found(n);
+  std::vector<std::vector<CanonizedWord> > words(n);
+  std::vector<char> failed(n, 0);
+  CanonizedWord word = cmp->canonizeWord(keyword);
+
+  // Reading the entries decompresses them, so it is done in the threads too
+  pool->run(n, [&](int i) {
+    bool matches;
+    DictionaryIteratorHandle it = dictionaries[i]->findEntryHandle(keyword, matches);
+    if(!it.isValid()) {
+      failed[i] = 1;
+      return;
+    }
+
+    for(int k = 0; k < count && !it->atEnd(); k++) {
+      MultiDictionaryHit hit;
+      hit.dictionary = i;
+      hit.keyword = it->getKeywordRef().str();
+      hit.description = it->getDescriptionRef().str();
+
+      words[i].push_back(cmp->canonizeWord(hit.keyword));
+      hit.matches = cmp->compare(words[i].back(), word) == 0;
+      found[i].push_back(hit);
+
+      if(!it->nextEntry()) break;
+    }
+  });
+
+  for(int i = 0; i < n; i++) {
+    if(failed[i]) {
+      errorString = dictionaries[i]->getErrorMessage();
+      return false;
+    }
+  }
+
+  // k-way merge of the sorted lists, ties in dictionary order
+  std::vector<unsigned int> next(n, 0);
+  hits.clear();
+  while((int) hits.size() < count) {
+    int first = -1;
+    for(int i = 0; i < n; i++) {
+      if(next[i] == found[i].size()) continue;
+      if(first < 0 || cmp->compare(words[i][next[i]], words[first][next[first]]) < 0)
+        first = i;
+    }
+
+    if(first < 0) break;
+    hits.push_back(found[first][next[first]++]);
+  }
+
+  return true;
+}
+
+// ============= Properties ==============
+
+const char *MultiDictionary::getName()
+{
+  return name.c_str();
+}
+
+const char *MultiDictionary::getFileName()
+{
+  return dictionaries[0]->getFileName();
+}
+
+bool MultiDictionary::getProperty(const char *propertyName, std::string &propertyValue)
+{
+  return dictionaries[0]->getProperty(propertyName, propertyValue);
+}
+
+void MultiDictionary::setCacheSize(size_t entries)
+{
+  for(unsigned int i = 0; i < dictionaries.size(); i++)
+    dictionaries[i]->setCacheSize(entries);
+}
+
+void MultiDictionary::setSequentialAccess(bool sequential)
+{
+  for(unsigned int i = 0; i < dictionaries.size(); i++)
+    dictionaries[i]->setSequentialAccess(sequential);
+}
+
+void MultiDictionary::setChunkCacheFile(bool enable)
+{
+  for(unsigned int i = 0; i < dictionaries.size(); i++)
+    dictionaries[i]->setChunkCacheFile(enable);
+}
+
+bool MultiDictionary::getCacheStats(LookupCacheStats &stats)
+{
+  stats = LookupCacheStats();
+  bool cached = false;
+  for(unsigned int i = 0; i < dictionaries.size(); i++) {
+    LookupCacheStats s;
+    if(!dictionaries[i]->getCacheStats(s)) continue;
+
+    stats.hits += s.hits;
+    stats.misses += s.misses;
+    stats.entries += s.entries;
+    stats.capacity += s.capacity;
+    cached = true;
+  }
+
+  return cached;
+}
+
+bool MultiDictionary::getStats(DictionaryStats &stats)
+{
+  stats = DictionaryStats();
+  bool counted = false;
+  for(unsigned int i = 0; i < dictionaries.size(); i++) {
+    DictionaryStats s;
+    if(!dictionaries[i]->getStats(s)) continue;
+
+    stats += s;
+    counted = true;
+  }
+
+  return counted;
+}
+
+void MultiDictionary::resetStats()
+{
+  for(unsigned int i = 0; i < dictionaries.size(); i++)
+    dictionaries[i]->resetStats();
+}
+
+bool MultiDictionary::verifyChecksums(int threads)
+{
+  for(unsigned int i = 0; i < dictionaries.size(); i++) {
+    if(!dictionaries[i]->verifyChecksums(threads)) {
+      errorString = dictionaries[i]->getErrorMessage();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+const char *MultiDictionary::getErrorMessage()
+{
+  if(!errorString.empty())
+    return errorString.c_str();
+
+  for(unsigned int i = 0; i < dictionaries.size(); i++)
+    if(strlen(dictionaries[i]->getErrorMessage()) != 0)
+      return dictionaries[i]->getErrorMessage();
+
+  return "";
+}
@@ -8,3 +8,6 @@ create table properties (
   tag varchar(200) PRIMARY KEY,
   value varchar(1024000) );
 
+
+create table tombstones (
+  keyword varchar(200) PRIMARY KEY COLLATE bedic );
@@ -0,0 +1,362 @@
+/**
+ * @file   shared_cache.cpp
+ * @brief  Cache of loaded dictionaries shared by processes
+ * @author Lyndon Hill and others
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "shared_cache.h"
+
+/// Layout of the file: the header, the path, the snapshot and the slots
+struct SharedCache::Header
+{
+  char magic[8];
+  unsigned int version;
+  unsigned int pathLength;
+  long long dictionarySize;
+  long long mtimeSec;
+  long long mtimeNsec;
+  unsigned long long snapshotOffset;
+  unsigned long long snapshotSize;
+  unsigned long long slotsOffset;
+  unsigned int slotCount;
+  unsigned int slotStride;
+  int chunkLength;
+};
+
+/// A slot, followed by the inflated chunk
+struct SharedCache::Slot
+{
+  std::atomic<unsigned int> seq;
+  std::atomic<unsigned int> chunk;    ///< chunk + 1, 0 if empty
+  std::atomic<int> length;
+  std::atomic<unsigned int> crc;      ///< CRC-32 of the chunk
+  std::atomic<int> owner;             ///< pid of the writer while seq is odd
+  std::atomic<long long> claimed;     ///< when the writer took the slot, see monotonicTime
+};
+
+static const char CACHE_MAGIC[8] = { 'B', 'E', 'D', 'I', 'C', 'S', 'C', 0 };
+static const unsigned int CACHE_VERSION = 3;
+
+/// A writer that holds a slot longer than this is taken to be gone
+static const long long STALE_WRITE_NS = 1000000000LL;
+
+static std::mutex directoryMutex;
+static std::string directory;
+
+/// Offsets in the file are aligned to this
+static const size_t ALIGNMENT = 64;
+
+static size_t align(size_t n)
+{
+  return (n + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+/// Nanoseconds of CLOCK_MONOTONIC, the same clock in every process
+static long long monotonicTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Opens a file that gets the name of cacheName once it is complete, see
+ * publishFile. It is an unnamed file where O_TMPFILE is supported, so that
+ * a process that dies while writing it leaves nothing behind; tmpName is
+ * then empty. Otherwise it is a file named after the process.
+ */
+static int openTempFile(const std::string &cacheName, std::string &tmpName)
+{
+  tmpName.clear();
+#ifdef O_TMPFILE
+  std::string dir = cacheName.substr(0, cacheName.rfind('/') + 1);
+  int fd = open(dir.empty() ? "." : dir.c_str(), O_RDWR | O_TMPFILE, 0644);
+  if(fd >= 0)
+    return fd;
+#endif
+
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", (int) getpid());
+  tmpName = cacheName + suffix;
+  return open(tmpName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+}
+
+/**
+ * Renames the file of openTempFile to cacheName, so that other processes
+ * see either the old file or the complete new one. The temporary name is
+ * removed if this fails.
+ */
+static bool publishFile(int fd, std::string &tmpName, const std::string &cacheName)
+{
+  if(tmpName.empty()) {
+    // an unnamed file is linked under a temporary name first, because
+    // linkat does not replace an existing file
+    char procName[64], suffix[32];
+    snprintf(procName, sizeof(procName), "/proc/self/fd/%d", fd);
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", (int) getpid());
+    tmpName = cacheName + suffix;
+    unlink(tmpName.c_str());
+    if(linkat(AT_FDCWD, procName, AT_FDCWD, tmpName.c_str(), AT_SYMLINK_FOLLOW) != 0)
+      return false;
+  }
+
+  if(rename(tmpName.c_str(), cacheName.c_str()) != 0) {
+    unlink(tmpName.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+/// FNV-1a, names the cache file after the path of the dictionary
+static unsigned long long hashPath(const std::string &s)
+{
+  unsigned long long h = 14695981039346656037ULL;
+  for(size_t i = 0; i < s.size(); i++) {
+    h ^= (unsigned char) s[i];
+    h *= 1099511628211ULL;
+  }
+
+  return h;
+}
+
+void SharedCache::setDirectory(const std::string &dir)
+{
+  std::lock_guard<std::mutex> lock(directoryMutex);
+  directory = dir;
+}
+
+std::string SharedCache::getDirectory()
+{
+  std::lock_guard<std::mutex> lock(directoryMutex);
+  return directory;
+}
+
+SharedCache::SharedCache(char *map, size_t mapSize) : map(map), mapSize(mapSize)
+{
+}
+
+SharedCache::~SharedCache()
+{
+  munmap(map, mapSize);
+}
+
+bool SharedCache::getKey(const char *filename, std::string &cacheName, std::string &path, Header &header)
+{
+  std::string dir = getDirectory();
+  if(dir.empty())
+    return false;
+
+  char real[PATH_MAX];
+  struct stat st;
+  if(realpath(filename, real) == nullptr || stat(real, &st) != 0)
+    return false;
+
+  path = real;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.pathLength = path.size();
+  header.dictionarySize = st.st_size;
+  header.mtimeSec = st.st_mtim.tv_sec;
+  header.mtimeNsec = st.st_mtim.tv_nsec;
+
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.bcache", hashPath(path));
+  cacheName = dir + name;
+  return true;
+}
+
+SharedCache *SharedCache::attach(const char *filename, int chunkLength)
+{
+  std::string cacheName, path;
+  Header key;
+  if(!getKey(filename, cacheName, path, key))
+    return nullptr;
+
+  int fd = open(cacheName.c_str(), O_RDWR);
+  if(fd < 0)
+    return nullptr;
+
+  struct stat st;
+  char *map = nullptr;
+  size_t size = 0;
+  if(fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(Header)) {
+    size = st.st_size;
+    map = (char *) mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+      map = nullptr;
+  }
+  close(fd);
+
+  if(map == nullptr)
+    return nullptr;
+
+  // the key and the layout must match
+  const Header *header = (const Header *) map;
+  bool valid = memcmp(header->magic, key.magic, sizeof(key.magic)) == 0 && header->version == key.version &&
+    header->pathLength == key.pathLength && header->dictionarySize == key.dictionarySize &&
+    header->mtimeSec == key.mtimeSec && header->mtimeNsec == key.mtimeNsec &&
+    sizeof(Header) + path.size() <= size && memcmp(map + sizeof(Header), path.data(), path.size()) == 0 &&
+    header->snapshotOffset + header->snapshotSize <= size &&
+    header->slotsOffset + (unsigned long long) header->slotCount * header->slotStride <= size &&
+    header->chunkLength == chunkLength &&
+    (header->slotCount == 0 || header->slotStride >= sizeof(Slot) + header->chunkLength);
+
+  if(!valid) {
+    munmap(map, size);
+    return nullptr;
+  }
+
+  return new SharedCache(map, size);
+}
+
+SharedCache *SharedCache::create(const char *filename, const std::string &snapshot, int chunkCount,
+                                 int chunkLength)
+{
+  std::string cacheName, path;
+  Header header;
+  if(!getKey(filename, cacheName, path, header))
+    return nullptr;
+
+  header.snapshotOffset = align(sizeof(Header) + path.size());
+  header.snapshotSize = snapshot.size();
+  header.slotsOffset = align(header.snapshotOffset + snapshot.size());
+  header.slotCount = chunkCount < MAX_CHUNK_SLOTS ? chunkCount : MAX_CHUNK_SLOTS;
+  header.slotStride = align(sizeof(Slot) + chunkLength);
+  header.chunkLength = chunkLength;
+  size_t size = header.slotsOffset + (size_t) header.slotCount * header.slotStride;
+
+  // the whole file is allocated, so that stores into the slots through
+  // the mapping can not raise SIGBUS on a full disk
+  std::string tmpName;
+  int fd = openTempFile(cacheName, tmpName);
+  if(fd < 0)
+    return nullptr;
+
+  bool ok = ftruncate(fd, size) == 0 && posix_fallocate(fd, 0, size) == 0 &&
+    pwrite(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header) &&
+    pwrite(fd, path.data(), path.size(), sizeof(header)) == (ssize_t) path.size() &&
+    pwrite(fd, snapshot.data(), snapshot.size(), header.snapshotOffset) == (ssize_t) snapshot.size();
+
+  char *map = nullptr;
+  if(ok) {
+    map = (char *) mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+      map = nullptr;
+  }
+
+  ok = map != nullptr && publishFile(fd, tmpName, cacheName);
+  close(fd);
+
+  if(!ok) {
+    if(map != nullptr)
+      munmap(map, size);
+    if(!tmpName.empty())
+      unlink(tmpName.c_str());
+    return nullptr;
+  }
+
+  return new SharedCache(map, size);
+}
+
+const char *SharedCache::getSnapshot(size_t &size) const
+{
+  const Header *header = (const Header *) map;
+  size = header->snapshotSize;
+  return map + header->snapshotOffset;
+}
+
+SharedCache::Slot *SharedCache::getSlot(int cp) const
+{
+  const Header *header = (const Header *) map;
+  if(header->slotCount == 0 || cp < 0)
+    return nullptr;
+
+  return (Slot *) (map + header->slotsOffset + (size_t) (cp % header->slotCount) * header->slotStride);
+}
+
+bool SharedCache::loadChunk(int cp, char *data, int &length) const
+{
+  Slot *slot = getSlot(cp);
+  if(slot == nullptr)
+    return false;
+
+  unsigned int seq = slot->seq.load(std::memory_order_acquire);
+  if((seq & 1) != 0 || slot->chunk.load(std::memory_order_relaxed) != (unsigned int) cp + 1)
+    return false;
+
+  int n = slot->length.load(std::memory_order_relaxed);
+  unsigned int crc = slot->crc.load(std::memory_order_relaxed);
+  if(n <= 0 || n > ((const Header *) map)->chunkLength)
+    return false;
+
+  memcpy(data, (const char *) (slot + 1), n);
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if(slot->seq.load(std::memory_order_relaxed) != seq)
+    return false;
+
+  // the checksum catches a writer that wrote after its slot was taken over
+  if(crc32(0, (const Bytef *) data, n) != crc)
+    return false;
+
+  length = n;
+  return true;
+}
+
+/// The writer of a slot with an odd seq died, or has held it for too long
+static bool isStale(int owner, long long claimed)
+{
+  if(owner > 0 && kill(owner, 0) != 0 && errno == ESRCH)
+    return true;
+
+  return monotonicTime() - claimed > STALE_WRITE_NS;
+}
+
+void SharedCache::storeChunk(int cp, const char *data, int length)
+{
+  Slot *slot = getSlot(cp);
+  if(slot == nullptr || length <= 0 || length > ((const Header *) map)->chunkLength)
+    return;
+
+  // an even seq is made odd, the odd seq of a stale writer stays odd
+  unsigned int seq = slot->seq.load(std::memory_order_relaxed);
+  bool taken = (seq & 1) != 0;
+  if(taken && !isStale(slot->owner.load(std::memory_order_relaxed),
+                       slot->claimed.load(std::memory_order_relaxed)))
+    return;
+  if(!taken && slot->chunk.load(std::memory_order_relaxed) == (unsigned int) cp + 1)
+    return;
+
+  unsigned int claim = taken ? seq + 2 : seq + 1;
+  if(!slot->seq.compare_exchange_strong(seq, claim, std::memory_order_acquire))
+    return;
+
+  slot->owner.store(getpid(), std::memory_order_relaxed);
+  slot->claimed.store(monotonicTime(), std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->chunk.store(0, std::memory_order_relaxed);
+  memcpy((char *) (slot + 1), data, length);
+  slot->length.store(length, std::memory_order_relaxed);
+  slot->crc.store(crc32(0, (const Bytef *) data, length), std::memory_order_relaxed);
+  slot->chunk.store(cp + 1, std::memory_order_relaxed);
+
+  // fails if the slot was taken over meanwhile
+  slot->seq.compare_exchange_strong(claim, claim + 1, std::memory_order_release);
+}
@@ -0,0 +1,199 @@
+/**
+ * @file   shared_cache.h
+ * @brief  Cache of loaded dictionaries shared by processes
+ * @author Lyndon Hill and others
+ */
+
+#pragma once
+#ifndef SHARED_CACHE_H
+#define SHARED_CACHE_H
+
+#include <sys/types.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+/// Appends values to a snapshot, in the byte order of the machine
+class SnapshotWriter
+{
+public:
+  template <class T> void put(const T &value)
+  {
+    data.append((const char *) &value, sizeof(value));
+  }
+
+  void putString(const std::string &s)
+  {
+    put<unsigned long long>(s.size());
+    data.append(s);
+  }
+
+  /// A vector of plain values
+  template <class T> void putVector(const std::vector<T> &v)
+  {
+    put<unsigned long long>(v.size());
+    if(!v.empty())
+      data.append((const char *) &v[0], v.size() * sizeof(T));
+  }
+
+  const std::string &getData() const
+  {
+    return data;
+  }
+
+private:
+  std::string data;
+};
+
+/// Reads the values of SnapshotWriter back; isValid is false once a value was missing
+class SnapshotReader
+{
+public:
+  SnapshotReader(const char *data, size_t size) : p(data), end(data + size), valid(true) {}
+
+  template <class T> bool get(T &value)
+  {
+    if(!valid || (size_t) (end - p) < sizeof(value))
+      return valid = false;
+
+    memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return true;
+  }
+
+  bool getString(std::string &s)
+  {
+    unsigned long long n;
+    if(!get(n) || (unsigned long long) (end - p) < n)
+      return valid = false;
+
+    s.assign(p, n);
+    p += n;
+    return true;
+  }
+
+  template <class T> bool getVector(std::vector<T> &v)
+  {
+    unsigned long long n;
+    if(!get(n) || (unsigned long long) (end - p) / sizeof(T) < n)
+      return valid = false;
+
+    v.resize(n);
+    if(n > 0)
+      memcpy(&v[0], p, n * sizeof(T));
+    p += n * sizeof(T);
+    return true;
+  }
+
+  bool isValid() const
+  {
+    return valid;
+  }
+
+  bool atEnd() const
+  {
+    return p == end;
+  }
+
+private:
+  const char *p;
+  const char *end;
+  bool valid;
+};
+
+/**
+ * @class SharedCache
+ *
+ * A file in the shared cache directory (see setDirectory) that holds
+ * what a process builds when it loads a dictionary: a snapshot of the
+ * parsed header, the index and the compiled collation, and, for dictzip
+ * files, slots of inflated chunks. The file is mapped by every process
+ * that loads the dictionary, so that a new process attaches to it
+ * instead of parsing the header again, and chunks inflated by one
+ * process are read by the others.
+ *
+ * The file is keyed by the real path, the modification time and the
+ * size of the dictionary; a changed dictionary gets a new file. A chunk
+ * goes to slot chunk % slot count. Each slot is guarded by a sequence
+ * number (a seqlock): a writer makes it odd while it writes and skips
+ * the slot if another writer has it, a reader copies the chunk and
+ * treats it as missing if the number changed meanwhile. Nobody waits.
+ * A slot whose writer died or has held it for more than a second is
+ * taken over, and a CRC-32 of each chunk keeps a reader from trusting
+ * what a writer wrote after it lost its slot.
+ *
+ * A new file is written as an unnamed file (O_TMPFILE) where the file
+ * system supports it, so that a process that dies meanwhile leaves no
+ * temporary file behind.
+ */
+class SharedCache
+{
+public:
+  ~SharedCache();
+
+  /**
+   * Directory of the cache files, empty (the default) disables the
+   * cache. The directory must exist and be writable by the processes.
+   */
+  static void setDirectory(const std::string &dir);
+  static std::string getDirectory();
+
+  /**
+   * Attaches to the cache file of the dictionary
+   *
+   * @param chunkLength  length of an inflated chunk of the dictionary, it
+   *                     must be the one the file was created with
+   * @return  the cache, or null if the cache is disabled or the file
+   *          does not exist or is stale
+   */
+  static SharedCache *attach(const char *filename, int chunkLength);
+
+  /**
+   * Writes a new cache file for the dictionary, replacing a stale one
+   *
+   * @param snapshot     see getSnapshot
+   * @param chunkCount   chunks of a dictzip file, 0 for a plain file
+   * @param chunkLength  length of an inflated chunk
+   * @return  the cache, or null if the cache is disabled or the file
+   *          could not be written
+   */
+  static SharedCache *create(const char *filename, const std::string &snapshot, int chunkCount,
+                             int chunkLength);
+
+  /// The snapshot written by create
+  const char *getSnapshot(size_t &size) const;
+
+  /**
+   * Copies chunk cp to data if it is in its slot
+   *
+   * @param length  set to the length of the chunk
+   * @return  true if the chunk was there
+   */
+  bool loadChunk(int cp, char *data, int &length) const;
+
+  /// Puts chunk cp in its slot, unless another writer has the slot
+  void storeChunk(int cp, const char *data, int length);
+
+  /// Most slots of a cache file
+  static const int MAX_CHUNK_SLOTS = 256;
+
+private:
+  struct Header;
+  struct Slot;
+
+  SharedCache(char *map, size_t mapSize);
+
+  /// Name of the cache file of the dictionary and its key
+  static bool getKey(const char *filename, std::string &cacheName, std::string &path, Header &header);
+
+  Slot *getSlot(int cp) const;
+
+  char *map;
+  size_t mapSize;
+
+  SharedCache(const SharedCache &) = delete;
+  SharedCache &operator=(const SharedCache &) = delete;
+};
+
+#endif  /* SHARED_CACHE_H */
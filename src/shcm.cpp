@@ -25,6 +25,7 @@
 
 #include "shcm.h"
 #include "shc.h"
+#include "trace.h"
 
 class SHCMImpl : public SHCM
 {
@@ -199,6 +200,7 @@ std::string SHCMImpl::encode(const std::string &s)
 
 std::string SHCMImpl::decode(const std::string &ss)
 {
+  TraceScope scope(TRACE_DECODE, ss.size());
   unsigned int bits, symbol;
   uint32 bitbuf, bufpos;
   std::string ret;
@@ -267,5 +269,7 @@ std::string SHCMImpl::decode(const std::string &ss)
     ret.push_back(symbol);
   }
 
+  BEDIC_STAT(stats.decodes, 1);
+  BEDIC_STAT(stats.decodedBytes, ret.size());
   return ret;
 }
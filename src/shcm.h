@@ -26,8 +26,15 @@
 
 #include <string>
 
+#include "stats.h"
+
 class SHCM {
 public:
+#ifdef BEDIC_STATS
+  /// Strings decoded and their size
+  StatCounters stats;
+#endif
+
   virtual void startDecode(const std::string &tree) = 0;
   virtual void endDecode() = 0;
 
@@ -0,0 +1,122 @@
+/**
+ * @file   stats.h
+ * @brief  Counters of the work done by lookups, see DictionaryStats
+ * @author Lyndon Hill and others
+ *
+ * The counters exist only when the library is built with BEDIC_STATS
+ * (make STATS=1). Otherwise BEDIC_STAT expands to nothing, so neither
+ * the counters nor the code that updates them is compiled.
+ */
+
+#pragma once
+#ifndef STATS_H
+#define STATS_H
+
+#ifdef BEDIC_STATS
+
+#include <atomic>
+
+#include "bedic.h"
+
+/**
+ * @class StatCounter
+ *
+ * A relaxed atomic counter: the increments are not ordered with other
+ * memory accesses, which is enough for statistics and costs no fence.
+ * Copying a counter copies its value, so the classes holding counters
+ * stay copyable.
+ */
+class StatCounter
+{
+  std::atomic<unsigned long long> value;
+
+public:
+  StatCounter() : value(0)
+  {
+  }
+
+  StatCounter(const StatCounter &other) : value(other.get())
+  {
+  }
+
+  StatCounter &operator=(const StatCounter &other)
+  {
+    value.store(other.get(), std::memory_order_relaxed);
+    return *this;
+  }
+
+  void add(unsigned long long n)
+  {
+    value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  unsigned long long get() const
+  {
+    return value.load(std::memory_order_relaxed);
+  }
+
+  void reset()
+  {
+    value.store(0, std::memory_order_relaxed);
+  }
+};
+
+/// The counters of one component; each updates the ones it knows about
+struct StatCounters
+{
+  StatCounter lookups;
+  StatCounter indexProbes;
+  StatCounter bisectionSteps;
+  StatCounter scanBytes;
+  StatCounter readCalls;
+  StatCounter readBytes;
+  StatCounter chunksInflated;
+  StatCounter chunkHits;
+  StatCounter canonicalizations;
+  StatCounter decodes;
+  StatCounter decodedBytes;
+  StatCounter sqliteSteps;
+
+  /// Adds the counters to stats
+  void addTo(DictionaryStats &stats) const
+  {
+    stats.lookups += lookups.get();
+    stats.indexProbes += indexProbes.get();
+    stats.bisectionSteps += bisectionSteps.get();
+    stats.scanBytes += scanBytes.get();
+    stats.readCalls += readCalls.get();
+    stats.readBytes += readBytes.get();
+    stats.chunksInflated += chunksInflated.get();
+    stats.chunkHits += chunkHits.get();
+    stats.canonicalizations += canonicalizations.get();
+    stats.decodes += decodes.get();
+    stats.decodedBytes += decodedBytes.get();
+    stats.sqliteSteps += sqliteSteps.get();
+  }
+
+  void reset()
+  {
+    lookups.reset();
+    indexProbes.reset();
+    bisectionSteps.reset();
+    scanBytes.reset();
+    readCalls.reset();
+    readBytes.reset();
+    chunksInflated.reset();
+    chunkHits.reset();
+    canonicalizations.reset();
+    decodes.reset();
+    decodedBytes.reset();
+    sqliteSteps.reset();
+  }
+};
+
+#define BEDIC_STAT(counter, n) ((counter).add(n))
+
+#else
+
+#define BEDIC_STAT(counter, n) ((void) 0)
+
+#endif  /* BEDIC_STATS */
+
+#endif  /* STATS_H */
@@ -0,0 +1,136 @@
+/**
+ * @file   test_collation.cpp
+ * @brief  Test unit for UTF-8 decoding and CollationComparator
+ * @author Lyndon Hill and others
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+
+#include "dictionary_impl.h"
+#include "utf8.h"
+
+static int failures = 0;
+
+static void check(bool condition, const char *description)
+{
+  if(!condition) {
+    std::cerr << "FAILED: " << description << "\n";
+    failures++;
+  }
+}
+
+static void testDecoding()
+{
+  // a, U+00E9, U+0416, U+1F600 (emoji), U+20000 (CJK extension B)
+  const char *word = "a\xc3\xa9\xd0\x96\xf0\x9f\x98\x80\xf0\xa0\x80\x80";
+  const unsigned int expected[] = { 0x61, 0xe9, 0x416, 0x1f600, 0x20000 };
+
+  const char *s = word;
+  for(unsigned int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+    check(Utf8::chartorune(&s) == expected[i], "decoding of 1 to 4 byte sequences");
+  check(*s == 0, "decoder consumed the whole string");
+
+  char buf[8];
+  check(Utf8::runetochar(buf, 0x1f600) == 4 && memcmp(buf, "\xf0\x9f\x98\x80", 4) == 0,
+        "encoding of a 4 byte sequence");
+
+  // truncated and overlong sequences are rejected
+  s = "\xf0\x9f\x98";
+  check(Utf8::chartorune(&s) == 128, "truncated 4 byte sequence");
+  s = "\xf0\x80\x80\x80";
+  check(Utf8::chartorune(&s) == 128, "overlong 4 byte sequence");
+
+  check(Utf8::asciiSpan("abcdefghijklmnop\xc3\xa9", 18) == 16, "ASCII span stops at UTF-8");
+  check(Utf8::asciiSpan("abcdefghij\0klm", 14) == 10, "ASCII span stops at zero");
+
+  // case mapping of Latin, Greek and Cyrillic runes, identity outside the tables
+  check(Utf8::runetoupper(0xe9) == 0xc9 && Utf8::runetolower(0xc9) == 0xe9, "Latin case mapping");
+  check(Utf8::runetoupper(0x3c9) == 0x3a9 && Utf8::runetolower(0x3a9) == 0x3c9, "Greek case mapping");
+  check(Utf8::runetoupper(0x436) == 0x416 && Utf8::runetolower(0x416) == 0x436, "Cyrillic case mapping");
+  check(Utf8::runetoupper(0x1f600) == 0x1f600 && Utf8::runetoupper('1') == '1', "runes without case");
+
+  unsigned int c = 0;
+  while(c <= 0x10ffff && Utf8::runetoupper(c) == Utf8::runetoupperSearch(c))
+    c++;
+  check(c > 0x10ffff, "case table matches the binary search");
+
+  std::string upper;
+  Utf8::toupper(std::string("ascii \xc3\xa9\xf0\x9f\x98\x80 text"), upper);
+  check(upper == "ASCII \xc3\x89\xf0\x9f\x98\x80 TEXT", "toupper keeps 4 byte sequences");
+}
+
+static void testCanonize()
+{
+  CollationComparator cmp;
+  cmp.setCollation("", "-.");
+
+  // Words must not be truncated at a supplementary plane character
+  CanonizedWord w1 = cmp.canonizeWord("smile\xf0\x9f\x98\x80" "a");
+  CanonizedWord w2 = cmp.canonizeWord("smile\xf0\x9f\x98\x80" "b");
+  check(w1.size() == 7, "canonized word keeps runes after an emoji");
+  check(cmp.compare(w1, w2) < 0, "words differing after an emoji are different");
+
+  check(cmp.compare(cmp.canonizeWord("a-b.c"), cmp.canonizeWord("ABC")) == 0,
+        "ignored characters and case");
+  check(cmp.compare(cmp.canonizeWord("abc"), cmp.canonizeWord("abd")) < 0, "simple order");
+
+  // Multi-byte ignored characters, words that are not zero terminated
+  CollationComparator apostrophes;
+  apostrophes.setCollation("", "\xe2\x80\x99'");
+  CanonizedWord w3;
+  apostrophes.canonizeWord("don\xe2\x80\x99t\xd0\x96", 8, w3);
+  check(apostrophes.compare(w3, apostrophes.canonizeWord("DON'T")) == 0,
+        "multi-byte ignored character and truncated sequence at the end");
+  check(cmp.compare(cmp.canonizeWord("ab"), cmp.canonizeWord("abc")) < 0, "prefix sorts first");
+
+  // Long words go through the vectorized mismatch search
+  std::string longWord = "abcdefghijklmnopqrstu";
+  for(unsigned int i = 0; i < longWord.size(); i++) {
+    std::string other = longWord;
+    other[i] = 'z';
+    check(cmp.compare(cmp.canonizeWord(longWord), cmp.canonizeWord(other)) < 0 &&
+          cmp.compare(cmp.canonizeWord(other), cmp.canonizeWord(longWord)) > 0,
+          "mismatch at every position of a long word");
+  }
+  check(cmp.compare(cmp.canonizeWord(longWord), cmp.canonizeWord(longWord + "-")) == 0,
+        "equal long words");
+}
+
+static void testCharPrecedence()
+{
+  CollationComparator cmp;
+  cmp.setCollation("{aA\xc3\xa4}{bB}{cC}", "");
+
+  // German style: the group decides first, the position in the group breaks ties
+  check(cmp.compare(cmp.canonizeWord("\xc3\xa4" "b"), cmp.canonizeWord("ac")) < 0,
+        "group order before tie-break");
+  check(cmp.compare(cmp.canonizeWord("ab"), cmp.canonizeWord("\xc3\xa4" "b")) < 0,
+        "tie-break inside a group");
+  check(cmp.compare(cmp.canonizeWord("Ab"), cmp.canonizeWord("ab")) > 0, "case sensitive tie-break");
+  check(cmp.compare(cmp.canonizeWord("ab"), cmp.canonizeWord("ab")) == 0, "equal words");
+  check(cmp.compare(cmp.canonizeWord("Ab"), cmp.canonizeWord("abc")) < 0, "shorter word first");
+
+  // Ignored characters win over char-precedence
+  CollationComparator ignored;
+  ignored.setCollation("{aA}{bB}{-}", "-");
+  check(ignored.compare(ignored.canonizeWord("a-b"), ignored.canonizeWord("ab")) == 0,
+        "ignored character listed in char-precedence");
+}
+
+int main()
+{
+  testDecoding();
+  testCanonize();
+  testCharPrecedence();
+
+  if(failures != 0) {
+    std::cerr << failures << " check(s) failed\n";
+    return EXIT_FAILURE;
+  }
+
+  std::cerr << "All collation checks passed\n";
+  return EXIT_SUCCESS;
+}
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 
 #include <iostream>
+#include <vector>
 
 #include "bedic.h"
 
@@ -61,14 +62,78 @@ int main()
     return EXIT_FAILURE;
   }
 
-  while(!(it == dic->end())) {
+  while(!it->atEnd()) {
     std::cerr << "# " << it->getKeyword() << " - " << it->getDescription() << "\n";
+
+    StringRef keywordRef = it->getKeywordRef();
+    if(keywordRef.str() != it->getKeyword()) {
+      std::cerr << "Failed: keyword view differs from the keyword\n";
+      return EXIT_FAILURE;
+    }
+    StringRef descriptionRef = it->getDescriptionRef();
+    if(descriptionRef.str() != it->getDescription()) {
+      std::cerr << "Failed: description view differs from the description\n";
+      return EXIT_FAILURE;
+    }
+
     if(!it->nextEntry()) {
       std::cerr << "Failed with error: " << dic->getErrorMessage() << "\n";
       return EXIT_FAILURE;
     }
   }
 
+  std::cerr << "Listing all entries backward\n";
+  std::vector<std::string> keywords;
+  for(it = dic->begin(); !it->atEnd(); it->nextEntry())
+    keywords.push_back(it->getKeyword());
+
+  it = dic->end();
+  for(int i = keywords.size() - 1; i >= 0; i--) {
+    if(!it->previousEntry() || keywords[i] != it->getKeyword()) {
+      std::cerr << "Failed: backward listing differs at " << keywords[i] << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+  if(it->previousEntry()) {
+    std::cerr << "Failed: moved before the first entry\n";
+    return EXIT_FAILURE;
+  }
+
+  std::cerr << "Looking up entries by ordinal\n";
+  if(dic->getEntryCount() != (long) keywords.size()) {
+    std::cerr << "Failed: entry count is " << dic->getEntryCount() << "\n";
+    return EXIT_FAILURE;
+  }
+  for(unsigned int i = 0; i < keywords.size(); i++) {
+    it = dic->seekOrdinal(i);
+    if(!it.isValid() || keywords[i] != it->getKeyword() || dic->rankOf(keywords[i].c_str()) != (long) i) {
+      std::cerr << "Failed: ordinal access differs at " << keywords[i] << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cerr << "Looking up entries through handles\n";
+  DictionaryIteratorHandle first = dic->beginHandle();
+  if(!first.isValid()) {
+    std::cerr << "Failed with error: " << dic->getErrorMessage() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::string firstKeyword = first->getKeyword();
+  bool matches = false;
+  DictionaryIteratorHandle found = dic->findEntryHandle(firstKeyword.c_str(), matches);
+  DictionaryIteratorHandle moved = std::move(found);
+  if(!matches || found.isValid() || !(moved == first)) {
+    std::cerr << "Failed: handle lookup of " << firstKeyword << "\n";
+    return EXIT_FAILURE;
+  }
+
+  DictionaryIteratorPtr released = moved.release();
+  if(moved.isValid() || firstKeyword != released->getKeyword()) {
+    std::cerr << "Failed: handle released to a pointer\n";
+    return EXIT_FAILURE;
+  }
+
   delete dic;
 
   return EXIT_SUCCESS;
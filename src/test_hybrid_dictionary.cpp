@@ -0,0 +1,617 @@
+/**
+ * @file   test_hybrid_dictionary.cpp
+ * @brief  Test unit for hybrid dictionaries and their compaction
+ * @author Lyndon Hill and others
+ */
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bedic.h"
+#include "dictionary_writer.h"
+#include "shared_cache.h"
+#include "trace.h"
+
+static int failures = 0;
+
+static void check(bool condition, const char *description)
+{
+  if(!condition) {
+    std::cerr << "FAILED: " << description << "\n";
+    failures++;
+  }
+}
+
+/// The results of findEntries are those of findEntry for each keyword
+static bool checkBatchLookup(StaticDictionary *dic, const std::vector<std::string> &keywords)
+{
+  std::vector<LookupResult> results;
+  if(!dic->findEntries(keywords, results) || results.size() != keywords.size())
+    return false;
+
+  for(size_t i = 0; i < keywords.size(); i++) {
+    bool matches;
+    DictionaryIteratorPtr it = dic->findEntry(keywords[i].c_str(), matches);
+    if(!it.isValid() || matches != results[i].matches || results[i].keyword != it->getKeyword() ||
+       results[i].description != it->getDescription())
+      return false;
+  }
+
+  return true;
+}
+
+static std::vector<std::string> listEntries(StaticDictionary *dic)
+{
+  std::vector<std::string> entries;
+  for(DictionaryIteratorPtr it = dic->begin(); !it->atEnd(); it->nextEntry())
+    entries.push_back(std::string(it->getKeyword()) + "=" + it->getDescription());
+
+  return entries;
+}
+
+/// Every entry is at the ordinal of its rank and seekOrdinal finds it there
+static bool checkOrdinals(StaticDictionary *dic)
+{
+  long n = 0;
+  for(DictionaryIteratorPtr it = dic->begin(); !it->atEnd(); it->nextEntry(), n++) {
+    std::string keyword = it->getKeyword();
+    DictionaryIteratorPtr at = dic->seekOrdinal(n);
+    if(dic->rankOf(keyword.c_str()) != n || !at.isValid() || keyword != at->getKeyword())
+      return false;
+  }
+
+  return dic->getEntryCount() == n && !dic->seekOrdinal(n).isValid();
+}
+
+/// Files in dir, removed if remove is set
+static int countFiles(const char *dir, bool remove)
+{
+  int n = 0;
+  DIR *d = opendir(dir);
+  for(struct dirent *e; d != nullptr && (e = readdir(d)) != nullptr; ) {
+    if(e->d_name[0] == '.')
+      continue;
+    n++;
+    if(remove)
+      unlink((std::string(dir) + "/" + e->d_name).c_str());
+  }
+  if(d != nullptr)
+    closedir(d);
+
+  return n;
+}
+
+int main()
+{
+  const char *staticFile = "test_hybrid.dic.dz";
+  const char *hybridFile = "test_hybrid.hdic";
+  remove(hybridFile);
+
+  std::cerr << "Writing a dictzip dictionary\n";
+  {
+    DictionaryWriter writer;
+    writer.setProperty("id", "Test hybrid");
+    char keyword[16], description[32];
+    for(int i = 0; i < 5000; i++) {
+      snprintf(keyword, sizeof(keyword), "k%05d", 2 * i);
+      snprintf(description, sizeof(description), "static %d", 2 * i);
+      writer.addEntry(keyword, strlen(keyword), description, strlen(description));
+    }
+    if(!writer.write(staticFile, true)) {
+      std::cerr << "Failed with error: " << writer.getError() << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::string errorMessage;
+  StaticDictionary *static_dic = StaticDictionary::loadDictionary(staticFile, false, errorMessage);
+  if(static_dic == nullptr) {
+    std::cerr << "Failed with error: " << errorMessage << "\n";
+    return EXIT_FAILURE;
+  }
+  check(static_dic->getEntryCount() == 5000, "written dictionary has all the entries");
+
+  bool matches;
+  DictionaryIteratorPtr it = static_dic->findEntry("k01234", matches);
+  check(matches && std::string(it->getDescription()) == "static 1234", "lookup in the dictzip file");
+  check(checkOrdinals(static_dic), "ordinals of the dictzip file");
+  check(static_dic->rankOf("a") == 0 && static_dic->rankOf("k00011") == 6 && static_dic->rankOf("z") == 5000,
+        "ranks of missing keywords");
+
+  std::cerr << "Caching lookups\n";
+  LookupCacheStats stats;
+  static_dic->setCacheSize(16);
+  for(int i = 0; i < 2; i++) {
+    it = static_dic->findEntry("k01235", matches);
+    check(!matches && std::string(it->getKeyword()) == "k01236" &&
+          std::string(it->getDescription()) == "static 1236", "cached lookup");
+    it->nextEntry();
+    check(std::string(it->getKeyword()) == "k01238", "iteration from a cached lookup");
+  }
+  check(static_dic->getCacheStats(stats) && stats.hits == 1 && stats.misses == 1, "cache counters");
+  static_dic->setCacheSize(0);
+
+  std::cerr << "Counting the work of lookups\n";
+  DictionaryStats counters;
+  static_dic->resetStats();
+  it = static_dic->findEntry("k04321", matches);
+#ifdef BEDIC_STATS
+  check(static_dic->getStats(counters) && counters.lookups == 1 && counters.bisectionSteps > 0 &&
+        counters.canonicalizations > 0 && counters.chunksInflated + counters.chunkHits > 0,
+        "lookup counters");
+  static_dic->resetStats();
+  check(static_dic->getStats(counters) && counters.lookups == 0 && counters.chunkHits == 0,
+        "counters are reset");
+#else
+  check(!static_dic->getStats(counters) && counters.lookups == 0, "no counters without BEDIC_STATS");
+#endif
+
+  std::cerr << "Tracing lookups\n";
+  std::vector<TraceSpan> spans;
+  Trace::setBufferSize(4);
+  it = static_dic->findEntry("k04322", matches);
+  it = static_dic->findEntry("k08642", matches);
+  size_t lost = Trace::collectSpans(spans);
+  Trace::setBufferSize(0);
+  check(spans.size() == 4 && lost > 0, "the ring buffer keeps the last spans");
+  check(!spans.empty() && spans.back().phase == TRACE_LOOKUP && spans.back().start <= spans.back().end,
+        "the lookup span ends last");
+  it = static_dic->findEntry("k04322", matches);
+  spans.clear();
+  check(Trace::collectSpans(spans) == 0 && spans.empty(), "tracing is off");
+
+  // spans collected while they are written are not lost
+  Trace::setBufferSize(1 << 16);
+  std::atomic<bool> recording(true);
+  std::thread recorder([&recording]() {
+    TraceSpan span = TraceSpan();
+    span.phase = TRACE_READ_ENTRY;
+    for(int i = 0; i < 50000; i++) {
+      span.arg = i;
+      Trace::record(span);
+    }
+    recording = false;
+  });
+  lost = 0;
+  while(recording)
+    lost += Trace::collectSpans(spans);
+  recorder.join();
+  lost += Trace::collectSpans(spans);
+  Trace::setBufferSize(0);
+  bool ordered = spans.size() == 50000;
+  for(size_t i = 0; ordered && i < spans.size(); i++)
+    ordered = spans[i].arg == (long long) i;
+  check(lost == 0 && ordered, "spans being written are collected later");
+
+  std::cerr << "Looking up several keywords at once\n";
+  std::vector<std::string> batch;
+  for(int i = 0; i < 200; i++) {
+    char keyword[16];
+    snprintf(keyword, sizeof(keyword), "k%05d", (i * 7919) % 10000);
+    batch.push_back(keyword);
+  }
+  batch.push_back("a");
+  batch.push_back("k99999");
+  batch.push_back("k01234");
+  check(checkBatchLookup(static_dic, batch), "batch lookup in the dictzip file");
+  static_dic->setCacheSize(64);
+  check(checkBatchLookup(static_dic, batch) && checkBatchLookup(static_dic, batch),
+        "batch lookup with the cache");
+  static_dic->setCacheSize(0);
+
+  std::cerr << "Reading sequentially\n";
+  {
+    std::vector<std::string> entries = listEntries(static_dic);
+    static_dic->setSequentialAccess(true);
+    check(listEntries(static_dic) == entries, "sequential scan of the dictzip file");
+    std::vector<std::string> reversed;
+    for(it = static_dic->end(); it->previousEntry(); )
+      reversed.push_back(std::string(it->getKeyword()) + "=" + it->getDescription());
+    check(std::equal(reversed.rbegin(), reversed.rend(), entries.begin()) && reversed.size() == entries.size(),
+          "backward scan in sequential mode");
+    it = static_dic->findEntry("k04320", matches);
+    check(matches && std::string(it->getDescription()) == "static 4320", "lookup in sequential mode");
+    static_dic->setSequentialAccess(false);
+  }
+
+  std::cerr << "Keeping inflated chunks in a file\n";
+  {
+    std::string chunkFile = std::string(staticFile) + ".chunks";
+    remove(chunkFile.c_str());
+    std::vector<std::string> entries = listEntries(static_dic);
+    static_dic->setChunkCacheFile(true);
+    FILE *fh = fopen(chunkFile.c_str(), "rb");
+    check(fh != nullptr, "chunk file created");
+    if(fh != nullptr)
+      fclose(fh);
+    check(listEntries(static_dic) == entries, "scan that fills the chunk file");
+    // the chunks are synced and marked when the file is closed
+    static_dic->setChunkCacheFile(false);
+
+    StaticDictionary *cached_dic = StaticDictionary::loadDictionary(staticFile, false, errorMessage);
+    if(cached_dic != nullptr) {
+      cached_dic->setChunkCacheFile(true);
+      cached_dic->resetStats();
+      check(listEntries(cached_dic) == entries, "scan from the chunk file");
+      check(checkBatchLookup(cached_dic, batch), "batch lookup with the chunk file");
+      cached_dic->setSequentialAccess(true);
+      check(listEntries(cached_dic) == entries, "sequential scan with the chunk file");
+      cached_dic->setSequentialAccess(false);
+#ifdef BEDIC_STATS
+      check(cached_dic->getStats(counters) && counters.chunksInflated == 0, "no chunk inflated again");
+#endif
+      cached_dic->setChunkCacheFile(false);
+      check(listEntries(cached_dic) == entries, "scan with the chunk file turned off");
+    }
+    delete cached_dic;
+
+    // a chunk that does not match its checksum is inflated again
+    std::string content;
+    fh = fopen(chunkFile.c_str(), "rb");
+    for(int c; fh != nullptr && (c = fgetc(fh)) != EOF; )
+      content += (char) c;
+    if(fh != nullptr)
+      fclose(fh);
+    size_t damaged = content.find("static 4320");
+    check(damaged != std::string::npos, "chunks written to the chunk file");
+    fh = fopen(chunkFile.c_str(), "r+b");
+    if(fh != nullptr && damaged != std::string::npos) {
+      fseek(fh, damaged, SEEK_SET);
+      fputs("static XXXX", fh);
+    }
+    if(fh != nullptr)
+      fclose(fh);
+
+    cached_dic = StaticDictionary::loadDictionary(staticFile, false, errorMessage);
+    if(cached_dic != nullptr) {
+      cached_dic->setChunkCacheFile(true);
+      it = cached_dic->findEntry("k04320", matches);
+      check(matches && std::string(it->getDescription()) == "static 4320", "damaged chunk is not used");
+      check(listEntries(cached_dic) == entries, "scan with a damaged chunk");
+    }
+    delete cached_dic;
+    remove(chunkFile.c_str());
+  }
+
+  std::cerr << "Sharing loaded dictionaries between processes\n";
+  {
+    const char *cacheDir = "test_hybrid_cache";
+    mkdir(cacheDir, 0755);
+    countFiles(cacheDir, true);
+    StaticDictionary::setSharedCacheDirectory(cacheDir);
+
+    StaticDictionary *first_dic = StaticDictionary::loadDictionary(staticFile, false, errorMessage);
+    check(first_dic != nullptr && countFiles(cacheDir, false) == 1, "cache file written");
+    if(first_dic != nullptr) {
+      it = first_dic->findEntry("k04320", matches);
+      check(matches && std::string(it->getDescription()) == "static 4320", "lookup that fills the cache");
+    }
+
+    StaticDictionary *second_dic = StaticDictionary::loadDictionary(staticFile, false, errorMessage);
+    check(second_dic != nullptr && listEntries(second_dic) == listEntries(static_dic),
+          "dictionary loaded from the cache");
+    if(second_dic != nullptr) {
+      check(std::string(second_dic->getName()) == static_dic->getName(), "properties loaded from the cache");
+      check(checkBatchLookup(second_dic, batch), "batch lookup with the cache");
+      second_dic->resetStats();
+      it = second_dic->findEntry("k04320", matches);
+      check(matches && std::string(it->getDescription()) == "static 4320", "lookup with the cache");
+#ifdef BEDIC_STATS
+      check(second_dic->getStats(counters) && counters.chunksInflated == 0, "chunk read from the cache");
+#endif
+    }
+    delete first_dic;
+    delete second_dic;
+
+    // chunks of another length would overflow the buffers of the reader
+    SharedCache *mismatched = SharedCache::attach(staticFile, 1);
+    check(mismatched == nullptr, "cache file of another chunk length is refused");
+    delete mismatched;
+
+    // a rewritten dictionary gets a new cache file
+    const char *changedFile = "test_hybrid_changed.dic";
+    for(int round = 0; round < 2; round++) {
+      DictionaryWriter writer;
+      writer.setProperty("id", round == 0 ? "Before" : "After");
+      char description[32];
+      for(int i = 0; i <= round; i++) {
+        snprintf(description, sizeof(description), "round %d", round);
+        writer.addEntry(i == 0 ? "a" : "b", 1, description, strlen(description));
+      }
+      check(writer.write(changedFile, false), "changed dictionary written");
+
+      StaticDictionary *changed_dic = StaticDictionary::loadDictionary(changedFile, false, errorMessage);
+      check(changed_dic != nullptr && std::string(changed_dic->getName()) == (round == 0 ? "Before" : "After") &&
+            listEntries(changed_dic).size() == (size_t) round + 1, "changed dictionary is not loaded from the cache");
+      delete changed_dic;
+    }
+    remove(changedFile);
+
+    StaticDictionary::setSharedCacheDirectory("");
+    countFiles(cacheDir, true);
+    rmdir(cacheDir);
+  }
+
+  std::cerr << "Checking the block checksums\n";
+  check(static_dic->verifyChecksums(2), "verification of an intact dictionary");
+  {
+    const char *plainFile = "test_hybrid.dic";
+    DictionaryWriter writer;
+    writer.setProperty("id", "Test checksums");
+    char keyword[16], description[32];
+    for(int i = 0; i < 5000; i++) {
+      snprintf(keyword, sizeof(keyword), "k%05d", 2 * i);
+      snprintf(description, sizeof(description), "static %d", 2 * i);
+      writer.addEntry(keyword, strlen(keyword), description, strlen(description));
+    }
+    check(writer.write(plainFile, false), "plain dictionary written");
+    StaticDictionary *batch_dic = StaticDictionary::loadDictionary(plainFile, true, errorMessage);
+    check(batch_dic != nullptr && checkBatchLookup(batch_dic, batch), "batch lookup in the plain file");
+    delete batch_dic;
+
+    std::cerr << "Reading a dictzip file of several members\n";
+    const char *membersFile = "test_hybrid_members.dic.dz";
+    writer.setMemberChunks(1);
+    check(writer.write(membersFile, true), "dictzip file of one chunk per member written");
+    StaticDictionary *plain_dic = StaticDictionary::loadDictionary(plainFile, false, errorMessage);
+    StaticDictionary *members_dic = StaticDictionary::loadDictionary(membersFile, true, errorMessage);
+    check(plain_dic != nullptr && members_dic != nullptr && listEntries(members_dic) == listEntries(plain_dic),
+          "the members read as one file");
+    if(plain_dic != nullptr && members_dic != nullptr) {
+      members_dic->setSequentialAccess(true);
+      plain_dic->setSequentialAccess(true);
+      check(listEntries(members_dic) == listEntries(plain_dic), "sequential scan of the members");
+      members_dic->setSequentialAccess(false);
+      plain_dic->setSequentialAccess(false);
+    }
+    if(members_dic != nullptr) {
+      it = members_dic->findEntry("k09998", matches);
+      check(matches && std::string(it->getDescription()) == "static 9998", "lookup in the last member");
+      check(members_dic->verifyChecksums(2), "verification across the members");
+    }
+    delete plain_dic;
+    delete members_dic;
+    remove(membersFile);
+
+    // a changed digit keeps the structure, so only the checksums can tell
+    FILE *fh = fopen(plainFile, "r+b");
+    std::vector<char> data;
+    char block[4096];
+    for(size_t n; fh != nullptr && (n = fread(block, 1, sizeof(block), fh)) > 0; )
+      data.insert(data.end(), block, block + n);
+    std::string text(data.begin(), data.end());
+    size_t corrupted = text.find("static 4320");
+    check(fh != nullptr && corrupted != std::string::npos, "plain dictionary read back");
+    if(fh != nullptr && corrupted != std::string::npos) {
+      fseek(fh, corrupted + 7, SEEK_SET);
+      fputc('5', fh);
+    }
+    // without the items property the entries are counted by a scan
+    size_t items = text.find("\nitems=");
+    if(fh != nullptr && items != std::string::npos) {
+      fseek(fh, items + 1, SEEK_SET);
+      fputc('x', fh);
+    }
+    if(fh != nullptr)
+      fclose(fh);
+
+    StaticDictionary *corrupted_dic = StaticDictionary::loadDictionary(plainFile, true, errorMessage);
+    check(corrupted_dic != nullptr, "the corruption is not found at load time");
+    if(corrupted_dic != nullptr) {
+      it = corrupted_dic->findEntry("k09000", matches);
+      check(it.isValid() && matches, "lookup in an intact block");
+      it = corrupted_dic->findEntry("k04320", matches);
+      check(!it.isValid(), "lookup in the corrupted block fails");
+      delete corrupted_dic;
+    }
+
+    corrupted_dic = StaticDictionary::loadDictionary(plainFile, true, errorMessage);
+    check(corrupted_dic != nullptr && corrupted_dic->getEntryCount() == -1, "count across the corrupted block fails");
+    delete corrupted_dic;
+
+    // the ordinals are right until the corrupted block is read, then they fail
+    corrupted_dic = StaticDictionary::loadDictionary(plainFile, true, errorMessage);
+    bool failed = false, wrong = false;
+    for(int i = 0; corrupted_dic != nullptr && i < 5000; i++) {
+      it = corrupted_dic->seekOrdinal(i);
+      snprintf(keyword, sizeof(keyword), "k%05d", 2 * i);
+      if(!it.isValid())
+        failed = true;
+      else if(std::string(it->getKeyword()) != keyword)
+        wrong = true;
+    }
+    check(failed && !wrong, "seekOrdinal fails across the corrupted block");
+    delete corrupted_dic;
+
+    corrupted_dic = StaticDictionary::loadDictionary(plainFile, true, errorMessage);
+    failed = wrong = false;
+    for(int i = 4999; corrupted_dic != nullptr && i >= 0; i--) {
+      snprintf(keyword, sizeof(keyword), "k%05d", 2 * i);
+      long rank = corrupted_dic->rankOf(keyword);
+      if(rank < 0)
+        failed = true;
+      else if(rank != i)
+        wrong = true;
+    }
+    check(failed && !wrong, "rankOf fails across the corrupted block");
+    delete corrupted_dic;
+
+    corrupted_dic = StaticDictionary::loadDictionary(plainFile, false, errorMessage);
+    check(corrupted_dic != nullptr && !corrupted_dic->verifyChecksums(2) &&
+          strstr(corrupted_dic->getErrorMessage(), "checksum") != nullptr, "verification finds the corruption");
+    delete corrupted_dic;
+
+    // dictionaries written before the checksums have no block-checksums
+    const char legacy[] = "id=Legacy\n\0apple\nfruit\0pear\nfruit\0";
+    fh = fopen(plainFile, "wb");
+    if(fh != nullptr) {
+      fwrite(legacy, 1, sizeof(legacy) - 1, fh);
+      fclose(fh);
+    }
+    StaticDictionary *legacy_dic = StaticDictionary::loadDictionary(plainFile, true, errorMessage);
+    check(legacy_dic != nullptr && legacy_dic->verifyChecksums(2),
+          "dictionary without checksums passes the integrity check");
+    if(legacy_dic != nullptr) {
+      it = legacy_dic->findEntry("pear", matches);
+      check(matches && std::string(it->getDescription()) == "fruit", "lookup without checksums");
+    }
+    delete legacy_dic;
+    remove(plainFile);
+  }
+
+  std::cerr << "Editing a hybrid dictionary\n";
+  DynamicDictionary *dic = createHybridDictionary(hybridFile, static_dic, errorMessage);
+  if(dic == nullptr) {
+    std::cerr << "Failed with error: " << errorMessage << "\n";
+    return EXIT_FAILURE;
+  }
+
+  dic->setCacheSize(64);
+  it = dic->findEntry("k00010", matches);
+  check(dic->updateEntry(it, "changed"), "update of a static entry");
+  for(int i = 0; i < 2; i++) {
+    it = dic->findEntry("k00010", matches);
+    check(matches && std::string(it->getDescription()) == "changed", "lookup of an updated entry");
+  }
+  check(dic->updateEntry(it, "changed again"), "second update of a static entry");
+  it = dic->findEntry("k00010", matches);
+  check(matches && std::string(it->getDescription()) == "changed again", "edits empty the cache");
+  it = dic->findEntry("k00010", matches);
+  check(dic->updateEntry(it, "changed"), "third update of a static entry");
+  it = dic->insertEntry("k00011");
+  check(it.isValid() && dic->updateEntry(it, "added"), "insert of a new entry");
+  it = dic->insertEntry("a");
+  check(it.isValid() && dic->updateEntry(it, "first"), "insert before the first entry");
+
+  check(listEntries(dic).size() == 5002, "hybrid dictionary lists both parts");
+  check(checkOrdinals(dic), "ordinals of added entries");
+
+  std::cerr << "Editing a hybrid dictionary with char-precedence\n";
+  {
+    const char *precedenceFile = "test_precedence.dic.dz";
+    const char *precedenceHybrid = "test_precedence.hdic";
+    remove(precedenceHybrid);
+
+    // the letters sort in reverse
+    DictionaryWriter writer;
+    writer.setProperty("id", "Test precedence");
+    writer.setProperty("char-precedence", "zyxwvutsrqponmlkjihgfedcba");
+    const char *staticWords[] = { "zeta", "yak", "nut", "bob" };
+    for(int i = 0; i < 4; i++)
+      writer.addEntry(staticWords[i], strlen(staticWords[i]), "static", 6);
+    check(writer.write(precedenceFile, true), "char-precedence dictionary written");
+
+    std::vector<std::string> expected;
+    const char *sorted[] = { "zeta", "yak", "x-ray", "nut", "mid", "bob", "apple" };
+    for(int i = 0; i < 7; i++)
+      expected.push_back(sorted[i]);
+
+    StaticDictionary *precedence_dic = StaticDictionary::loadDictionary(precedenceFile, false, errorMessage);
+    DynamicDictionary *hybrid_dic = precedence_dic != nullptr ?
+      createHybridDictionary(precedenceHybrid, precedence_dic, errorMessage) : nullptr;
+    check(hybrid_dic != nullptr, "hybrid dictionary with char-precedence created");
+    if(hybrid_dic == nullptr) {
+      delete precedence_dic;
+    } else {
+      const char *added[] = { "x-ray", "mid", "apple" };
+      for(int i = 0; i < 3; i++) {
+        it = hybrid_dic->insertEntry(added[i]);
+        check(it.isValid() && hybrid_dic->updateEntry(it, "added"), "insert with char-precedence");
+      }
+    }
+
+    StaticDictionary *reopened_dic = hybrid_dic;
+    for(int round = 0; reopened_dic != nullptr && round < 2; round++) {
+      std::vector<std::string> keywords;
+      for(it = reopened_dic->begin(); !it->atEnd(); it->nextEntry())
+        keywords.push_back(it->getKeyword());
+      check(keywords == expected, round == 0 ? "order of a new hybrid dictionary with char-precedence" :
+            "order of a reopened hybrid dictionary with char-precedence");
+      it = reopened_dic->findEntry("xray", matches);
+      check(!matches, "no ignored characters with char-precedence");
+
+      delete reopened_dic;
+      reopened_dic = round == 0 ? StaticDictionary::loadDictionary(precedenceHybrid, false, errorMessage) : nullptr;
+    }
+    delete reopened_dic;
+    remove(precedenceHybrid);
+    remove(precedenceFile);
+  }
+
+  std::cerr << "Removing entries\n";
+  it = dic->findEntry("k00020", matches);
+  check(dic->removeEntry(it), "removal of a static entry");
+  it = dic->findEntry("k00011", matches);
+  check(dic->removeEntry(it), "removal of an added entry");
+  it = dic->findEntry("k00030", matches);
+  check(dic->removeEntry(it), "removal of an entry inserted again");
+  it = dic->insertEntry("k00030");
+  check(it.isValid() && dic->updateEntry(it, "again"), "insert of a removed entry");
+
+  it = dic->findEntry("k00020", matches);
+  check(!matches && std::string(it->getKeyword()) == "k00022", "removed entry is not found");
+  check(it->previousEntry() && std::string(it->getKeyword()) == "k00018", "removed entries are skipped backward");
+  it = dic->findEntry("k00030", matches);
+  check(matches && std::string(it->getDescription()) == "again", "entry inserted again is found");
+
+  std::vector<std::string> before = listEntries(dic);
+  check(before.size() == 5000 && (long) before.size() == dic->getEntryCount(),
+        "removed entries are not listed nor counted");
+  const char *keywords[] = { "a", "k00000", "k00010", "k00018", "k00022", "k09998" };
+  for(unsigned int i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+    it = dic->seekOrdinal(dic->rankOf(keywords[i]));
+    check(it.isValid() && std::string(it->getKeyword()) == keywords[i], "ordinals skip removed entries");
+  }
+  check(checkOrdinals(dic), "ordinals follow the edits");
+  check(dic->rankOf("k00020") == dic->rankOf("k00022"), "rank of a removed entry");
+  delete dic;
+
+  dic = static_cast<DynamicDictionary *>(StaticDictionary::loadDictionary(hybridFile, false, errorMessage));
+  if(dic == nullptr) {
+    std::cerr << "Failed with error: " << errorMessage << "\n";
+    return EXIT_FAILURE;
+  }
+  check(listEntries(dic) == before, "removals are kept when the dictionary is loaded again");
+  check(checkOrdinals(dic), "ordinals of a loaded hybrid dictionary");
+  delete dic;
+
+  std::cerr << "Compacting\n";
+  if(!compactHybridDictionary(hybridFile, errorMessage)) {
+    std::cerr << "Failed with error: " << errorMessage << "\n";
+    return EXIT_FAILURE;
+  }
+
+  dic = static_cast<DynamicDictionary *>(StaticDictionary::loadDictionary(hybridFile, false, errorMessage));
+  if(dic == nullptr) {
+    std::cerr << "Failed with error: " << errorMessage << "\n";
+    return EXIT_FAILURE;
+  }
+  check(listEntries(dic) == before, "compacted dictionary has the same entries");
+  check(dic->getEntryCount() == 5000, "compacted dictionary has no tombstones");
+  delete dic;
+
+  static_dic = StaticDictionary::loadDictionary(staticFile, false, errorMessage);
+  check(static_dic != nullptr && listEntries(static_dic) == before, "edits are in the static part");
+  delete static_dic;
+
+  remove(hybridFile);
+  remove(staticFile);
+
+  if(failures != 0) {
+    std::cerr << failures << " check(s) failed\n";
+    return EXIT_FAILURE;
+  }
+
+  std::cerr << "All hybrid dictionary checks passed\n";
+  return EXIT_SUCCESS;
+}
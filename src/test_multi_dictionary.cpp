@@ -0,0 +1,168 @@
+/**
+ * @file   test_multi_dictionary.cpp
+ * @brief  Test unit for MultiDictionary class
+ * @author Lyndon Hill and others
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <vector>
+
+#include "multi_dictionary.h"
+#include "dictionary_impl.h"
+#include "dictionary_writer.h"
+
+static int failures = 0;
+
+static void check(bool condition, const char *description)
+{
+  if(!condition) {
+    std::cerr << "FAILED: " << description << "\n";
+    failures++;
+  }
+}
+
+static DynamicDictionary *createDictionary(const char *fileName, int seed, const char *shared)
+{
+  std::string errorMessage;
+  remove(fileName);
+  DynamicDictionary *dic = createSQLiteDictionary(fileName, fileName, errorMessage);
+  if(dic == nullptr) {
+    std::cerr << "Failed with error: " << errorMessage << "\n";
+    exit(EXIT_FAILURE);
+  }
+
+  srand(seed);
+  for(int i = 0; i < 20; i++) {
+    std::string keyword;
+    int l = rand() % 6 + 3;
+    for(int j = 0; j < l; j++)
+      keyword += 'a' + (rand() % 25);
+
+    DictionaryIteratorPtr item = dic->insertEntry(i == 0 ? shared : keyword.c_str());
+    if(item.isValid())
+      dic->updateEntry(item, fileName);
+  }
+
+  return dic;
+}
+
+int main()
+{
+  const char *files[] = { "test_multi_0.edic", "test_multi_1.edic", "test_multi_2.edic" };
+  std::vector<StaticDictionary *> dictionaries;
+  long total = 0;
+  for(int i = 0; i < 3; i++) {
+    dictionaries.push_back(createDictionary(files[i], i + 1, i == 1 ? "other" : "shared"));
+    total += dictionaries.back()->getEntryCount();
+  }
+
+  std::string errorMessage;
+  MultiDictionary *dic = createMultiDictionary(dictionaries, 0, errorMessage);
+  if(dic == nullptr) {
+    std::cerr << "Failed with error: " << errorMessage << "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::cerr << "Listing merged entries\n";
+  CollationComparator *cmp = dic->getCollationComparator();
+  std::vector<std::string> keywords;
+  for(DictionaryIteratorPtr it = dic->begin(); !it->atEnd(); it->nextEntry()) {
+    if(!keywords.empty())
+      check(cmp->compare(cmp->canonizeWord(keywords.back()), cmp->canonizeWord(it->getKeyword())) <= 0,
+            "merged entries are in collation order");
+    keywords.push_back(it->getKeyword());
+  }
+  check((long) keywords.size() == total, "merged listing has the entries of all dictionaries");
+
+  std::cerr << "Listing merged entries backward\n";
+  DictionaryIteratorPtr it = dic->end();
+  for(int i = keywords.size() - 1; i >= 0; i--)
+    check(it->previousEntry() && keywords[i] == it->getKeyword(), "backward listing");
+  check(!it->previousEntry(), "no entry before the first one");
+
+  std::cerr << "Looking up a keyword in several dictionaries\n";
+  bool matches;
+  it = dic->findEntry("shared", matches);
+  check(matches && std::string(it->getKeyword()) == "shared" &&
+        std::string(it->getDescription()) == files[0], "entry of the first dictionary comes first");
+  it->nextEntry();
+  check(std::string(it->getKeyword()) == "shared" && std::string(it->getDescription()) == files[2],
+        "entry of the third dictionary comes next");
+
+  std::vector<MultiDictionaryHit> hits;
+  check(dic->lookup("shared", 5, hits), "lookup succeeds");
+  check(hits.size() == 5, "lookup returns the requested number of entries");
+  check(hits.size() >= 2 && hits[0].matches && hits[0].dictionary == 0 &&
+        hits[1].matches && hits[1].dictionary == 2, "lookup returns the hits of every dictionary");
+  for(unsigned int i = 2; i < hits.size(); i++)
+    check(!hits[i].matches, "only the keyword matches");
+
+  it = dic->findEntry("shared", matches);
+  for(unsigned int i = 0; i < hits.size(); i++, it->nextEntry())
+    check(hits[i].keyword == it->getKeyword() && hits[i].description == it->getDescription(),
+          "lookup returns the entries of the iterator");
+
+  delete dic;
+  for(int i = 0; i < 3; i++)
+    remove(files[i]);
+
+  std::cerr << "Mixing a static dictionary with empty ones\n";
+  const char *staticFile = "test_multi_static.dic";
+  const char *emptyFile = "test_multi_empty.dic";
+  const char *staticWords[] = { "apple", "pear", "plum" };
+  {
+    DictionaryWriter writer, emptyWriter;
+    writer.setProperty("id", "Test static");
+    for(int i = 0; i < 3; i++)
+      writer.addEntry(staticWords[i], strlen(staticWords[i]), "fruit", 5);
+    emptyWriter.setProperty("id", "Test empty");
+    check(writer.write(staticFile, false) && emptyWriter.write(emptyFile, false), "static dictionaries written");
+  }
+
+  dictionaries.clear();
+  dictionaries.push_back(StaticDictionary::loadDictionary(emptyFile, false, errorMessage));
+  dictionaries.push_back(StaticDictionary::loadDictionary(staticFile, false, errorMessage));
+  remove(files[0]);
+  dictionaries.push_back(createSQLiteDictionary(files[0], files[0], errorMessage));
+  dic = createMultiDictionary(dictionaries, 0, errorMessage);
+  if(dic == nullptr) {
+    std::cerr << "Failed with error: " << errorMessage << "\n";
+    return EXIT_FAILURE;
+  }
+
+  keywords.clear();
+  it = dic->begin();
+  check(it.isValid(), "iterator over a set with empty dictionaries");
+  for( ; it.isValid() && !it->atEnd(); it->nextEntry())
+    keywords.push_back(it->getKeyword());
+  check(keywords.size() == 3 && keywords[0] == "apple" && keywords[2] == "plum",
+        "empty dictionaries add no entries");
+  check(it.isValid() && !it->nextEntry() && it->atEnd(), "no entry after the last one");
+
+  it = dic->end();
+  for(int i = 2; i >= 0; i--)
+    check(it->previousEntry() && keywords[i] == it->getKeyword(), "backward listing with empty dictionaries");
+  check(!it->previousEntry(), "no entry before the first one with empty dictionaries");
+
+  it = dic->findEntry("pear", matches);
+  check(matches && std::string(it->getKeyword()) == "pear", "lookup with empty dictionaries");
+  check(dic->lookup("apple", 5, hits) && hits.size() == 3 && hits[0].dictionary == 1,
+        "lookup returns the entries of the static dictionary");
+
+  delete dic;
+  remove(staticFile);
+  remove(emptyFile);
+  remove(files[0]);
+
+  if(failures != 0) {
+    std::cerr << failures << " check(s) failed\n";
+    return EXIT_FAILURE;
+  }
+
+  std::cerr << "All multi dictionary checks passed\n";
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file   thread_pool.cpp
+ * @brief  A fixed set of worker threads running parallel loops
+ * @author Lyndon Hill and others
+ */
+
+#include <algorithm>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int threads) : stopping(false)
+{
+  if(threads <= 0)
+    threads = std::thread::hardware_concurrency();
+
+  // the calling thread also runs the tasks
+  for(int i = 1; i < threads; i++)
+    workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  started.notify_all();
+
+  for(unsigned int i = 0; i < workers.size(); i++)
+    workers[i].join();
+}
+
+void ThreadPool::run(int count, const std::function<void(int)> &task)
+{
+  if(workers.empty() || count <= 1) {
+    for(int i = 0; i < count; i++)
+      task(i);
+    return;
+  }
+
+  TaskGroup group;
+  group.task = &task;
+  group.count = count;
+  group.next = 0;
+  group.running = count;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  groups.push_back(&group);
+  started.notify_all();
+
+  // the caller only takes iterations of its own loop, so it returns as
+  // soon as that loop is done
+  while(group.next < group.count)
+    runTask(group, lock);
+
+  while(group.running > 0)
+    group.finished.wait(lock);
+}
+
+void ThreadPool::work()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  for(;;) {
+    while(!stopping && groups.empty())
+      started.wait(lock);
+
+    if(stopping) return;
+
+    runTask(*groups.front(), lock);
+  }
+}
+
+// Runs the next iteration of the group, called with the mutex locked
+void ThreadPool::runTask(TaskGroup &group, std::unique_lock<std::mutex> &lock)
+{
+  const std::function<void(int)> &f = *group.task;
+  int i = group.next++;
+
+  if(group.next == group.count)
+    groups.erase(std::find(groups.begin(), groups.end(), &group));
+
+  lock.unlock();
+  f(i);
+  lock.lock();
+
+  // the caller may return and destroy the group once the mutex is free
+  if(--group.running == 0)
+    group.finished.notify_all();
+}
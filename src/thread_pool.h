@@ -0,0 +1,62 @@
+/**
+ * @file   thread_pool.h
+ * @brief  A fixed set of worker threads running parallel loops
+ * @author Lyndon Hill and others
+ */
+
+#pragma once
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ *
+ * Runs the iterations of a loop on the worker threads and the calling
+ * thread. Loops started by several threads at once share the workers;
+ * each caller waits only for the iterations of its own loop.
+ */
+class ThreadPool
+{
+public:
+  /// 0 threads uses one thread per processor
+  explicit ThreadPool(int threads = 0);
+  ~ThreadPool();
+
+  /// Runs task(0) ... task(count - 1) and returns when all have finished
+  void run(int count, const std::function<void(int)> &task);
+
+  int getThreadCount() const
+  {
+    return workers.size() + 1;
+  }
+
+private:
+  /// The iterations of one call to run
+  struct TaskGroup
+  {
+    const std::function<void(int)> *task;
+    int count;
+    int next;          ///< Next iteration to run
+    int running;       ///< Iterations that have not finished yet
+    std::condition_variable finished;
+  };
+
+  void work();
+  void runTask(TaskGroup &group, std::unique_lock<std::mutex> &lock);
+
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable started;
+  std::deque<TaskGroup *> groups;      ///< Groups with iterations left to start
+  bool stopping;
+};
+
+#endif  /* THREAD_POOL_H */
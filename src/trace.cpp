@@ -0,0 +1,151 @@
+/**
+ * @file   trace.cpp
+ * @brief  Timed spans of the phases of lookups
+ * @author Lyndon Hill and others
+ */
+
+#include <time.h>
+
+#include "trace.h"
+
+std::atomic<bool> Trace::enabled(false);
+
+static TraceCallback traceCallback = nullptr;
+static void *traceData = nullptr;
+
+/**
+ * A slot of the ring buffer. seq is 2 * n + 1 while span n is written
+ * and 2 * n + 2 once it is complete, so a reader can tell a span from
+ * one that is being overwritten.
+ */
+struct TraceSlot
+{
+  std::atomic<unsigned long long> seq;
+  std::atomic<unsigned long long> phaseThread;    ///< phase << 32 | thread
+  std::atomic<unsigned long long> start;
+  std::atomic<unsigned long long> end;
+  std::atomic<long long> arg;
+};
+
+static TraceSlot *traceSlots = nullptr;
+static size_t traceMask = 0;
+static std::atomic<unsigned long long> traceHead(0);
+static unsigned long long traceTail = 0;
+
+void Trace::setCallback(TraceCallback callback, void *data)
+{
+  traceCallback = callback;
+  traceData = data;
+  enabled.store(callback != nullptr || traceSlots != nullptr, std::memory_order_relaxed);
+}
+
+void Trace::setBufferSize(size_t capacity)
+{
+  enabled.store(traceCallback != nullptr, std::memory_order_relaxed);
+
+  delete[] traceSlots;
+  traceSlots = nullptr;
+  traceMask = 0;
+  traceHead.store(0);
+  traceTail = 0;
+
+  if(capacity == 0) return;
+
+  size_t size = 1;
+  while(size < capacity) size *= 2;
+
+  traceSlots = new TraceSlot[size];
+  for(size_t i = 0; i < size; i++)
+    traceSlots[i].seq.store(0, std::memory_order_relaxed);
+  traceMask = size - 1;
+
+  enabled.store(true, std::memory_order_relaxed);
+}
+
+size_t Trace::collectSpans(std::vector<TraceSpan> &spans)
+{
+  if(traceSlots == nullptr) return 0;
+
+  unsigned long long head = traceHead.load(std::memory_order_acquire);
+  unsigned long long from = traceTail;
+  size_t lost = 0;
+
+  if(head - from > traceMask + 1) {
+    lost = head - from - (traceMask + 1);
+    from = head - (traceMask + 1);
+  }
+
+  unsigned long long i;
+  for(i = from; i < head; i++) {
+    TraceSlot &slot = traceSlots[i & traceMask];
+    unsigned long long seq = slot.seq.load(std::memory_order_acquire);
+
+    TraceSpan span;
+    unsigned long long phaseThread = slot.phaseThread.load(std::memory_order_relaxed);
+    span.phase = (TracePhase) (phaseThread >> 32);
+    span.thread = (unsigned int) phaseThread;
+    span.start = slot.start.load(std::memory_order_relaxed);
+    span.end = slot.end.load(std::memory_order_relaxed);
+    span.arg = slot.arg.load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    unsigned long long again = slot.seq.load(std::memory_order_relaxed);
+
+    // A span still being written is collected by the next call
+    if(seq < 2 * i + 2 || again < 2 * i + 2) break;
+
+    // Overwritten by a later span
+    if(seq != 2 * i + 2 || again != seq) {
+      lost++;
+      continue;
+    }
+
+    spans.push_back(span);
+  }
+
+  traceTail = i;
+  return lost;
+}
+
+const char *Trace::getPhaseName(TracePhase phase)
+{
+  static const char *names[TRACE_PHASE_COUNT] = {
+    "lookup", "index search", "bisection", "read entry", "inflate", "decode", "format"
+  };
+
+  return phase < TRACE_PHASE_COUNT ? names[phase] : "unknown";
+}
+
+unsigned long long Trace::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void Trace::record(const TraceSpan &recorded)
+{
+  static std::atomic<unsigned int> threadCount(0);
+  static thread_local unsigned int thread = 0;
+  if(thread == 0)
+    thread = ++threadCount;
+
+  TraceSpan span = recorded;
+  span.thread = thread;
+
+  if(traceCallback != nullptr)
+    traceCallback(span, traceData);
+
+  if(traceSlots == nullptr) return;
+
+  unsigned long long n = traceHead.fetch_add(1, std::memory_order_relaxed);
+  TraceSlot &slot = traceSlots[n & traceMask];
+
+  slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.phaseThread.store(((unsigned long long) span.phase << 32) | span.thread, std::memory_order_relaxed);
+  slot.start.store(span.start, std::memory_order_relaxed);
+  slot.end.store(span.end, std::memory_order_relaxed);
+  slot.arg.store(span.arg, std::memory_order_relaxed);
+  slot.seq.store(2 * n + 2, std::memory_order_release);
+}
@@ -17,6 +17,11 @@
  * OF THIS SOFTWARE OR ITS FITNESS FOR ANY PARTICULAR PURPOSE.
  ****************************************************************************/
 
+#include <string.h>
+#include <stdint.h>
+
+#include <vector>
+
 #include "utf8.h"
 
 #define nelem(x) (sizeof(x) / sizeof(x[0]))
@@ -28,16 +33,22 @@ enum
   Bit2 = 5,
   Bit3 = 4,
   Bit4 = 3,
+  Bit5 = 2,
 
   T1 = ((1<<(Bit1+1))-1) ^ 0xFF,  /* 0000 0000 */
   Tx = ((1<<(Bitx+1))-1) ^ 0xFF,  /* 1000 0000 */
   T2 = ((1<<(Bit2+1))-1) ^ 0xFF,  /* 1100 0000 */
   T3 = ((1<<(Bit3+1))-1) ^ 0xFF,  /* 1110 0000 */
   T4 = ((1<<(Bit4+1))-1) ^ 0xFF,  /* 1111 0000 */
+  T5 = ((1<<(Bit5+1))-1) ^ 0xFF,  /* 1111 1000 */
 
   Rune1 = (1<<(Bit1+0*Bitx))-1,   /* 0000 0000 0111 1111 */
   Rune2 = (1<<(Bit2+1*Bitx))-1,   /* 0000 0111 1111 1111 */
   Rune3 = (1<<(Bit3+2*Bitx))-1,   /* 1111 1111 1111 1111 */
+  Rune4 = (1<<(Bit4+3*Bitx))-1,   /* 0001 1111 1111 1111 1111 1111 */
+
+  Runemax   = 0x10FFFF,           /* highest code point in Unicode */
+  Runeerror = 0xFFFD,             /* replacement character */
 
   Maskx = (1<<Bitx)-1,            /* 0011 1111 */
   Testx = Maskx ^ 0xFF,           /* 1100 0000 */
@@ -826,7 +837,7 @@ unsigned int tolower1[] =
 
 static unsigned int chartorune(char **buf)
 {
-  int c, c1, c2;
+  int c, c1, c2, c3;
   long l;
   char *str = *buf;
 
@@ -874,6 +885,22 @@ static unsigned int chartorune(char **buf)
     return l;
   }
 
+  /*
+   * four character sequence
+   *  10000-10FFFF => T4 Tx Tx Tx
+   */
+  c3 = *(unsigned char*)(str+3) ^ Tx;
+  if(c3 & Testx)
+    goto bad;
+  if(c < T5) {
+    l = ((((((c << Bitx) | c1) << Bitx) | c2) << Bitx) | c3) & Rune4;
+    if(l <= Rune3 || l > Runemax)
+      goto bad;
+
+    *buf = str + 4;
+    return l;
+  }
+
   /*
    * bad decoding
    */
@@ -909,16 +936,105 @@ static int runetochar(char *str, unsigned int rune)
    * three character sequence
    *  0800-FFFF => T3 Tx Tx
    */
-  str[0] = T3 |  (c >> 2*Bitx);
-  str[1] = Tx | ((c >> 1*Bitx) & Maskx);
-  str[2] = Tx |  (c & Maskx);
-  return 3;
+  if(c > Runemax)
+    c = Runeerror;
+  if(c <= Rune3) {
+    str[0] = T3 |  (c >> 2*Bitx);
+    str[1] = Tx | ((c >> 1*Bitx) & Maskx);
+    str[2] = Tx |  (c & Maskx);
+    return 3;
+  }
+
+  /*
+   * four character sequence
+   *  10000-10FFFF => T4 Tx Tx Tx
+   */
+  str[0] = T4 |  (c >> 3*Bitx);
+  str[1] = Tx | ((c >> 2*Bitx) & Maskx);
+  str[2] = Tx | ((c >> 1*Bitx) & Maskx);
+  str[3] = Tx |  (c & Maskx);
+  return 4;
+}
+
+/*
+ * Two-level case mapping table
+ *
+ * Built once from the range and singlet tables above. The first level is
+ * indexed by the high byte of a BMP rune and selects a page of 256 deltas;
+ * pages without any mapping share the identity page 0. All the mapped runes
+ * are in the BMP, anything above U+FFFF maps to itself.
+ */
+class CaseTable
+{
+  unsigned char page[256];
+  std::vector<short> delta;
+
+  void set(unsigned int c, unsigned int mapped)
+  {
+    int p = c >> 8;
+    if(page[p] == 0) {
+      page[p] = delta.size() >> 8;
+      delta.resize(delta.size() + 256, 0);
+    }
+    delta[(page[p] << 8) | (c & 0xFF)] = mapped - c;
+  }
+
+public:
+  CaseTable(const unsigned int *ranges, int nranges,
+            const unsigned int *singlets, int nsinglets) : delta(256, 0)
+  {
+    memset(page, 0, sizeof(page));
+
+    // ranges take precedence over singlets, so they are applied last
+    for(int i = 0; i < nsinglets; i++) {
+      const unsigned int *p = singlets + i*2;
+      set(p[0], p[0] + p[1] - 500);
+    }
+
+    for(int i = 0; i < nranges; i++) {
+      const unsigned int *p = ranges + i*3;
+      for(unsigned int c = p[0]; c <= p[1]; c++) {
+        set(c, c + p[2] - 500);
+      }
+    }
+  }
+
+  unsigned int map(unsigned int c) const
+  {
+    if(c > 0xFFFF) {
+      return c;
+    }
+
+    return c + delta[(page[c >> 8] << 8) | (c & 0xFF)];
+  }
+};
+
+static const CaseTable &upperTable()
+{
+  static const CaseTable table(toupper2, nelem(toupper2) / 3, toupper1, nelem(toupper1) / 2);
+  return table;
 }
 
-static unsigned int *bsearch(unsigned int c, unsigned int *t,
-                             int n, int ne)
+static const CaseTable &lowerTable()
 {
-  unsigned int *p;
+  static const CaseTable table(tolower2, nelem(tolower2) / 3, tolower1, nelem(tolower1) / 2);
+  return table;
+}
+
+unsigned int Utf8::runetolower(unsigned int c)
+{
+  return lowerTable().map(c);
+}
+
+unsigned int Utf8::runetoupper(unsigned int c)
+{
+  return upperTable().map(c);
+}
+
+static const unsigned int *bsearch(unsigned int c, const unsigned int *t,
+                                   int n, int ne)
+{
+  const unsigned int *p;
 
   while(n > 1)
   {
@@ -941,26 +1057,9 @@ static unsigned int *bsearch(unsigned int c, unsigned int *t,
   return nullptr;
 }
 
-static unsigned int runetolower(unsigned int c)
-{
-  unsigned *p;
-
-  p = bsearch(c, tolower2, nelem(tolower2) / 3, 3);
-  if(p && c >= p[0] && c <= p[1]) {
-    return c + p[2] - 500;
-  }
-
-  p = bsearch(c, tolower1, nelem(tolower1) / 2, 2);
-  if(p && c == p[0]) {
-    return c + p[1] - 500;
-  }
-
-  return c;
-}
-
-unsigned int Utf8::runetoupper(unsigned int c)
+unsigned int Utf8::runetoupperSearch(unsigned int c)
 {
-  unsigned *p;
+  const unsigned int *p;
 
   p = bsearch(c, toupper2, nelem(toupper2) / 3, 3);
   if(p && c >= p[0] && c <= p[1]) {
@@ -979,7 +1078,8 @@ int Utf8::tolower(const char *s, char *buf, int buflen)
 {
   int j = 0;
 
-  while(*s != 0 && buflen > 3) {
+  // leave room for the longest sequence and the terminating zero
+  while(*s != 0 && buflen > 4) {
     unsigned int n = ::chartorune((char **) &s);
     if(n == 128) {
       return 0;
@@ -990,6 +1090,7 @@ int Utf8::tolower(const char *s, char *buf, int buflen)
     int i = runetochar(buf, n);
     buf += i;
     j += i;
+    buflen -= i;
   }
 
   *buf = 0;
@@ -1000,7 +1101,8 @@ int Utf8::toupper(const char *s, char *buf, int buflen)
 {
   int j = 0;
 
-  while(*s != 0 && buflen > 3) {
+  // leave room for the longest sequence and the terminating zero
+  while(*s != 0 && buflen > 4) {
     unsigned int n = ::chartorune((char **) &s);
     if(n == 128) {
       return 0;
@@ -1011,6 +1113,7 @@ int Utf8::toupper(const char *s, char *buf, int buflen)
     int i = runetochar(buf, n);
     buf += i;
     j += i;
+    buflen -= i;
   }
 
   *buf = 0;
@@ -1020,10 +1123,22 @@ int Utf8::toupper(const char *s, char *buf, int buflen)
 int Utf8::toupper(const std::string &str, std::string &result)
 {
   const char *s = str.c_str();
+  const char *e = s + str.size();
   char buf[10];
 
   result.erase();
+  result.reserve(str.size());
   while(*s != 0) {
+    // copy runs of ASCII without decoding them
+    int a = asciiSpan(s, e - s);
+    for(const char *ae = s + a; s < ae; s++) {
+      char c = *s;
+      result.push_back(c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c);
+    }
+    if(*s == 0) {
+      break;
+    }
+
     unsigned int n = ::chartorune((char **) &s);
     if(n == 128) {
       return 0;
@@ -1041,10 +1156,22 @@ int Utf8::toupper(const std::string &str, std::string &result)
 int Utf8::tolower(const std::string &str, std::string &result)
 {
   const char *s = str.c_str();
+  const char *e = s + str.size();
   char buf[10];
 
   result.erase();
+  result.reserve(str.size());
   while(*s != 0) {
+    // copy runs of ASCII without decoding them
+    int a = asciiSpan(s, e - s);
+    for(const char *ae = s + a; s < ae; s++) {
+      char c = *s;
+      result.push_back(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+    }
+    if(*s == 0) {
+      break;
+    }
+
     unsigned int n = ::chartorune((char **) &s);
     if(n == 128) {
       return 0;
@@ -1068,3 +1195,29 @@ int Utf8::runetochar(char *b, int rune)
 {
   return ::runetochar(b, rune);
 }
+
+int Utf8::asciiSpan(const char *s, int len)
+{
+  const uint64_t ones  = 0x0101010101010101ULL;
+  const uint64_t highs = 0x8080808080808080ULL;
+  int i = 0;
+
+  // Eight bytes at a time (SWAR). A word is plain ASCII when none of its
+  // bytes has the high bit set and none of them is zero.
+  for( ; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, s + i, sizeof(w));
+    if(((w | ((w - ones) & ~w)) & highs) != 0) {
+      break;
+    }
+  }
+
+  for( ; i < len; i++) {
+    unsigned char c = s[i];
+    if(c == 0 || c >= Tx) {
+      break;
+    }
+  }
+
+  return i;
+}
@@ -36,6 +36,8 @@
 #include <sstream>
 #include <set>
 
+#include "bedic.h"
+#include "block_checksums.h"
 #include "dictionary_impl.h"
 #include "utf8.h"
 
@@ -77,11 +79,11 @@ struct entry_type {
   std:: string word;
   CanonizedWord canonizedWord;
   int fidx;
-  int pos;
+  off_t pos;
   int len;
-  int offset;
+  off_t offset;
 
-  entry_type(const std::string &w, const CanonizedWord &canonizedWord, int i, int p) :
+  entry_type(const std::string &w, const CanonizedWord &canonizedWord, int i, off_t p) :
                    word(w), canonizedWord(canonizedWord), fidx(i), pos(p)
   {
   }
@@ -225,20 +227,17 @@ bool XeroxDict::xerox(int fd, const std::string &compress_method, bool do_sort)
   EntryList entries;
   unsigned int mrl = 0;
   unsigned int mwl = 0;
-  long dsize = 0;
+  off_t dsize = 0;
 
   std::set<int> usedCharacters;
 
   std::cerr << "Reading the entries ...\n";
   int n = 0;
+  setSequentialAccess(true);
   firstEntry();
   do {
     checkIfError();
 
-    // Check if we fit into long maximum value, -2000000 to avoid overflow before the check
-    if(currPos > LONG_MAX-2000000)
-      throw XeroxException( "Maximum dictionary length exceeded" );
-
     std::string w = getWord();
     if(mwl < w.size()) {
       mwl = w.size();
@@ -309,6 +308,9 @@ bool XeroxDict::xerox(int fd, const std::string &compress_method, bool do_sort)
     n++;		
   } while(nextEntry());
 
+  // the entries are written in sorted order, which jumps around the file
+  setSequentialAccess(false);
+
   // Sort entries
   if(do_sort) {
     std::cerr << "Sorting ...\n";
@@ -325,21 +327,21 @@ bool XeroxDict::xerox(int fd, const std::string &compress_method, bool do_sort)
     }
   }
 
-  n = 0;
+  off_t offset = 0;
   for(unsigned int i = 0; i < entries.size(); i++) {
-    entries[i].offset = n;
-    n += entries[i].len;
+    entries[i].offset = offset;
+    offset += entries[i].len;
   }
 
   std::string idx;
-  n = -32769;
+  off_t indexed = -32769;
   char *ibuf = new char[mwl+32];
   for(unsigned int i = 0; i < entries.size() - 1; i++) {
-    if(n + 32768 < entries[i].offset) {
+    if(indexed + 32768 < entries[i].offset) {
       idx += (char) 0;
-      snprintf(ibuf, mwl+32, "%s\n%d", entries[i].word.c_str(), entries[i].offset);
+      snprintf(ibuf, mwl+32, "%s\n%lld", entries[i].word.c_str(), (long long) entries[i].offset);
       idx += ibuf;
-      n = entries[i].offset;
+      indexed = entries[i].offset;
     }
   }
   delete []ibuf;
@@ -367,7 +369,19 @@ bool XeroxDict::xerox(int fd, const std::string &compress_method, bool do_sort)
     prop["index"] = idx;
   }
 
-  snprintf(buf, sizeof(buf), "%ld", dsize);
+  // Offset of every 64th entry, for access by ordinal
+  std::string ordinalIdx = "64";
+  for(unsigned int i = 0; i < entries.size(); i += 64) {
+    snprintf(buf, sizeof(buf), " %lld", (long long) entries[i].offset);
+    ordinalIdx += buf;
+  }
+  prop["ordinal-index"] = ordinalIdx;
+
+  // Filled in once the entries are written
+  prop["block-checksums"] = BlockChecksums::placeholder(dsize);
+  off_t checksumsPos = -1;
+
+  snprintf(buf, sizeof(buf), "%lld", (long long) dsize);
   prop["dict-size"] = buf;
 
   snprintf(buf, sizeof(buf), "%ld", (long)entries.size());
@@ -382,7 +396,8 @@ bool XeroxDict::xerox(int fd, const std::string &compress_method, bool do_sort)
   while(pit != prop.end())
   {
     std::pair<const std::string, std::string> entry = *pit;
-    const char *s = escape(entry.first).c_str();
+    std::string en = escape(entry.first);
+    const char *s = en.c_str();
     unsigned int n = write(fd, s, strlen(s));
     if(n != strlen(s)) {
       return false;
@@ -392,6 +407,10 @@ bool XeroxDict::xerox(int fd, const std::string &compress_method, bool do_sort)
       return false;
     }
 
+    if(entry.first == "block-checksums") {
+      checksumsPos = lseek(fd, 0, SEEK_CUR);
+    }
+
     std::string es = escape(entry.second);
     s = es.c_str();
     n = write(fd, s, strlen(s));
@@ -408,6 +427,8 @@ bool XeroxDict::xerox(int fd, const std::string &compress_method, bool do_sort)
   buf[0] = 0;
   write(fd, buf, 1);
 
+  BlockChecksums checksums;
+
   for(unsigned int i = 0; i < entries.size(); i++) {
     readEntry(entries[i].pos);
     checkIfError();
@@ -424,12 +445,22 @@ bool XeroxDict::xerox(int fd, const std::string &compress_method, bool do_sort)
     write(fd, s.c_str(), s.size());
     write(fd, ddelim, sizeof(ddelim));
 
+    checksums.add(w.c_str(), w.size());
+    checksums.add(wdelim, sizeof(wdelim));
+    checksums.add(s.c_str(), s.size());
+    checksums.add(ddelim, sizeof(ddelim));
+
     if(i % 1024 == 0) {
       std::cerr << ".";
     }
   }
   std::cerr << "\n";
 
+  std::string cs = checksums.toString();
+  if(checksumsPos < 0 || pwrite(fd, cs.c_str(), cs.size(), checksumsPos) != (ssize_t) cs.size()) {
+    return false;
+  }
+
   return true;
 }
 
@@ -461,6 +492,7 @@ std::vector<std::string> XeroxDict::findAllCharacters(void)
   
   std::cerr << "Reading the entries and looking for all letters...\n";
   std::set<std::string> foundLetters;
+  setSequentialAccess(true);
   firstEntry();
   do {
     std::string w = getWord();
@@ -486,6 +518,7 @@ std::vector<std::string> XeroxDict::findAllCharacters(void)
       cBeg = cEnd;
     }
   } while(nextEntry());
+  setSequentialAccess(false);
 
   std::vector<std::string> letterVec(foundLetters.begin(), foundLetters.end());
 //   map<string, bool>::iterator it;
@@ -501,7 +534,7 @@ std::vector<std::string> XeroxDict::findAllCharacters(void)
 
 static void printHelp() {
   std::cerr << "Usage: " PROG_NAME " [-d] [--generate-char-precedence] [--verbose] [--help] infile"
- " [outfile]\nSee the man page for more information\n";
+ " [outfile]\n       " PROG_NAME " --compact dicfile.hdic\nSee the man page for more information\n";
 }
 
 static void errorCheck(bool condition, const char *description)
@@ -515,6 +548,7 @@ static void errorCheck(bool condition, const char *description)
 int main(int argc, char **argv) {
 
   bool generateCharPrecedence = false;
+  bool compact = false;
   
   try {
     const char *cmth = "none";
@@ -524,13 +558,14 @@ int main(int argc, char **argv) {
       { "help", no_argument, nullptr, 'h' },
       { "verbose", no_argument, nullptr, 'v' },
       { "generate-char-precedence", required_argument, nullptr, 'g' },
+      { "compact", no_argument, nullptr, 'c' },
       { nullptr, 0, nullptr, 0 }
     };
 
     int optionIndex = 0;
     while(1)
     {
-      int c = getopt_long(argc, argv, "hvdg:s", cmdLineOptions, &optionIndex);
+      int c = getopt_long(argc, argv, "hvdg:sc", cmdLineOptions, &optionIndex);
       if(c == -1) break;
       switch(c) {
       case 'h':
@@ -543,6 +578,9 @@ int main(int argc, char **argv) {
         generateCharPrecedence = true;
         localeForCharPrec = optarg;
         break;
+      case 'c':
+        compact = true;
+        break;
       case 'd':                 // Ignore
         break;
       case '?':
@@ -554,6 +592,16 @@ int main(int argc, char **argv) {
 
     const char *sourceFileName, *destFileName;
 
+    if(compact) {
+      errorCheck(optind == argc - 1, "A single hybrid dictionary file must be specified");
+
+      std::string errorMessage;
+      if(!compactHybridDictionary(argv[optind], errorMessage))
+        throw XeroxException(errorMessage.c_str());
+
+      return EXIT_SUCCESS;
+    }
+
     if(generateCharPrecedence)
       errorCheck(optind == argc - 1, "A single dictionary file must be specified");
     else
@@ -610,5 +658,6 @@ int main(int argc, char **argv) {
   }
   catch(XeroxException &ex) {
     std::cerr << PROG_NAME ": " << ex.what() << "\n";
+    return EXIT_FAILURE;
   }
 }